@@ -0,0 +1,179 @@
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "HandyString.h"
+
+// Most endpoints in a group (Primary plus backups)
+#define CASTER_GROUP_MAX 4
+
+// Health penalties. These decay by half every CASTER_PENALTY_HALF_LIFE
+#define CASTER_PENALTY_CONNECT 30 // Could not open the connection
+#define CASTER_PENALTY_REJECT 40  // Caster refused the SOURCE or POST
+#define CASTER_PENALTY_DROP 20	  // Working connection lost
+#define CASTER_PENALTY_HALF_LIFE 120000
+
+// Most penalty an endpoint can build up. A caster that has been dead for
+// .. hours is back in use within a few half lives of it recovering
+#define CASTER_PENALTY_MAX 100
+
+// Lower priority endpoints score less so we return to the primary when healthy
+#define CASTER_PRIORITY_PENALTY 25
+
+// Score difference needed before we move while streaming. Between connection
+// .. attempts there is nothing to lose so any better endpoint is taken, but
+// .. only after the retry wait (NTRIPServer allows one early switch for each
+// .. run of failures). With
+// .. these values a primary that fails one connect (Score 70) loses to the
+// .. first backup (75) on the next attempt. Streaming on the backup we go back
+// .. once the primary penalty has decayed below 5 (About 6 minutes)
+#define CASTER_HYSTERESIS 20
+
+// Minimum time on an endpoint before a planned switch (ms)
+#define CASTER_MIN_DWELL 60000
+
+///////////////////////////////////////////////////////////////////////////////
+// One address for the mount point
+struct CasterEndpoint
+{
+	std::string host;				// Address of the caster
+	int port = 0;					// Port of the caster
+	int penalty = 0;				// Health penalty from errors
+	unsigned long penaltyTime = 0;	// Millis when the penalty was last updated
+	unsigned long sendMicros = 0;	// Average write time while active
+	unsigned long activeTime = 0;	// Total time streaming on this endpoint (ms)
+	int errors = 0;					// Total errors on this endpoint
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Ordered list of casters serving the same logical mount point. Each has a
+// .. health score made from its error history (decaying over time), its
+// .. write latency and its position in the list. We move to a better endpoint
+// .. only when it beats the current one by CASTER_HYSTERESIS so a single
+// .. glitch does not bounce us between casters
+class CasterGroup
+{
+private:
+	std::vector<CasterEndpoint> _endpoints;	// Primary first
+	int _current = 0;						// Endpoint in use
+	unsigned long _switchTime = 0;			// Millis when we last changed endpoint
+	unsigned long _tickTime = 0;			// Last time active time was updated
+	int _failovers = 0;						// Number of endpoint changes
+
+public:
+	inline CasterEndpoint &Current() { return _endpoints[_current]; }
+	inline const CasterEndpoint &Current() const { return _endpoints[_current]; }
+	inline int CurrentIndex() const { return _current; }
+	inline const std::vector<CasterEndpoint> &GetEndpoints() const { return _endpoints; }
+	inline int GetFailovers() const { return _failovers; }
+	inline unsigned long GetSwitchTime() const { return _switchTime; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Build the group from the primary and a list of backups
+	// @param backups Comma separated host:port list like "a.com:2101,b.com:2102"
+	void Setup(const std::string &host, int port, const std::string &backups)
+	{
+		_endpoints.clear();
+		_endpoints.push_back(CasterEndpoint());
+		_endpoints[0].host = host;
+		_endpoints[0].port = port;
+		_current = 0;
+
+		if (backups.empty())
+			return;
+		for (const auto &item : Split(backups, ","))
+		{
+			if (_endpoints.size() >= CASTER_GROUP_MAX || item.empty())
+				continue;
+			CasterEndpoint endpoint;
+			auto colon = item.find(':');
+			endpoint.host = item.substr(0, colon);
+			endpoint.port = colon == std::string::npos ? port : atoi(item.c_str() + colon + 1);
+			_endpoints.push_back(endpoint);
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Record a failure against the current endpoint
+	void OnFailure(int penalty)
+	{
+		CasterEndpoint &endpoint = Current();
+		endpoint.penalty = min(DecayedPenalty(endpoint) + penalty, CASTER_PENALTY_MAX);
+		endpoint.penaltyTime = millis();
+		endpoint.errors++;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Record the time a write took on the current endpoint
+	inline void OnSend(unsigned long micros)
+	{
+		Current().sendMicros = (Current().sendMicros * 15 + micros) / 16;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Add to the time streaming on the current endpoint
+	void Tick(bool streaming)
+	{
+		unsigned long now = millis();
+		if (streaming)
+			Current().activeTime += now - _tickTime;
+		_tickTime = now;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Health score. Higher is better
+	int Score(int index) const
+	{
+		const CasterEndpoint &endpoint = _endpoints[index];
+		int score = 100 - DecayedPenalty(endpoint) - index * CASTER_PRIORITY_PENALTY;
+
+		// Slow writes count against us (Over 10ms average starts to cost)
+		score -= min(50, (int)(endpoint.sendMicros / 10000));
+		return score;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Move to the best endpoint if it beats the current one. Used between
+	// .. connection attempts. There is no hysteresis here so the caller must
+	// .. keep its retry wait or every failure would bounce to the other end
+	// @return true if the endpoint changed
+	bool Choose()
+	{
+		int best = Best();
+		if (best == _current)
+			return false;
+		_current = best;
+		_switchTime = millis();
+		_failovers++;
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Check if a working connection should be given up for a better endpoint
+	bool ShouldSwitch() const
+	{
+		if ((millis() - _switchTime) < CASTER_MIN_DWELL)
+			return false;
+		int best = Best();
+		return best != _current && Score(best) - Score(_current) >= CASTER_HYSTERESIS;
+	}
+
+private:
+	int Best() const
+	{
+		int best = _current;
+		for (int n = 0; n < (int)_endpoints.size(); n++)
+		{
+			if (Score(n) > Score(best))
+				best = n;
+		}
+		return best;
+	}
+
+	static int DecayedPenalty(const CasterEndpoint &endpoint)
+	{
+		int halves = (millis() - endpoint.penaltyTime) / CASTER_PENALTY_HALF_LIFE;
+		return halves >= 16 ? 0 : endpoint.penalty >> halves;
+	}
+};
@@ -26,13 +26,17 @@
 	#define DISPLAY_POWER_PIN 15
 #endif
 
-#define MAX_LOG_LENGTH (200)
-#define MAX_LOG_SIZE (MAX_LOG_LENGTH * 80)
-
 #define RTK_SERVERS 3
 
 #define GPS_BUFFER_SIZE (16*1024)
 
+// Second receiver on UART 2. Only where the chip has a third UART (Not the S2)
+#if SOC_UART_NUM > 2
+	#define GPS2_SERIAL Serial2
+	#define GPS2_RX_PIN 32
+	#define GPS2_TX_PIN 33
+#endif
+
 // One 1 buttons on right, 3 Buttons on left
 #define TFT_ROTATION  3
 
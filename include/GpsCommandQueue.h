@@ -20,9 +20,10 @@ private:
 	std::string _deviceFirmware = "UNKNOWN";	// Firmware version
 	std::string _deviceSerial = "UNKNOWN";		// Serial number
 	std::function<void(std::string)> _logToGps; // Log to GPS function
+	Stream &_port;								// Serial port of the receiver
 
 public:
-	GpsCommandQueue(std::function<void(std::string)> logFunc)
+	GpsCommandQueue(std::function<void(std::string)> logFunc, Stream &port) : _port(port)
 	{
 		_logToGps = logFunc;
 	}
@@ -218,7 +219,7 @@ public:
 		if (_strings.empty())
 			return;
 		_logToGps("GPS -> " + _strings.front());
-		Serial1.println(_strings.front().c_str());
+		_port.println(_strings.front().c_str());
 		_timeSent = millis();
 	}
 };
@@ -2,15 +2,32 @@
 
 #include <string>
 #include <vector>
+#include "LogRing.h"
+#include "LogFormat.h"
+#include "LogLimiter.h"
+#include "LogIngest.h"
 
 void SetupLog();
-std::string Logln(const char *msg);
+void Logln(const char *msg, LogSource source = LOG_SYSTEM);
 
-template<typename... Args>
-void Logf(const std::string& format, Args... args);
+template <size_t N, typename... Args>
+void Logf(const char (&format)[N], Args... args);
+template <size_t N, typename... Args>
+void Logf(LogSource source, const char (&format)[N], Args... args);
 
+// The format is kept by address so it must not be a buffer
+template <size_t N, typename... Args>
+void Logf(char (&format)[N], Args... args) = delete;
+
+void LogFlushSuppressed();
+byte *LogReserve(LogSource source, int length);
+void LogCommit(byte *pPayload);
+void LogDrain();
+uint32_t GetLogIngestDropped();
 const std::string Uptime(unsigned long millis);
-const void TruncateLog( std::vector<std::string> &log );
-const std::vector<std::string> CopyMainLog();
+const LogRing<LOG_ARENA_SIZE> &GetLog();
+const LogLimiter &GetLogLimiter();
+const char *LogSourceName(uint8_t source);
+uint8_t LogSourceFromKey(const char *key);
 
 #include "HandyLog.tpp"
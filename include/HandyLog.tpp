@@ -1,26 +1,29 @@
 #include "HandyLog.h"
 
 #include <string>
-#include <HardwareSerial.h>
-#include <memory>
 
 ///////////////////////////////////////////////////////////////////////////////
-// Taken from
-//	https://stackoverflow.com/questions/2342162/stdstring-formatting-like-sprintf
-// Answer by iFreiticht
-template<typename... Args>
-void Logf(const std::string& format, Args... args)
+// Log the format string and the raw arguments. The text is only made when
+// .. the log is viewed. Safe from any task. Messages with a code are dropped
+// .. by the consumer once the code has been logged too often
+// @param format String literal using printf conversions
+template <size_t N, typename... Args>
+void Logf(LogSource source, const char (&format)[N], Args... args)
 {
-	int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) + 1;  // Extra space for '\0'
-	if (size_s <= 0)
-	{
-		perror("E910 - Unable to allocate string size. ");
-		Logln(format.c_str());
+	const char *pFormat = format;
+	int length = min((int)sizeof(pFormat) + LogArgsSize(args...), LOG_RECORD_MAX);
+	byte *pPayload = LogReserve(source, length);
+	if (pPayload == nullptr)
 		return;
-	}
-	auto size = static_cast<size_t>(size_s);
-	std::unique_ptr<char[]> buf(new char[size]);
-	std::snprintf(buf.get(), size, format.c_str(), args...);
-	Logln(std::string(buf.get(), buf.get() + size - 1).c_str());  // We don't want the '\0' inside
+	memcpy(pPayload, &pFormat, sizeof(pFormat));
+	LogArgsPack(pPayload + sizeof(pFormat), pPayload + length, args...);
+	LogCommit(pPayload);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Log to the system log
+template <size_t N, typename... Args>
+void Logf(const char (&format)[N], Args... args)
+{
+	Logf(LOG_SYSTEM, format, args...);
+}
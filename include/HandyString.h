@@ -1,11 +1,15 @@
 #pragma once
 
+// Text StringPrintf makes on the stack before copying to the string
+#define STRING_PRINTF_STACK 128
+
 #include <WiFi.h>
 #include <string>
 #include <vector>
+#include "TextBuilder.h"
 
 template<typename... Args>
-std::string StringPrintf(const std::string& format, Args... args);
+std::string StringPrintf(const char *format, Args... args);
 
 bool StartsWith(const std::string& fullString, const std::string& startString);
 bool StartsWith(const char* szA, const char* szB);
@@ -22,5 +26,8 @@ std::string ReplaceNewlineWithTab(const std::string& input);
 std::string Replace(const std::string &input, const std::string &search, const std::string &replace);
 void RemoveLastLfCr(std::string &str);
 void ReplaceCrLfEncode(std::string &str);
+std::string Base64Encode(const std::string &text);
+std::string GetOption(const std::string &options, const std::string &key, const std::string &defaultValue);
+int GetOption(const std::string &options, const std::string &key, int defaultValue);
 
 #include "HandyString.tpp"
@@ -3,17 +3,18 @@
 #include "HandyLog.h"
 
 ///////////////////////////////////////////////////////////////////////////////
-// Taken from
-//	https://stackoverflow.com/questions/2342162/stdstring-formatting-like-sprintf
-// Answer by iFreiticht
+// printf into a std::string. Most text fits the stack buffer so is formatted
+// .. once and copied in. Only longer text is formatted again into the string
 template<typename... Args>
-std::string StringPrintf(const std::string& format, Args... args)
+std::string StringPrintf(const char *format, Args... args)
 {
-	int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) + 1;  // Extra space for '\0'
-	if (size_s <= 0)
-		throw std::runtime_error("Unable to allocate string size.");
-	auto size = static_cast<size_t>(size_s);
-	std::unique_ptr<char[]> buf(new char[size]);
-	std::snprintf(buf.get(), size, format.c_str(), args...);
-	return std::string(buf.get(), buf.get() + size - 1);  // We don't want the '\0' inside
+	char text[STRING_PRINTF_STACK];
+	int size = std::snprintf(text, sizeof(text), format, args...);
+	if (size < 0)
+		throw std::runtime_error("Unable to format string.");
+	if (size < (int)sizeof(text))
+		return std::string(text, size);
+	std::string result(size, '\0');
+	std::snprintf(&result[0], size + 1, format, args...);
+	return result;
 }
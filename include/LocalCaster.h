@@ -0,0 +1,87 @@
+#pragma once
+
+// Most rovers served at once
+#define LOCAL_CASTER_MAX_CLIENTS 4
+
+// Bytes of the rover request kept for parsing
+#define LOCAL_CASTER_REQUEST_MAX 512
+
+// Time a new connection has to send its request (ms)
+#define LOCAL_CASTER_REQUEST_TIMEOUT 5000
+
+// Drop a rover that has taken nothing for this long (ms)
+#define LOCAL_CASTER_STALL_TIMEOUT 10000
+
+// Mount point when none is configured
+#define LOCAL_CASTER_MOUNT "RTK"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <WiFiServer.h>
+#include "RingWriter.h"
+#include "HandyLog.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A rover connected to the local caster
+struct LocalRover
+{
+	WiFiClient client;				   // Connection (Owns the socket)
+	std::string address;			   // Remote IP for the status page
+	bool streaming = false;			   // Request accepted and receiving RTCM
+	bool ntripV2 = false;			   // Rover asked for NTRIP v2
+	char request[LOCAL_CASTER_REQUEST_MAX + 1]; // Request header as it arrives
+	int requestLength = 0;			   // Bytes in request
+	RingWriter writer;				   // Position in the frame ring
+	unsigned long connectTime = 0;	   // Millis when the rover connected
+	unsigned long progressTime = 0;	   // Millis when the rover last took data
+	unsigned long lag = 0;			   // Age of the oldest frame not yet sent (ms)
+	uint32_t received = 0;			   // Bytes the rover sent after its request (Read and dropped)
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Embedded NTRIP v1/v2 caster so rovers on the same network get corrections
+// .. without a trip through the internet. Configured with one line of options
+//		port=2101 mount=RTK user=rover password=secret
+// .. Each rover has its own cursor into the shared frame ring like the caster
+// .. uplinks so frames are never copied per rover and a slow rover only
+// .. falls behind on its own
+class LocalCaster
+{
+public:
+	void LoadSettings();
+	void Save(const char *options) const;
+	void Loop(const RtcmFrameRing &ring);
+
+	inline bool IsEnabled() const { return _port > 0; }
+	inline int GetPort() const { return _port; }
+	inline const std::string &GetMount() const { return _sMount; }
+	inline const std::string &GetOptions() const { return _sOptions; }
+	inline const std::vector<std::unique_ptr<LocalRover>> &GetRovers() const { return _rovers; }
+	inline int GetRoversServed() const { return _roversServed; }
+	inline int GetRejected() const { return _rejected; }
+	inline int GetSourceTables() const { return _sourceTables; }
+
+private:
+	std::unique_ptr<WiFiServer> _pServer;			 // Listening socket (Created on first loop)
+	std::vector<std::unique_ptr<LocalRover>> _rovers; // Connected rovers
+	std::string _sOptions;							 // Settings line
+	int _port = 0;									 // Listening port (0 = off)
+	std::string _sMount = LOCAL_CASTER_MOUNT;		 // Mount point served
+	std::string _sAuth;								 // Expected Basic auth token (Empty = open)
+	int _roversServed = 0;							 // Total rovers that received RTCM
+	int _rejected = 0;								 // Requests refused
+	int _sourceTables = 0;							 // Source tables sent
+
+	void Accept();
+	bool ReadRequest(LocalRover &rover, const RtcmFrameRing &ring);
+	void SendSourceTable(LocalRover &rover);
+	bool StreamTo(LocalRover &rover, const RtcmFrameRing &ring);
+	static std::string HeaderValue(const char *request, const char *name);
+	void LogX(std::string text);
+	template <size_t N, typename... Args>
+	void LogX(const char (&format)[N], Args... args)
+	{
+		Logf(LOG_LOCAL_CASTER, format, args...);
+	}
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <Arduino.h>
+#include <type_traits>
+#include "LogRing.h"
+
+// Type of each argument packed after the format string
+#define LOG_ARG_INTEGER 1 // Raw bytes of an integer. Sign or mask applied when shown
+#define LOG_ARG_DOUBLE 2  // Floats are promoted like printf does
+#define LOG_ARG_STRING 3  // Copy of the text as the pointer may not live
+#define LOG_ARG_POINTER 4 // Address only
+#define LOG_ARG_HEX 5	  // Raw bytes shown as hex by %s
+
+// Most bytes kept for a hex argument. Three characters each fill a line
+#define LOG_HEX_MAX (LOG_RECORD_MAX / 3)
+
+// Longest line made from one record
+#define LOG_LINE_MAX (LOG_RECORD_MAX + 64)
+
+///////////////////////////////////////////////////////////////////////////////
+// A format record holds the address of the format string then each argument
+// .. as [type][size][bytes]. Strings and hex are [type][length (2 bytes)][data]. The
+// .. format string must be a literal so the address stays good for ever.
+// .. The size is worked out first so the arguments go straight into the arena
+
+///////////////////////////////////////////////////////////////////////////////
+// Binary data for a %s conversion. The bytes are copied and only turned into
+// .. hex when the log is viewed
+struct LogHex
+{
+	const byte *pData;
+	int length;
+	LogHex(const byte *data, int size) : pData(data), length(min(max(size, 0), LOG_HEX_MAX)) {}
+};
+
+// GCC 11 and later see strnlen inlined with a short literal and a larger
+// .. limit and warn of a read past it. strnlen stops at the null so it
+// .. cannot, and strnlen is kept as GCC folds it to a constant for literals
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstringop-overread"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Bytes needed by each argument
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, int>::type LogArgSize(T)
+{
+	return 2 + sizeof(T);
+}
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, int>::type LogArgSize(T)
+{
+	return 2 + sizeof(double);
+}
+template <typename T>
+inline typename std::enable_if<std::is_pointer<T>::value, int>::type LogArgSize(T)
+{
+	return 2 + sizeof(void *);
+}
+inline int LogArgSize(const char *text)
+{
+	return 3 + (text == nullptr ? 0 : strnlen(text, LOG_RECORD_MAX));
+}
+inline int LogArgSize(char *text)
+{
+	return LogArgSize((const char *)text);
+}
+inline int LogArgSize(const LogHex &hex)
+{
+	return 3 + hex.length;
+}
+
+inline int LogArgsSize()
+{
+	return 0;
+}
+template <typename T, typename... Args>
+inline int LogArgsSize(T value, Args... args)
+{
+	return LogArgSize(value) + LogArgsSize(args...);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy one argument into the record. Anything past the end of the record is dropped
+// @return Where the next argument goes
+inline byte *LogArgPack(byte *p, byte *pEnd, byte type, const void *pValue, int size)
+{
+	if (p + 2 + size > pEnd)
+		return pEnd;
+	p[0] = type;
+	p[1] = size;
+	memcpy(p + 2, pValue, size);
+	return p + 2 + size;
+}
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, byte *>::type LogArgPack(byte *p, byte *pEnd, T value)
+{
+	return LogArgPack(p, pEnd, LOG_ARG_INTEGER, &value, sizeof(T));
+}
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, byte *>::type LogArgPack(byte *p, byte *pEnd, T value)
+{
+	double d = value;
+	return LogArgPack(p, pEnd, LOG_ARG_DOUBLE, &d, sizeof(d));
+}
+template <typename T>
+inline typename std::enable_if<std::is_pointer<T>::value, byte *>::type LogArgPack(byte *p, byte *pEnd, T value)
+{
+	const void *pAddress = value;
+	return LogArgPack(p, pEnd, LOG_ARG_POINTER, &pAddress, sizeof(pAddress));
+}
+inline byte *LogArgPackBytes(byte *p, byte *pEnd, byte type, const void *pData, int size)
+{
+	if (p + 3 > pEnd)
+		return pEnd;
+	uint16_t length = min(size, (int)(pEnd - p - 3));
+	p[0] = type;
+	memcpy(p + 1, &length, 2);
+	memcpy(p + 3, pData, length);
+	return p + 3 + length;
+}
+inline byte *LogArgPack(byte *p, byte *pEnd, const char *text)
+{
+	if (text == nullptr)
+		text = "";
+	return LogArgPackBytes(p, pEnd, LOG_ARG_STRING, text, p + 3 > pEnd ? 0 : strnlen(text, pEnd - p - 3));
+}
+inline byte *LogArgPack(byte *p, byte *pEnd, char *text)
+{
+	return LogArgPack(p, pEnd, (const char *)text);
+}
+
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+inline byte *LogArgPack(byte *p, byte *pEnd, const LogHex &hex)
+{
+	return LogArgPackBytes(p, pEnd, LOG_ARG_HEX, hex.pData, hex.length);
+}
+
+inline void LogArgsPack(byte *, byte *)
+{
+}
+template <typename T, typename... Args>
+inline void LogArgsPack(byte *p, byte *pEnd, T value, Args... args)
+{
+	LogArgsPack(LogArgPack(p, pEnd, value), pEnd, args...);
+}
+
+int LogRender(const LogRecord &record, char *pOut, int size);
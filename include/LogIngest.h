@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "LogRing.h"
+
+// Bytes for messages logged but not yet moved to the log (Power of 2)
+#define LOG_INGEST_SIZE (8 * 1024)
+
+// State of a slot in the ingest ring
+#define LOG_SLOT_FREE 0	 // Reserved and being written (Or not used yet)
+#define LOG_SLOT_READY 1 // Written and ready to move
+#define LOG_SLOT_PAD 2	 // Skip to the front of the ring
+
+///////////////////////////////////////////////////////////////////////////////
+// Header in front of each message waiting in the ingest ring. The size keeps
+// .. every header whole at the end of the ring
+struct LogSlot
+{
+	uint32_t state;	 // LOG_SLOT_xxx (Only changed with atomics)
+	uint32_t time;	 // Millis when the message was logged
+	uint16_t size;	 // Bytes used including this header (Multiple of the header size)
+	uint16_t length; // Bytes of payload
+	uint8_t source;	 // LogSource
+	uint8_t kind;	 // LOG_KIND_TEXT or LOG_KIND_FORMAT
+	uint8_t reserved[2];
+
+	inline byte *Payload() { return (byte *)(this + 1); }
+	inline const byte *Payload() const { return (const byte *)(this + 1); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Lock free path for messages from any task into the log. Producers take
+// .. space with one compare and swap on the reserve count, write the message
+// .. in place and then mark it ready. They never wait or allocate. When there
+// .. is no room the message is dropped and counted. A single consumer moves
+// .. the ready messages out in order and frees the space. A message still
+// .. being written holds back the ones after it until it is ready.
+// .. The counts run freely and wrap, so SIZE must divide 2^32
+template <uint32_t SIZE>
+class LogIngest
+{
+	static_assert((SIZE & (SIZE - 1)) == 0, "Ingest size must be a power of 2");
+	static_assert(SIZE <= 0x10000, "Slot sizes are held in 16 bits");
+	static_assert(sizeof(LogSlot) == 16, "Slot header must stay 16 bytes");
+
+private:
+	alignas(16) byte _arena[SIZE];			// Slots
+	std::atomic<uint32_t> _reserved{0};		// Bytes ever reserved by producers
+	std::atomic<uint32_t> _released{0};		// Bytes ever freed by the consumer
+	std::atomic<uint32_t> _dropped{0};		// Messages lost for lack of room
+
+	inline LogSlot *At(uint32_t position) { return (LogSlot *)(_arena + position % SIZE); }
+
+public:
+	LogIngest() { memset(_arena, 0, sizeof(_arena)); }
+
+	inline uint32_t Dropped() const { return _dropped.load(std::memory_order_relaxed); }
+	inline uint32_t Waiting() const { return _reserved.load(std::memory_order_relaxed) - _released.load(std::memory_order_relaxed); }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Take space for a message. Safe from any task
+	// @param length Bytes of payload (Cut to LOG_RECORD_MAX)
+	// @return Where the payload goes (With room for a '\0' after it) or
+	// ..	   nullptr if the ring is full
+	byte *Reserve(LogSource source, uint8_t kind, int length)
+	{
+		length = min(length, LOG_RECORD_MAX);
+		uint32_t size = (sizeof(LogSlot) + length + 1 + sizeof(LogSlot) - 1) & ~(sizeof(LogSlot) - 1);
+
+		// A message that will not fit before the end of the ring also takes
+		// .. the space up to the end so it can start again at the front
+		uint32_t head = _reserved.load(std::memory_order_relaxed);
+		uint32_t pad;
+		do
+		{
+			uint32_t offset = head % SIZE;
+			pad = offset + size > SIZE ? SIZE - offset : 0;
+			if (head + pad + size - _released.load(std::memory_order_acquire) > SIZE)
+			{
+				_dropped.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+		} while (!_reserved.compare_exchange_weak(head, head + pad + size, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+		if (pad > 0)
+		{
+			LogSlot *pPad = At(head);
+			pPad->size = pad;
+			__atomic_store_n(&pPad->state, LOG_SLOT_PAD, __ATOMIC_RELEASE);
+		}
+
+		LogSlot *pSlot = At(head + pad);
+		pSlot->time = millis();
+		pSlot->size = size;
+		pSlot->length = length;
+		pSlot->source = source;
+		pSlot->kind = kind;
+		return pSlot->Payload();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Mark a message written so the consumer can take it
+	// @param pPayload Returned by Reserve
+	static void Commit(byte *pPayload)
+	{
+		LogSlot *pSlot = (LogSlot *)pPayload - 1;
+		__atomic_store_n(&pSlot->state, LOG_SLOT_READY, __ATOMIC_RELEASE);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Pass each ready message to the callback in order and free its space.
+	// .. Only ever called by one task at a time
+	// @return Messages passed on
+	template <typename F>
+	int Drain(F callback)
+	{
+		int count = 0;
+		uint32_t tail = _released.load(std::memory_order_relaxed);
+		while (tail != _reserved.load(std::memory_order_acquire))
+		{
+			LogSlot *pSlot = At(tail);
+			uint32_t state = __atomic_load_n(&pSlot->state, __ATOMIC_ACQUIRE);
+			if (state == LOG_SLOT_FREE)
+				break;
+			if (state == LOG_SLOT_READY)
+			{
+				callback(*pSlot);
+				count++;
+			}
+			// A later slot can start at any header boundary in this space so
+			// .. clear the state at each one, not just at this header
+			uint32_t size = pSlot->size;
+			for (uint32_t offset = 0; offset < size; offset += sizeof(LogSlot))
+				__atomic_store_n(&At(tail + offset)->state, LOG_SLOT_FREE, __ATOMIC_RELAXED);
+			tail += size;
+			_released.store(tail, std::memory_order_release);
+		}
+		return count;
+	}
+};
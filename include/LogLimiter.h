@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Arduino.h>
+#include "LogRing.h"
+
+// Messages with the same code and source logged in full in each window
+#define LOG_CODE_BURST 5
+
+// Length of the window (ms). A summary of the messages held back follows it
+#define LOG_CODE_WINDOW 60000
+
+// Codes tracked at once. Codes past this are always logged
+#define LOG_CODE_SLOTS 48
+
+///////////////////////////////////////////////////////////////////////////////
+// Counts for one message code from one source
+struct LogCodeStats
+{
+	char code[5];				  // Such as "E500"
+	uint8_t source;				  // LogSource
+	uint32_t count;				  // Times logged or held back
+	uint32_t suppressed;		  // Times held back
+	unsigned long windowStart;	  // Millis of the first message in the window
+	uint32_t windowCount;		  // Messages in this window
+	uint32_t windowSuppressed;	  // Messages held back in this window
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Stops a failing part of the system filling the log with the same message.
+// .. Messages starting with a code like "E500 - " or " - W701 - " are counted
+// .. per code and source. The first LOG_CODE_BURST in each window are logged
+// .. and the rest only counted. The caller logs a summary when a window with
+// .. held back messages closes
+class LogLimiter
+{
+private:
+	LogCodeStats _slots[LOG_CODE_SLOTS]; // Codes seen so far
+	int _used = 0;						 // Slots in use
+	uint32_t _untracked = 0;			 // Coded messages with no slot left
+
+public:
+	inline int Count() const { return _used; }
+	inline const LogCodeStats &Get(int n) const { return _slots[n]; }
+	inline LogCodeStats &Get(int n) { return _slots[n]; }
+	inline uint32_t GetUntracked() const { return _untracked; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Read the code from the front of a message
+	// @return false if the message has no code
+	static bool CodeOf(const char *text, char code[5])
+	{
+		while (*text == ' ' || *text == '-')
+			text++;
+		if (*text != 'E' && *text != 'W')
+			return false;
+		for (int n = 1; n < 4; n++)
+		{
+			if (text[n] < '0' || text[n] > '9')
+				return false;
+		}
+		if (text[4] != ' ' && text[4] != '\0')
+			return false;
+		memcpy(code, text, 4);
+		code[4] = '\0';
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Find or add the counts for the code of a message
+	// @return nullptr if the message has no code or there is no room
+	LogCodeStats *Find(uint8_t source, const char *text, unsigned long now)
+	{
+		char code[5];
+		if (!CodeOf(text, code))
+			return nullptr;
+		for (int n = 0; n < _used; n++)
+		{
+			if (_slots[n].source == source && memcmp(_slots[n].code, code, 4) == 0)
+				return &_slots[n];
+		}
+		if (_used >= LOG_CODE_SLOTS)
+		{
+			_untracked++;
+			return nullptr;
+		}
+		LogCodeStats &stats = _slots[_used++];
+		memset(&stats, 0, sizeof(stats));
+		memcpy(stats.code, code, sizeof(code));
+		stats.source = source;
+		stats.windowStart = now;
+		return &stats;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Count a message
+	// @return true if it should be logged in full
+	static bool Take(LogCodeStats &stats)
+	{
+		stats.count++;
+		if (stats.windowCount++ < LOG_CODE_BURST)
+			return true;
+		stats.suppressed++;
+		stats.windowSuppressed++;
+		return false;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Has the window of a code finished
+	static inline bool IsWindowOver(const LogCodeStats &stats, unsigned long now)
+	{
+		return (now - stats.windowStart) >= LOG_CODE_WINDOW;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Start the next window
+	static void Restart(LogCodeStats &stats, unsigned long now)
+	{
+		stats.windowStart = now;
+		stats.windowCount = 0;
+		stats.windowSuppressed = 0;
+	}
+};
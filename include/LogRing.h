@@ -0,0 +1,167 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Bytes kept for the log of every source together
+#define LOG_ARENA_SIZE (32 * 1024)
+
+// Longest message kept. Anything longer is cut
+#define LOG_RECORD_MAX 1024
+
+// Where a log message came from. Each log page shows one source
+enum LogSource : uint8_t
+{
+	LOG_SYSTEM,
+	LOG_GPS1,
+	LOG_GPS2,
+	LOG_CASTER1,
+	LOG_CASTER2,
+	LOG_CASTER3,
+	LOG_LOCAL_CASTER,
+	LOG_RAW_SERVER,
+	LOG_UDP_SENDER,
+	LOG_FAILOVER,
+	LOG_UPSTREAM,
+	LOG_ALL = 0xFF // Only used to read every source
+};
+
+// How the payload of a record is held
+#define LOG_KIND_TEXT 0	  // Text ending in '\0'
+#define LOG_KIND_FORMAT 1 // Pointer to a constant format string followed by the packed arguments
+
+///////////////////////////////////////////////////////////////////////////////
+// Header in front of each message in the arena
+struct LogRecord
+{
+	uint32_t seq;	 // Sequence number of the message
+	uint32_t time;	 // Millis when the message was logged
+	uint16_t size;	 // Bytes used by the record including this header (4 byte aligned)
+	uint16_t length; // Bytes of payload (Not counting the '\0' after text)
+	uint8_t source;	 // LogSource
+	uint8_t kind;	 // LOG_KIND_TEXT or LOG_KIND_FORMAT
+	uint8_t reserved[2];
+
+	inline const byte *Payload() const { return (const byte *)(this + 1); }
+
+	// The text or the format string
+	inline const char *Message() const
+	{
+		const char *pText = (const char *)Payload();
+		if (kind == LOG_KIND_FORMAT)
+			memcpy(&pText, Payload(), sizeof(pText));
+		return pText;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Every log message from every part of the system in one fixed arena. Records
+// .. are variable length and kept contiguous. A record that will not fit at
+// .. the end starts again at the front and the oldest records it lands on
+// .. are dropped, so adding is O(1) (Each record is evicted once) and nothing
+// .. touches the heap. The log pages walk the records and pick out their
+// .. source. Most records hold the format string and raw arguments rather than
+// .. text, so the cost of formatting is only paid when a page is viewed
+template <int SIZE>
+class LogRing
+{
+private:
+	alignas(4) byte _arena[SIZE]; // Records
+	int _head = 0;				  // Where the next record goes
+	int _tail = 0;				  // Oldest record
+	int _wrapEnd = SIZE;		  // End of the records at the top when wrapped
+	bool _wrapped = false;		  // Newer records start at the front of the arena
+	int _count = 0;				  // Records held
+	int _last = 0;				  // Newest record
+	uint32_t _nextSeq = 0;		  // Sequence number of the next record
+	uint32_t _evicted = 0;		  // Records dropped to make room
+
+public:
+	inline int Count() const { return _count; }
+	inline uint32_t NextSeq() const { return _nextSeq; }
+	inline uint32_t OldestSeq() const { return _nextSeq - _count; }
+	inline uint32_t Evicted() const { return _evicted; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Make room for a record and fill in the header. The caller writes the
+	// .. payload straight into the arena
+	// @param length Bytes of payload (Cut to LOG_RECORD_MAX)
+	// @param time Millis when the message was logged
+	// @return Where the payload goes. There is always room for a '\0' after it
+	byte *Reserve(LogSource source, uint8_t kind, int length, uint32_t time)
+	{
+		length = min(length, LOG_RECORD_MAX);
+		int size = (sizeof(LogRecord) + length + 1 + 3) & ~3;
+
+		// Find room. Start at the front when the record will not fit at the
+		// .. end and drop the oldest records the new one lands on
+		while (true)
+		{
+			if (!_wrapped)
+			{
+				if (_head + size <= SIZE)
+					break;
+				_wrapEnd = _head;
+				_head = 0;
+				if (_count == 0)
+				{
+					_tail = 0;
+					break;
+				}
+				_wrapped = true;
+			}
+			if (_head + size <= _tail)
+				break;
+			Evict();
+		}
+
+		LogRecord *pRecord = (LogRecord *)(_arena + _head);
+		pRecord->seq = _nextSeq++;
+		pRecord->time = time;
+		pRecord->size = size;
+		pRecord->length = length;
+		pRecord->source = source;
+		pRecord->kind = kind;
+		_last = _head;
+		_head += size;
+		_count++;
+		return (byte *)(pRecord + 1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Most recent record (Only valid if Count() > 0)
+	inline const LogRecord &Last() const { return *(const LogRecord *)(_arena + _last); }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Call back with each record for a source, oldest first
+	// @param source LogSource or LOG_ALL
+	// @param fromSeq Skip records before this sequence number
+	template <typename F>
+	void ForEach(uint8_t source, F callback, uint32_t fromSeq = 0) const
+	{
+		int offset = _tail;
+		for (int n = 0; n < _count; n++)
+		{
+			if (_wrapped && offset >= _wrapEnd)
+				offset = 0;
+			const LogRecord *pRecord = (const LogRecord *)(_arena + offset);
+			if ((source == LOG_ALL || pRecord->source == source) && pRecord->seq >= fromSeq)
+				callback(*pRecord);
+			offset += pRecord->size;
+		}
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	// Drop the oldest record
+	void Evict()
+	{
+		_tail += ((const LogRecord *)(_arena + _tail))->size;
+		_count--;
+		_evicted++;
+		if (_wrapped && _tail >= _wrapEnd)
+		{
+			_tail = 0;
+			_wrapped = false;
+		}
+	}
+};
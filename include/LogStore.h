@@ -0,0 +1,106 @@
+#pragma once
+
+// Bytes in each log file before the next is started
+#define LOG_SEGMENT_SIZE (16 * 1024)
+
+// Log files kept. The oldest is deleted when a new one starts so the log never
+// .. takes more than LOG_SEGMENTS x (LOG_SEGMENT_SIZE + LOG_BATCH_SIZE) of flash
+#define LOG_SEGMENTS 4
+
+// Longest time a message waits before it is written (ms)
+#define LOG_FLUSH_INTERVAL 60000
+
+// Write early once this many messages are waiting
+#define LOG_FLUSH_RECORDS 100
+
+// Text collected before each append to the file
+#define LOG_BATCH_SIZE 4096
+
+// Batches that can wait for the writer task. The main loop renders into one
+// .. while the other is written
+#define LOG_BATCHES 2
+
+// Writer task. The loop task also runs at 1 and idle is too low as the loop
+// .. never blocks, so the two share the CPU on the single core S2. Pinned to
+// .. PRO_CPU_NUM, away from the loop on a dual core ESP32
+#define LOG_WRITER_PRIORITY 1
+#define LOG_WRITER_STACK 4096
+
+// Least time between appends (ms). Erasing and writing flash stops the cache
+// .. and with it every task on every core, so a backlog is written in steps
+#define LOG_WRITE_SPACING 100
+
+// Longest a flush before a restart waits for the writer (ms)
+#define LOG_FLUSH_WAIT 5000
+
+// Most text passed to the ReadSegments callback at a time
+#define LOG_READ_CHUNK 512
+
+#include <Arduino.h>
+#include <string>
+#include <functional>
+#include <atomic>
+#include "LogFormat.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Keeps the log on flash so it survives a restart. The main loop renders the
+// .. messages into batches, at most one per loop, and a writer task appends
+// .. them no closer than LOG_WRITE_SPACING. The loop never waits for the file
+// .. system, though each flash write still stalls every task while it runs. Each
+// .. boot starts a new file /LogN.txt and files roll over at LOG_SEGMENT_SIZE.
+// .. Only the last LOG_SEGMENTS files are kept. The bytes written are counted
+// .. so the flash wear can be budgeted
+class LogStore
+{
+public:
+	void Setup();
+	void Loop();
+	void Flush();
+	static void WriterTask(void *param);
+	void ReadSegments(std::function<void(const char *pText, int length)> callback) const;
+
+	inline uint32_t GetSegment() const { return _segment.load(std::memory_order_relaxed); }
+	inline uint32_t GetSegmentBytes() const { return _segmentBytes.load(std::memory_order_relaxed); }
+	inline uint32_t GetBytesWritten() const { return _bytesWritten.load(std::memory_order_relaxed); }
+	inline uint32_t GetWrites() const { return _writes.load(std::memory_order_relaxed); }
+	inline uint32_t GetLost() const { return _lost; }
+	inline uint32_t GetFailures() const { return _failures.load(std::memory_order_relaxed); }
+	inline uint32_t GetWorstRender() const { return _worstRender; }
+	inline uint32_t GetWorstWrite() const { return _worstWrite.load(std::memory_order_relaxed); }
+	inline bool IsEnabled() const { return _enabled; }
+	uint32_t GetBytesPerHour() const;
+	static std::string SegmentPath(uint32_t segment);
+
+private:
+	bool _enabled = false;			 // File system is ready
+	bool _writerRunning = false;	 // Writer task started. If not the loop writes
+	uint32_t _savedSeq = 0;			 // Next log record to render
+	unsigned long _lastFlush = 0;	 // Millis when the last flush started
+	bool _flushing = false;			 // Records still to render for this flush
+	int _filling = 0;				 // Batch the loop renders into next
+	uint32_t _lost = 0;				 // Records dropped from the log before they were written
+	uint32_t _worstRender = 0;		 // Longest render of one batch on the loop (us)
+	char _line[LOG_LINE_MAX];		 // One rendered record
+
+	// Written only by the writer task once it runs. The loop reads them for
+	// .. the status page and ReadSegments
+	std::atomic<uint32_t> _segment{0};		 // File being written
+	std::atomic<uint32_t> _segmentBytes{0};	 // Bytes in the file being written
+	std::atomic<uint32_t> _bytesWritten{0};	 // Bytes written since boot
+	std::atomic<uint32_t> _writes{0};		 // Appends since boot
+	std::atomic<uint32_t> _failures{0};		 // Appends that did not complete
+	std::atomic<uint32_t> _worstWrite{0};	 // Longest append including a roll over (us)
+	int _writing = 0;						 // Batch the writer takes next
+	unsigned long _lastWrite = 0;			 // Millis of the last append by the writer
+
+	// Handed between the loop and the writer. A batch with a length belongs
+	// .. to the writer until it sets the length back to zero
+	char _batches[LOG_BATCHES][LOG_BATCH_SIZE];
+	std::atomic<int> _batchLengths[LOG_BATCHES];
+
+	bool RenderBatch();
+	bool IsWriterIdle() const;
+	void WriteBatch(int batch);
+	bool Append(const char *pText, int length);
+	void NextSegment();
+};
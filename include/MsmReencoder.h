@@ -0,0 +1,432 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Rtcm.h"
+
+// Most satellites and cells in an MSM (The cell mask is limited to 64 bits)
+#define MSM_MAX_SATS 64
+#define MSM_MAX_CELLS 64
+
+// Bits in the MSM header from the station ID to the end of the signal mask
+//	station(12) epoch time(30) multiple(1) IODS(3) reserved(7) clock steering(2)
+//	external clock(2) smoothing(1) smoothing interval(3) satellites(64) signals(32)
+#define MSM_HEADER_BITS (12 + 30 + 19 + 64 + 32)
+
+// Longest lock time the MSM6/7 indicator can hold (ms)
+#define MSM_LOCK_MAX 67108864
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads fields from a frame MSB first a byte at a time
+class BitReader
+{
+private:
+	const byte *_pBytes;
+	int _pos;
+
+public:
+	BitReader(const byte *pBytes, int pos) : _pBytes(pBytes), _pos(pos) {}
+
+	uint32_t Get(int len)
+	{
+		uint32_t value = 0;
+		while (len > 0)
+		{
+			int used = _pos & 7;
+			int take = min(8 - used, len);
+			value = (value << take) | ((_pBytes[_pos >> 3] >> (8 - used - take)) & ((1u << take) - 1));
+			_pos += take;
+			len -= take;
+		}
+		return value;
+	}
+
+	int32_t GetSigned(int len)
+	{
+		return (int32_t)(Get(len) << (32 - len)) >> (32 - len);
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes fields MSB first into a zeroed buffer
+class BitWriter
+{
+private:
+	byte *_pBytes;
+	int _pos;
+
+public:
+	BitWriter(byte *pBytes, int pos) : _pBytes(pBytes), _pos(pos) {}
+	inline int Position() const { return _pos; }
+
+	void Put(int len, uint32_t value)
+	{
+		while (len > 0)
+		{
+			int used = _pos & 7;
+			int take = min(8 - used, len);
+			uint32_t bits = (value >> (len - take)) & ((1u << take) - 1);
+			_pBytes[_pos >> 3] |= bits << (8 - used - take);
+			_pos += take;
+			len -= take;
+		}
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Rewrites MSM frames for a caster on a metered or slow uplink
+//	- Drops to a smaller MSM (e.g. MSM7 to MSM4 removes the Doppler fields and
+//	  .. the extended resolution)
+//	- Keeps only the first few signals of each message (Lowest signal IDs,
+//	  .. which on the usual receivers drops the third frequency first)
+// .. A frame can only lose fields. MSM4 never becomes MSM7 and MSM1-3 are
+// .. passed through. Every rewritten frame gets a new CRC24Q. Values are held
+// .. at the MSM7 resolution internally and rounded to the nearest step of
+// .. the output. Lock times round down so the rover never sees more lock
+// .. than there was
+class MsmReencoder
+{
+private:
+	int _msm = 0;		 // Output MSM (0 = keep the input type)
+	int _signals = 0;	 // Signals kept per message (0 = all)
+
+	// Decoded satellite data
+	uint8_t _roughInt[MSM_MAX_SATS];
+	uint8_t _info[MSM_MAX_SATS];
+	uint16_t _roughMod[MSM_MAX_SATS];
+	int16_t _roughRate[MSM_MAX_SATS];
+
+	// Decoded cell data at MSM7 resolution
+	int32_t _pseudorange[MSM_MAX_CELLS]; // 2^-29 ms (INT32_MIN = invalid)
+	int32_t _phase[MSM_MAX_CELLS];		 // 2^-31 ms (INT32_MIN = invalid)
+	uint32_t _lockTime[MSM_MAX_CELLS];	 // ms
+	uint8_t _halfCycle[MSM_MAX_CELLS];
+	uint16_t _cnr[MSM_MAX_CELLS];		 // 2^-4 dB-Hz
+	int16_t _fineRate[MSM_MAX_CELLS];	 // 0.0001 m/s (Raw field)
+
+	// Stats
+	uint32_t _frames = 0;			// Frames rewritten
+	uint64_t _bytesIn = 0;			// Bytes before rewriting
+	uint64_t _bytesOut = 0;			// Bytes after rewriting
+	uint32_t _epoch = 0;			// Epoch being timed
+	uint32_t _epochMicros = 0;		// Time spent on the current epoch
+	uint32_t _lastEpochMicros = 0;	// Time spent on the last full epoch
+	uint32_t _maxEpochMicros = 0;	// Longest time spent on an epoch
+
+public:
+	inline bool IsEnabled() const { return _msm > 0 || _signals > 0; }
+	inline int GetMsm() const { return _msm; }
+	inline int GetSignals() const { return _signals; }
+	inline uint32_t GetFrames() const { return _frames; }
+	inline uint64_t GetBytesIn() const { return _bytesIn; }
+	inline uint64_t GetBytesSaved() const { return _bytesIn - _bytesOut; }
+	inline uint32_t GetEpochMicros() const { return _lastEpochMicros; }
+	inline uint32_t GetMaxEpochMicros() const { return _maxEpochMicros; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// @param msm Output MSM 4 to 7 (0 = keep)
+	// @param signals Signals kept per message (0 = all)
+	void Setup(int msm, int signals)
+	{
+		_msm = (msm >= 4 && msm <= 7) ? msm : 0;
+		_signals = max(0, signals);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Rewrite one frame
+	// @param pOut Room for at least length bytes. The output is never longer
+	// @param epoch Ring epoch of the frame for the timing stats
+	// @return Length of the new frame or 0 to send the original
+	int Reencode(const byte *pFrame, int length, int type, uint32_t epoch, byte *pOut)
+	{
+		if (!IsEnabled() || !RtcmIsMsm(type) || type % 10 < 4)
+			return 0;
+
+		unsigned long start = micros();
+		int outLength = Rewrite(pFrame, length, type, pOut);
+		uint32_t elapsed = micros() - start;
+
+		// Time per epoch rather than per frame as that is what the caster sees
+		if (epoch != _epoch)
+		{
+			_lastEpochMicros = _epochMicros;
+			_maxEpochMicros = max(_maxEpochMicros, _epochMicros);
+			_epochMicros = 0;
+			_epoch = epoch;
+		}
+		_epochMicros += elapsed;
+
+		if (outLength > 0)
+		{
+			_frames++;
+			_bytesIn += length;
+			_bytesOut += outLength;
+		}
+		return outLength;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Convert the MSM6/7 lock time indicator (DF407) to ms
+	static uint32_t LockFromExtended(uint32_t indicator)
+	{
+		if (indicator < 64)
+			return indicator;
+		if (indicator >= 704)
+			return MSM_LOCK_MAX;
+		int k = indicator / 32 - 1;
+		return (indicator - 32 * k) << k;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Largest MSM6/7 lock time indicator (DF407) not over the time
+	static uint32_t ExtendedFromLock(uint32_t ms)
+	{
+		if (ms < 64)
+			return ms;
+		if (ms >= MSM_LOCK_MAX)
+			return 704;
+		int k = (31 - __builtin_clz(ms)) - 5;
+		return (ms >> k) + 32 * k;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Convert the MSM4/5 lock time indicator (DF402) to ms
+	static uint32_t LockFromIndicator(uint32_t indicator)
+	{
+		return indicator == 0 ? 0 : 1u << (indicator + 4);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Largest MSM4/5 lock time indicator (DF402) not over the time
+	static uint32_t IndicatorFromLock(uint32_t ms)
+	{
+		if (ms < 32)
+			return 0;
+		return min(15, (31 - __builtin_clz(ms)) - 4);
+	}
+
+private:
+	// MSM5 and MSM7 carry the extended satellite info and the Doppler fields
+	static inline bool HasRates(int msm) { return msm == 5 || msm == 7; }
+
+	// MSM6 and MSM7 use the extended resolution fields
+	static inline bool IsExtended(int msm) { return msm >= 6; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Scale a signed field with an invalid marker (The most negative value)
+	static int32_t ScaleDown(int32_t value, int shift, int bits)
+	{
+		int32_t invalid = -(1 << (bits - 1));
+		if (value == INT32_MIN)
+			return invalid;
+		int32_t scaled = shift == 0 ? value : (value + (1 << (shift - 1))) >> shift;
+		return constrain(scaled, invalid + 1, -invalid - 1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Decode the frame and write it back with the reduced content
+	// @return Length of the new frame or 0 if the frame does not look right
+	int Rewrite(const byte *pFrame, int length, int type, byte *pOut)
+	{
+		// Too short to hold the header
+		if ((length - 3) * 8 < RTCM_STATION_BIT + MSM_HEADER_BITS)
+			return 0;
+
+		int inMsm = type % 10;
+		int outMsm = inMsm;
+		if (_msm > 0 && (!HasRates(_msm) || HasRates(inMsm)) && (!IsExtended(_msm) || IsExtended(inMsm)))
+			outMsm = _msm;
+
+		// Header
+		BitReader reader(pFrame, RTCM_STATION_BIT);
+		uint32_t station = reader.Get(12);
+		uint32_t epochTime = reader.Get(30);
+		uint32_t flags = reader.Get(19);
+		uint64_t satMask = ((uint64_t)reader.Get(32) << 32) | reader.Get(32);
+		uint32_t sigMask = reader.Get(32);
+		int satCount = __builtin_popcountll(satMask);
+		int sigCount = __builtin_popcount(sigMask);
+		if (satCount * sigCount > MSM_MAX_CELLS || RTCM_STATION_BIT + MSM_HEADER_BITS + satCount * sigCount > (length - 3) * 8)
+			return 0;
+
+		uint64_t cellMask = 0;
+		for (int n = 0; n < satCount * sigCount; n++)
+			cellMask = (cellMask << 1) | reader.Get(1);
+		int cellCount = __builtin_popcountll(cellMask);
+
+		// Check the frame holds everything the masks say it does
+		int satBits = HasRates(inMsm) ? 36 : 18;
+		int cellBits = (IsExtended(inMsm) ? 65 : 48) + (HasRates(inMsm) ? 15 : 0);
+		int needed = RTCM_STATION_BIT + MSM_HEADER_BITS + satCount * sigCount + satCount * satBits + cellCount * cellBits;
+		if (needed > (length - 3) * 8)
+			return 0;
+
+		// Satellite data. Each field is a run for all satellites
+		for (int n = 0; n < satCount; n++)
+			_roughInt[n] = reader.Get(8);
+		for (int n = 0; n < satCount; n++)
+			_info[n] = HasRates(inMsm) ? reader.Get(4) : 0;
+		for (int n = 0; n < satCount; n++)
+			_roughMod[n] = reader.Get(10);
+		for (int n = 0; n < satCount; n++)
+			_roughRate[n] = HasRates(inMsm) ? reader.GetSigned(14) : -8192;
+
+		// Signal data brought up to MSM7 resolution
+		bool extended = IsExtended(inMsm);
+		for (int n = 0; n < cellCount; n++)
+		{
+			int32_t value = reader.GetSigned(extended ? 20 : 15);
+			_pseudorange[n] = value == (extended ? -524288 : -16384) ? INT32_MIN : (extended ? value : value * 32);
+		}
+		for (int n = 0; n < cellCount; n++)
+		{
+			int32_t value = reader.GetSigned(extended ? 24 : 22);
+			_phase[n] = value == (extended ? -8388608 : -2097152) ? INT32_MIN : (extended ? value : value * 4);
+		}
+		for (int n = 0; n < cellCount; n++)
+			_lockTime[n] = extended ? LockFromExtended(reader.Get(10)) : LockFromIndicator(reader.Get(4));
+		for (int n = 0; n < cellCount; n++)
+			_halfCycle[n] = reader.Get(1);
+		for (int n = 0; n < cellCount; n++)
+			_cnr[n] = extended ? reader.Get(10) : reader.Get(6) << 4;
+		for (int n = 0; n < cellCount; n++)
+			_fineRate[n] = HasRates(inMsm) ? reader.GetSigned(15) : -16384;
+
+		// Signals kept are the first _signals in the mask
+		uint32_t keepSigMask = sigMask;
+		if (_signals > 0)
+		{
+			keepSigMask = 0;
+			uint32_t bit = 0x80000000;
+			for (int kept = 0; bit != 0 && kept < _signals; bit >>= 1)
+			{
+				if (sigMask & bit)
+				{
+					keepSigMask |= bit;
+					kept++;
+				}
+			}
+		}
+		int keepSigCount = __builtin_popcount(keepSigMask);
+
+		// Flag the signal columns kept
+		bool sigKept[32];
+		for (int n = 0, s = 0; n < 32; n++)
+		{
+			uint32_t bit = 0x80000000u >> n;
+			if (sigMask & bit)
+				sigKept[s++] = (keepSigMask & bit) != 0;
+		}
+
+		// Work out which satellites and cells survive
+		bool satKept[MSM_MAX_SATS];
+		bool cellKept[MSM_MAX_CELLS];
+		uint64_t keepSatMask = 0;
+		int keepSatCount = 0;
+		int keepCellCount = 0;
+		for (int sat = 0, cell = 0, satBit = 63; sat < satCount; sat++, satBit--)
+		{
+			while (!(satMask & (1ull << satBit)))
+				satBit--;
+			satKept[sat] = false;
+			for (int sig = 0; sig < sigCount; sig++)
+			{
+				bool present = (cellMask >> (satCount * sigCount - 1 - (sat * sigCount + sig))) & 1;
+				if (!present)
+					continue;
+				cellKept[cell] = sigKept[sig];
+				if (sigKept[sig])
+				{
+					satKept[sat] = true;
+					keepCellCount++;
+				}
+				cell++;
+			}
+			if (satKept[sat])
+			{
+				keepSatMask |= 1ull << satBit;
+				keepSatCount++;
+			}
+		}
+
+		// Nothing to gain
+		if (outMsm == inMsm && keepSigCount == sigCount && keepSatCount == satCount)
+			return 0;
+
+		// Write the new message
+		int outSatBits = HasRates(outMsm) ? 36 : 18;
+		int outCellBits = (IsExtended(outMsm) ? 65 : 48) + (HasRates(outMsm) ? 15 : 0);
+		int messageBits = 12 + MSM_HEADER_BITS + keepSatCount * keepSigCount + keepSatCount * outSatBits + keepCellCount * outCellBits;
+		int messageLength = (messageBits + 7) / 8;
+		if (messageLength + 6 > length)
+			return 0;
+		memset(pOut, 0, messageLength + 6);
+
+		BitWriter writer(pOut, 0);
+		writer.Put(8, 0xD3);
+		writer.Put(6, 0);
+		writer.Put(10, messageLength);
+		writer.Put(12, type - inMsm + outMsm);
+		writer.Put(12, station);
+		writer.Put(30, epochTime);
+		writer.Put(19, flags);
+		writer.Put(32, keepSatMask >> 32);
+		writer.Put(32, keepSatMask & 0xFFFFFFFF);
+		writer.Put(32, keepSigMask);
+
+		// New cell mask
+		for (int sat = 0, cell = 0; sat < satCount; sat++)
+		{
+			for (int sig = 0; sig < sigCount; sig++)
+			{
+				bool present = (cellMask >> (satCount * sigCount - 1 - (sat * sigCount + sig))) & 1;
+				if (satKept[sat] && sigKept[sig])
+					writer.Put(1, present);
+				if (present)
+					cell++;
+			}
+		}
+
+		// Satellite data
+		for (int n = 0; n < satCount; n++)
+			if (satKept[n])
+				writer.Put(8, _roughInt[n]);
+		if (HasRates(outMsm))
+			for (int n = 0; n < satCount; n++)
+				if (satKept[n])
+					writer.Put(4, _info[n]);
+		for (int n = 0; n < satCount; n++)
+			if (satKept[n])
+				writer.Put(10, _roughMod[n]);
+		if (HasRates(outMsm))
+			for (int n = 0; n < satCount; n++)
+				if (satKept[n])
+					writer.Put(14, _roughRate[n]);
+
+		// Signal data
+		bool outExtended = IsExtended(outMsm);
+		for (int n = 0; n < cellCount; n++)
+			if (cellKept[n])
+				writer.Put(outExtended ? 20 : 15, ScaleDown(_pseudorange[n], outExtended ? 0 : 5, outExtended ? 20 : 15));
+		for (int n = 0; n < cellCount; n++)
+			if (cellKept[n])
+				writer.Put(outExtended ? 24 : 22, ScaleDown(_phase[n], outExtended ? 0 : 2, outExtended ? 24 : 22));
+		for (int n = 0; n < cellCount; n++)
+			if (cellKept[n])
+				writer.Put(outExtended ? 10 : 4, outExtended ? ExtendedFromLock(_lockTime[n]) : IndicatorFromLock(_lockTime[n]));
+		for (int n = 0; n < cellCount; n++)
+			if (cellKept[n])
+				writer.Put(1, _halfCycle[n]);
+		for (int n = 0; n < cellCount; n++)
+			if (cellKept[n])
+				writer.Put(outExtended ? 10 : 6, outExtended ? _cnr[n] : min(63, _cnr[n] >> 4));
+		if (HasRates(outMsm))
+			for (int n = 0; n < cellCount; n++)
+				if (cellKept[n])
+					writer.Put(15, _fineRate[n]);
+
+		// Parity over the header and message
+		int outLength = 3 + messageLength + 3;
+		RtcmSetUInt(pOut, (outLength - 3) * 8, 24, RtcmCrc24(pOut, outLength - 3));
+		return outLength;
+	}
+};
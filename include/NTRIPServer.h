@@ -3,12 +3,45 @@
 // Buffer used to grab data to send
 #define SOCKET_IN_BUFFER_MAX 512
 
-// Number of items in the averaging buffer for send time calculation
-#define AVERAGE_SEND_TIMERS 256
+// Time between connection attempts
+#define SOCKET_RETRY_INTERVAL 30000
+
+// Default oldest correction we will send to a caster (Override with maxage=ms)
+#define DEFAULT_MAX_FRAME_AGE 5000
+
+// Largest NTRIP v2 chunk. One epoch of MSM7 is normally under 3KB
+#define CASTER_CHUNK_MAX 4096
+
+// Longest hex length line of a chunk
+#define CHUNK_HEADER_SIZE 8
+
+// Most frames gathered into one write
+#define CASTER_VIEWS_MAX 32
+
+// Unsent tail of a partial write. Holds the largest v2 chunk with its framing
+#define CASTER_PENDING_MAX (CASTER_CHUNK_MAX + CHUNK_HEADER_SIZE + 2)
+
+// Low value frames held back while a shaped caster catches up on MSM
+#define CASTER_DEFERRED_MAX 8
+
+// Default time the socket can refuse data before the caster is treated as dead (ms)
+// .. Override with stall=ms (0 = off)
+#define DEFAULT_STALL_TIMEOUT 3000
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <lwip/sockets.h>
+#include "RtcmFrameRing.h"
+#include "TokenBucket.h"
+#include "NtripResponse.h"
+#include "SocketConnector.h"
+#include "CasterGroup.h"
+#include "SendStats.h"
+#include "MsmReencoder.h"
+#include "HandyLog.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // Class manages the connection to the RTK Service client
@@ -17,11 +50,9 @@ class NTRIPServer
 public:
 	NTRIPServer(int index);
 	void LoadSettings();
-	void Save(const char *address, const char *port, const char *credential, const char *password) const;
-	void Loop(const byte *pBytes, int length);
-	int AverageSendTime();
+	void Save(const char *address, const char *port, const char *credential, const char *password, const char *options) const;
+	void Loop(const RtcmFrameRing &ring);
 
-	inline const std::vector<std::string> &GetLogHistory() const { return _logHistory; }
 	inline const char *GetStatus() const { return _status; }
 	inline int GetReconnects() const { return _reconnects; }
 	inline int GetPacketsSent() const { return _packetsSent; }
@@ -29,30 +60,162 @@ public:
 	inline int GetPort() const { return _port; }
 	inline const std::string GetCredential() const { return _sCredential; }
 	inline const std::string GetPassword() const { return _sPassword; }
-	inline const std::vector<int> &GetSendMicroSeconds() const { return _sendMicroSeconds; }
-	inline const int GetMaxSendTime() const { return _maxSendTime; }
+	inline const std::string GetOptions() const { return _sOptions; }
+	inline const SendStats &GetSendStats() const { return _sendStats; }
+	inline int GetDroppedFrames() const { return _droppedFrames; }
+	inline int GetDroppedBytes() const { return _droppedBytes; }
+	inline unsigned long GetCorrectionAge() const { return _correctionAge; }
+	inline unsigned long GetMaxCorrectionAge() const { return _maxCorrectionAge; }
+	inline const TokenBucket &GetBucket() const { return _bucket; }
+	inline int GetDeferredEvicted() const { return _deferredEvicted; }
+	inline int GetAchievedRate() const { return _achievedRate; }
+	inline unsigned long GetQueueDelay() const { return _queueDelay; }
+	unsigned long GetThrottleTime() const;
+	inline bool IsNtripV2() const { return _ntripV2; }
+	inline int GetChunksSent() const { return _chunksSent; }
+	inline int GetWriteCalls() const { return _writeCalls; }
+	inline int GetEpochsSent() const { return _epochsSent; }
+	inline uint64_t GetCopyAvoided() const { return _copyAvoided; }
+	inline int GetPartialWrites() const { return _partialWrites; }
+	inline int GetBlockedWrites() const { return _blockedWrites; }
+	inline int GetMaxEpochBytes() const { return _maxEpochBytes; }
+	inline const MsmReencoder &GetReencoder() const { return _reencoder; }
+	inline const SocketConnector &GetConnector() const { return _connector; }
+	inline const CasterGroup &GetGroup() const { return _group; }
+	inline int GetInput() const { return _input; }
+	inline unsigned long GetSwitchLatency() const { return _switchLatency; }
+	inline int GetStandbySwaps() const { return _standbySwaps; }
+	inline int GetStallDrops() const { return _stallDrops; }
+	inline unsigned long GetStallDetectTime() const { return _stallDetectTime; }
+	inline unsigned long GetFirstByteLatency() const { return _firstByteLatency; }
+	inline unsigned long GetMaxFirstByteLatency() const { return _maxFirstByteLatency; }
+	inline bool IsTls() const { return (bool)_pSecureClient; }
+	inline bool IsTlsCaChecked() const { return !_caCert.empty(); }
+	inline int GetTlsRejects() const { return _tlsRejects; }
+	inline int GetTlsWriteNsPerByte() const { return _tlsWriteBytes == 0 ? 0 : (int)(_tlsWriteMicros * 1000 / _tlsWriteBytes); }
 
 private:
-	WiFiClient _client;					  // Socket connection
+	WiFiClient _client;					  // Plain socket connection
+	std::unique_ptr<WiFiClientSecure> _pSecureClient; // TLS connection when enabled with tls=1
+	WiFiClient *_pClient = &_client;	  // Connection in use
+	std::string _caCert;				  // CA certificate the server must chain to (Empty = use the fingerprints)
+	std::vector<std::string> _tlsFingerprints; // Accepted SHA256 fingerprints from fp=
+	int _tlsRejects = 0;				  // Connections refused as the certificate was not trusted
+	uint64_t _tlsWriteMicros = 0;		  // Time spent in TLS writes
+	uint64_t _tlsWriteBytes = 0;		  // Bytes written over TLS
 	unsigned long _wifiConnectTime = 0;		  // Time we last had good data to prevent reconnects too fast
-	bool _wasConnected = false;			  // Was connected last time
+	unsigned long _retryInterval = SOCKET_RETRY_INTERVAL; // Time between connection attempts. Grows on authentication failure
+	bool _wasConnected = false;			  // Caster has accepted us and we are streaming
+	unsigned long _acceptTime = 0;		  // Millis when the caster accepted us
+	int _quickDrops = 0;				  // Connections in a row dropped before CASTER_STABLE_TIME
+	NtripResponse _response;			  // Caster reply to the SOURCE request
+	SocketConnector _connector;			  // Cached DNS and parallel connect attempts
+	unsigned long _dnsTtl = DEFAULT_DNS_TTL; // How long resolved addresses are reused (ms)
+	CasterGroup _group;					  // Primary and backup casters for the mount point
+	bool _plannedSwitch = false;		  // We closed the connection to move to a better caster
+	bool _earlySwitched = false;		  // Used the one switch without a retry wait since the last accept
+	bool _switchPending = false;		  // Waiting for the first byte on a new caster
+	unsigned long _switchStart = 0;		  // Millis when we left the old caster
+	unsigned long _switchLatency = 0;	  // Time from leaving a caster to data on the next (ms)
+	bool _standbyEnabled = false;		  // Keep a spare connection open (standby=1)
+	int _standbyFd = -1;				  // Spare connection ready to swap in
+	unsigned long _standbyTime = 0;		  // Last time the standby was opened or checked
+	int _standbySwaps = 0;				  // Times the standby replaced a dropped connection
+	unsigned long _dropTime = 0;		  // Millis when a working connection dropped (0 = none)
+	unsigned long _firstByteLatency = 0;  // Last time from drop to first byte sent again (ms)
+	unsigned long _maxFirstByteLatency = 0; // Longest time from drop to first byte sent (ms)
+	unsigned long _stallTimeout = DEFAULT_STALL_TIMEOUT; // Longest the socket can refuse data (ms)
+	unsigned long _stallStart = 0;		  // Millis when the socket stopped taking data (0 = not stalled)
+	unsigned long _lastWriteTime = 0;	  // Millis of the last successful write
+	int _stallDrops = 0;				  // Connections closed because the caster stopped taking data
+	unsigned long _stallDetectTime = 0;	  // Time from the last good write to closing a stalled connection (ms)
+	int _input = 1;						  // Receiver feeding this caster (1 = Serial1)
 	const int _index;					  // Index of the server used when updating display
 	const char *_status = "-";			  // Connection status
-	std::vector<std::string> _logHistory; // History of connection status
-	std::vector<int> _sendMicroSeconds;	  // Collection of send times
+	SendStats _sendStats;				  // Write times, percentiles and throughput
 	int _reconnects;					  // Total number of reconnects
 	int _packetsSent;					  // Total number of packets sent
-	unsigned long _maxSendTime;			  // Maximum amount of time it took to send a packet
+	uint32_t _nextSeq = 0;				  // Next frame in the ring to send
+	uint32_t _dropEpoch = 0;			  // Epochs before this are stale and dropped
+	unsigned long _maxFrameAge = DEFAULT_MAX_FRAME_AGE; // Oldest frame we will send (ms)
+	int _droppedFrames = 0;				  // Frames discarded as stale or overwritten
+	int _droppedBytes = 0;				  // Bytes discarded as stale
+	unsigned long _correctionAge = 0;	  // Age of the last frame sent (ms)
+	unsigned long _maxCorrectionAge = 0;  // Oldest frame sent (ms)
+	TokenBucket _bucket;				  // Optional shaping of the uplink
+	uint32_t _deferred[CASTER_DEFERRED_MAX]; // Low value frames waiting for MSM to go first
+	int _deferredCount = 0;				  // Number of deferred frames
+	int _deferredEvicted = 0;			  // Deferred frames pushed out by newer ones before they were sent
+	bool _throttled = false;			  // Token bucket stopped a send this pass
+	unsigned long _throttleStart = 0;	  // Millis when throttling began (0 = not throttled)
+	unsigned long _throttleTime = 0;	  // Total time spent throttled (ms)
+	unsigned long _rateTime = 0;		  // Start of the current rate window
+	int _rateBytes = 0;					  // Bytes sent in the current rate window
+	int _achievedRate = 0;				  // Bytes per second sent in the last window
+	unsigned long _queueDelay = 0;		  // Average time frames wait before sending (ms)
+	bool _ntripV2 = false;				  // Use NTRIP v2 POST with chunked transfer
+	struct iovec _views[CASTER_VIEWS_MAX + 2]; // Frames in the ring waiting for one gathered write. First and last are for the v2 chunk framing
+	int _viewCount = 0;					  // Number of frames gathered
+	int _viewBytes = 0;					  // Bytes of frame data gathered
+	uint32_t _viewOldestSeq = 0;		  // Oldest frame gathered (Checked against ring eviction)
+	uint32_t _viewEpoch = 0;			  // Epoch of the last frame gathered
+	unsigned long _viewStart = 0;		  // Millis when the first frame was gathered
+	char _chunkHeader[CHUNK_HEADER_SIZE + 1]; // Hex length line of the v2 chunk
+	MsmReencoder _reencoder;			  // Optional MSM reduction for this caster (msm= signals=)
+	byte _reencoded[CASTER_CHUNK_MAX];	  // Rewritten frames gathered for the next write
+	int _reencodedLength = 0;			  // Bytes used in _reencoded
+	uint32_t _reencodedSeq = UINT32_MAX;  // Frame rewritten at the end of _reencoded waiting for the bucket
+	int _reencodedFrame = 0;			  // Length of that rewrite (0 = send the original)
+	int _chunksSent = 0;				  // Total NTRIP v2 chunks sent
+	int _writeCalls = 0;				  // Socket writes of frame data
+	int _epochsSent = 0;				  // Epochs sent (For writes per epoch)
+	uint32_t _sentEpoch = 0;			  // Epoch of the last frame gathered for the stats
+	int _epochBytes = 0;				  // Bytes in the current epoch
+	int _maxEpochBytes = 0;				  // Largest epoch seen
+	uint64_t _copyAvoided = 0;			  // NTRIP v2 frame bytes sent straight from the ring rather than copied into a chunk
+	byte _pending[CASTER_PENDING_MAX];	  // What the socket did not take from the last write
+	int _pendingLength = 0;				  // Bytes in _pending
+	int _pendingOffset = 0;				  // Bytes of _pending already sent
+	int _partialWrites = 0;				  // Writes the socket only took part of
+	int _blockedWrites = 0;				  // Writes the full socket took nothing of (Not in the send stats)
 
 	std::string _sAddress;
 	int _port;
 	std::string _sCredential;
 	std::string _sPassword;
+	std::string _sOptions;
+	std::string _sUser;					  // NTRIP v2 user name (Defaults to the mount point)
 
-	void ConnectedProcessing(const byte *pBytes, int length);
-	void ConnectedProcessingSend(const byte *pBytes, int length);
+	void SetupTls();
+	static std::string NormaliseFingerprint(const std::string &text);
+	inline const char *Host() const { return _group.Current().host.c_str(); }
+	inline int Port() const { return _group.Current().port; }
+	void OnEndpointChanged();
+	bool VerifyFingerprint();
+	void HandshakeProcessing(const RtcmFrameRing &ring);
+	void ConnectedProcessing(const RtcmFrameRing &ring);
+	void SendQueued(const RtcmFrameRing &ring);
+	void SendDeferred(const RtcmFrameRing &ring);
+	void Defer(uint32_t seq);
+	bool TrySend(const RtcmFrameRing &ring, uint32_t seq, unsigned long age);
+	bool FlushViews(const RtcmFrameRing &ring);
+	void UpdateSendStats();
+	bool SendViews(const struct iovec *pViews, int count);
+	bool SendPending();
+	void OnWritten();
+	void TakeSocket(int fd);
+	bool CanWrite();
 	void ConnectedProcessingReceive();
 	void LogX(std::string text);
+	template <size_t N, typename... Args>
+	void LogX(const char (&format)[N], Args... args)
+	{
+		Logf((LogSource)(LOG_CASTER1 + _index), format, args...);
+	}
 	bool Reconnect();
+	void PollConnect();
+	bool SendRequest();
+	void KeepStandby();
+	bool CheckStall(const RtcmFrameRing &ring);
 	bool WriteText(const char *str);
 };
\ No newline at end of file
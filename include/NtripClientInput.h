@@ -0,0 +1,110 @@
+#pragma once
+
+// Bytes of upstream data held for the parser
+#define NTRIP_INPUT_BUFFER 1024
+
+// Time between connection attempts (ms)
+#define NTRIP_INPUT_RETRY 10000
+
+// How long the upstream caster has to accept the request (ms)
+#define NTRIP_INPUT_RESPONSE_TIMEOUT 10000
+
+// Reconnect if nothing arrives for this long (ms)
+#define NTRIP_INPUT_DATA_TIMEOUT 30000
+
+#include <string>
+#include <vector>
+#include <WiFiClient.h>
+#include "NtripResponse.h"
+#include "SocketConnector.h"
+#include "HandyLog.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads RTCM from an upstream NTRIP caster so a site with no receiver can
+// .. relay a regional stream. It is a Stream like Serial1 so GpsParser frames
+// .. it exactly the same way and everything downstream is unchanged.
+// .. Configured with one line of options
+//		host=caster.com port=2101 mount=XYZ user=name password=pass v2=1
+// .. NTRIP v2 replies are usually chunked and are decoded here so the parser
+// .. only sees RTCM
+class NtripClientInput : public Stream
+{
+	enum State
+	{
+		Idle,		// Waiting to retry
+		Connecting, // TCP connect in progress
+		Handshake,	// Request sent, waiting for the reply
+		Streaming	// Receiving RTCM
+	};
+
+	enum ChunkState
+	{
+		ChunkSize, // Reading the hex length line
+		ChunkData, // Copying chunk data
+		ChunkEnd   // Skipping the CRLF after the data
+	};
+
+public:
+	void LoadSettings();
+	void Save(const char *options) const;
+	void Loop();
+
+	// Stream
+	int available() override;
+	int read() override;
+	int peek() override;
+	size_t readBytes(char *buffer, size_t length) override;
+	size_t write(uint8_t) override { return 0; }
+	using Stream::readBytes;
+
+	inline bool IsEnabled() const { return _port > 0 && !_sHost.empty(); }
+	inline const std::string &GetOptions() const { return _sOptions; }
+	inline const std::string &GetHost() const { return _sHost; }
+	inline const std::string &GetMount() const { return _sMount; }
+	inline const char *GetStatus() const { return _status; }
+	inline int GetReconnects() const { return _reconnects; }
+	inline uint64_t GetBytesReceived() const { return _bytesReceived; }
+	inline unsigned long GetMaxGap() const { return _maxGap; }
+	inline unsigned long GetDataAge() const { return _state == Streaming ? millis() - _lastDataTime : 0; }
+	inline const SocketConnector &GetConnector() const { return _connector; }
+
+private:
+	std::string _sOptions;				  // Settings line
+	std::string _sHost;					  // Upstream caster
+	int _port = 0;						  // Upstream port (0 = off)
+	std::string _sMount;				  // Mount point to read
+	std::string _sAuth;					  // Basic auth token (Empty = none)
+	bool _ntripV2 = false;				  // Use an NTRIP v2 request
+	State _state = Idle;				  // Where we are with the connection
+	const char *_status = "-";			  // Connection status
+	WiFiClient _client;					  // Upstream connection
+	SocketConnector _connector;			  // Cached DNS and parallel connect
+	NtripResponse _response;			  // Upstream reply to our request
+	unsigned long _stateTime = 0;		  // Millis when the state last changed
+	bool _chunked = false;				  // Reply uses chunked transfer encoding
+	ChunkState _chunkState = ChunkSize;	  // Where we are in the chunk
+	int _chunkRemaining = 0;			  // Data bytes left in the chunk
+	char _chunkLine[12];				  // Chunk length line
+	int _chunkLineLength = 0;			  // Bytes in _chunkLine
+	byte _buffer[NTRIP_INPUT_BUFFER];	  // RTCM waiting for the parser
+	int _head = 0;						  // Next byte for the parser
+	int _tail = 0;						  // End of the data
+	int _reconnects = 0;				  // Times the stream was accepted
+	uint64_t _bytesReceived = 0;		  // Total RTCM bytes received
+	unsigned long _lastDataTime = 0;	  // Millis when data last arrived
+	unsigned long _maxGap = 0;			  // Longest wait for data while streaming (ms)
+
+	void SetState(State state, const char *status);
+	void StartConnect();
+	void PollConnect();
+	void HandshakeProcessing();
+	void StreamingProcessing();
+	void AddBody(const byte *pBytes, int length);
+	void AddData(const byte *pBytes, int length);
+	void LogX(std::string text);
+	template <size_t N, typename... Args>
+	void LogX(const char (&format)[N], Args... args)
+	{
+		Logf(LOG_UPSTREAM, format, args...);
+	}
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+
+// Bytes of the response kept for parsing and the log
+#define NTRIP_RESPONSE_MAX 256
+
+///////////////////////////////////////////////////////////////////////////////
+// Incremental parser for the caster reply to a SOURCE, POST or GET request.
+// .. Bytes are added as they arrive and the status line is classified once
+// .. it is complete. Typical replies
+//		ICY 200 OK
+//		HTTP/1.1 200 OK
+//		ERROR - Bad Password
+//		ERROR - Bad Mountpoint
+//		HTTP/1.1 401 Unauthorized
+//		SOURCETABLE 200 OK
+class NtripResponse
+{
+public:
+	enum Result
+	{
+		Pending,	// Status line not complete yet
+		Ok,			// Caster accepted us
+		AuthFailed, // Credentials rejected
+		Rejected	// Anything else (Mount point in use, unknown etc)
+	};
+
+private:
+	char _text[NTRIP_RESPONSE_MAX + 1]; // Start of the response
+	int _length = 0;					// Bytes held in _text
+	int _statusLength = 0;				// Length of the status line (0 = incomplete)
+	int _headerLength = 0;				// Length of the HTTP header block (0 = incomplete)
+	int _httpCode = 0;					// HTTP status code (0 = not HTTP)
+	Result _result = Pending;
+
+public:
+	inline Result GetResult() const { return _result; }
+	inline int GetHttpCode() const { return _httpCode; }
+	inline const char *GetText() const { return _text; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Get the first line of the response
+	inline std::string GetStatusLine() const
+	{
+		return std::string(_text, _statusLength > 0 ? _statusLength : _length);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Check if the end of the HTTP header block has been seen. Anything after
+	// .. this is body data (Only used by NTRIP v2 and the upstream client)
+	inline bool HeadersComplete() const { return _headerLength > 0; }
+	inline int HeaderLength() const { return _headerLength; }
+
+	///////////////////////////////////////////////////////////////////////////
+	void Reset()
+	{
+		_length = 0;
+		_statusLength = 0;
+		_headerLength = 0;
+		_httpCode = 0;
+		_result = Pending;
+		_text[0] = '\0';
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Add received bytes. Anything past the buffer is ignored
+	// @return Number of bytes consumed
+	int Add(const byte *pBytes, int length)
+	{
+		int count = min(length, NTRIP_RESPONSE_MAX - _length);
+		if (count <= 0)
+			return 0;
+		int start = _length;
+		memcpy(_text + _length, pBytes, count);
+		_length += count;
+		_text[_length] = '\0';
+
+		for (int n = max(start, 1); n < _length; n++)
+		{
+			if (_text[n - 1] != '\r' || _text[n] != '\n')
+				continue;
+
+			// First line complete
+			if (_statusLength == 0)
+			{
+				_statusLength = n - 1;
+				Classify();
+			}
+
+			// Only HTTP has headers after the status line. A blank line ends them
+			bool endOfHeader = _httpCode == 0 || (n >= 3 && _text[n - 3] == '\r' && _text[n - 2] == '\n');
+			if (_headerLength == 0 && endOfHeader)
+			{
+				_headerLength = n + 1;
+				return _headerLength - start;
+			}
+		}
+
+		// Give up waiting for a line end if the buffer is full
+		if (_statusLength == 0 && _length >= NTRIP_RESPONSE_MAX)
+		{
+			_statusLength = _length;
+			Classify();
+		}
+		return count;
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	// Decide what the status line means
+	void Classify()
+	{
+		std::string line = GetStatusLine();
+		if (line.rfind("ICY 200", 0) == 0)
+		{
+			_result = Ok;
+			return;
+		}
+		if (line.rfind("HTTP/1.", 0) == 0 && line.length() >= 12)
+		{
+			_httpCode = atoi(line.c_str() + 9);
+			if (_httpCode >= 200 && _httpCode < 300)
+				_result = Ok;
+			else if (_httpCode == 401 || _httpCode == 403)
+				_result = AuthFailed;
+			else
+				_result = Rejected;
+			return;
+		}
+		if (line.find("Bad Password") != std::string::npos || line.find("Unauthorized") != std::string::npos)
+		{
+			_result = AuthFailed;
+			return;
+		}
+		_result = Rejected;
+	}
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+// Most tools connected at once
+#define RAW_SERVER_MAX_CLIENTS 4
+
+// Default frames a client can fall behind before it is dropped (Override with backlog=)
+#define RAW_SERVER_BACKLOG 64
+
+// Drop a client that has taken nothing for this long (ms)
+#define RAW_SERVER_STALL_TIMEOUT 5000
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <WiFiServer.h>
+#include "RingWriter.h"
+#include "HandyLog.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A tool connected to the raw stream
+struct RawClient
+{
+	WiFiClient client;				// Connection (Owns the socket)
+	std::string address;			// Remote IP for the status page
+	RingWriter writer;				// Position in the frame ring
+	unsigned long connectTime = 0;	// Millis when the client connected
+	unsigned long progressTime = 0; // Millis when the client last took data
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Plain TCP server pushing every validated RTCM3 frame to each connected
+// .. client with no NTRIP handshake. For RTKLIB str2str, QGIS and loggers.
+// .. Configured with one line of options
+//		port=2102 backlog=64
+// .. Each client queue is its cursor into the shared frame ring. A client
+// .. more than backlog frames behind is disconnected so it can never hold up
+// .. the parser or the other clients
+class RawRtcmServer
+{
+public:
+	void LoadSettings();
+	void Save(const char *options) const;
+	void Loop(const RtcmFrameRing &ring);
+
+	inline bool IsEnabled() const { return _port > 0; }
+	inline int GetPort() const { return _port; }
+	inline const std::string &GetOptions() const { return _sOptions; }
+	inline const std::vector<std::unique_ptr<RawClient>> &GetClients() const { return _clients; }
+	inline int GetClientsServed() const { return _clientsServed; }
+	inline int GetSlowDrops() const { return _slowDrops; }
+
+private:
+	std::unique_ptr<WiFiServer> _pServer;			// Listening socket (Created on first loop)
+	std::vector<std::unique_ptr<RawClient>> _clients; // Connected clients
+	std::string _sOptions;							// Settings line
+	int _port = 0;									// Listening port (0 = off)
+	uint32_t _maxBacklog = RAW_SERVER_BACKLOG;		// Frames a client can fall behind
+	int _clientsServed = 0;							// Total clients connected
+	int _slowDrops = 0;								// Clients dropped for falling behind
+
+	void Accept(const RtcmFrameRing &ring);
+	bool Service(RawClient &client, const RtcmFrameRing &ring);
+	void LogX(std::string text);
+	template <size_t N, typename... Args>
+	void LogX(const char (&format)[N], Args... args)
+	{
+		Logf(LOG_RAW_SERVER, format, args...);
+	}
+};
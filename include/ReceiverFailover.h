@@ -0,0 +1,122 @@
+#pragma once
+
+// Primary epochs missed before switching to the standby
+#define FAILOVER_STALL_EPOCHS 2
+
+// Added to the stall time to allow for jitter in the epoch timing (ms)
+#define FAILOVER_MARGIN 250
+
+// Epoch interval assumed until the primary has sent two epochs (ms)
+#define FAILOVER_DEFAULT_INTERVAL 1000
+
+// Gaps longer than this are outages and not used for the epoch interval (ms)
+#define FAILOVER_MAX_INTERVAL 5000
+
+// Regular primary epochs needed before switching back
+#define FAILOVER_RECOVER_EPOCHS 5
+
+// Primary frames of the unfinished epoch held till its last MSM. Room for
+// .. one epoch of MSM7 from four systems
+#define FAILOVER_HOLD_MAX 6144
+#define FAILOVER_HOLD_FRAMES 32
+
+// Time the primary can send frames without an MSM end of epoch before the
+// .. failover is turned off (ms). Legacy 1004/1012 have no epoch marker
+#define FAILOVER_MSM_WAIT 10000
+
+#include <string>
+#include <vector>
+#include "RtcmFrameRing.h"
+#include "HandyLog.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Keeps a second receiver in hot standby for the casters fed by the primary.
+// .. Configured with one line of options
+//		standby=2 epochs=2 station=1234
+// .. The standby is parsed all the time into its own ring. When the primary
+// .. has missed 'epochs' epochs its frames are held back and the standby
+// .. frames are copied into the primary ring starting at the first frame of
+// .. the standby's current epoch, so the casters never notice the change.
+// .. Primary frames only reach the ring once their epoch is complete so a
+// .. primary that dies part way through an epoch leaves nothing behind.
+// .. The epochs come from the MSM multiple message bit. A primary sending
+// .. only legacy observations (1004, 1012) turns the failover off
+// .. Once the primary has sent FAILOVER_RECOVER_EPOCHS regular epochs the
+// .. output returns to it at the next epoch boundary on both sides.
+// .. 'station' rewrites the reference station ID of the standby frames so
+// .. rovers see one base
+class ReceiverFailover
+{
+public:
+	void LoadSettings();
+	void Save(const char *options) const;
+	void Setup(const RtcmFrameRing *pStandby);
+	bool TakePrimary(RtcmFrameRing &output, const byte *pFrame, int length, int type);
+	void Loop(RtcmFrameRing &output);
+
+	inline bool IsEnabled() const { return _standbyInput > 1; }
+	inline int GetStandbyInput() const { return _standbyInput; }
+	inline const std::string &GetOptions() const { return _sOptions; }
+	inline bool IsOnStandby() const { return _onStandby; }
+	inline int GetSwitches() const { return _switches; }
+	inline int GetReturns() const { return _returns; }
+	inline unsigned long GetSwitchLatency() const { return _switchLatency; }
+	inline unsigned long GetMaxSwitchLatency() const { return _maxSwitchLatency; }
+	inline unsigned long GetEpochInterval() const { return _epochInterval; }
+	inline int GetStandbyFrames() const { return _standbyFrames; }
+	inline int GetHeldFrames() const { return _heldFrames; }
+	inline int GetPrimaryEpochs() const { return _primaryEpochs; }
+	inline int GetDroppedPartial() const { return _droppedPartial; }
+	inline int GetHoldOverflows() const { return _holdOverflows; }
+	unsigned long GetTimeOnStandby() const;
+	std::string GetStatus() const;
+
+private:
+	std::string _sOptions;						  // Settings line
+	int _standbyInput = 0;						  // Receiver used as the standby (0 = off)
+	int _stallEpochs = FAILOVER_STALL_EPOCHS;	  // Primary epochs missed before switching
+	int _station = -1;							  // Station ID for standby frames (-1 = leave)
+	const RtcmFrameRing *_pStandby = nullptr;	  // Frames from the standby receiver
+	bool _onStandby = false;					  // Output comes from the standby
+	bool _returning = false;					  // Primary is back. Switch at the end of this epoch
+	bool _primaryAligned = true;				  // Primary frames start a new epoch in the output
+	uint32_t _standbySeq = 0;					  // Next standby frame to copy
+	uint32_t _standbyEpoch = 0;					  // Standby epoch count last seen
+	unsigned long _standbyEpochTime = 0;		  // Millis of the last standby epoch
+	unsigned long _primaryEpochTime = 0;		  // Millis of the last primary epoch
+	unsigned long _primaryFrameTime = 0;		  // Millis of the last primary frame
+	unsigned long _firstFrameTime = 0;			  // Millis of the first primary frame (0 = none yet)
+	bool _noMsm = false;						  // Primary has no epoch markers so the failover is off
+	unsigned long _epochInterval = 0;			  // Smoothed primary epoch interval (ms)
+	int _primaryEpochs = 0;						  // Epochs seen from the primary
+	int _recoverEpochs = 0;						  // Regular primary epochs since the stall
+	unsigned long _switchTime = 0;				  // Millis when the standby took over
+	unsigned long _standbyTotal = 0;			  // Completed time on the standby (ms)
+	int _switches = 0;							  // Times the standby took over
+	int _returns = 0;							  // Times the primary took back over
+	unsigned long _switchLatency = 0;			  // Last gap from the primary epoch to the standby epoch (ms)
+	unsigned long _maxSwitchLatency = 0;		  // Longest switch gap (ms)
+	int _standbyFrames = 0;						  // Standby frames sent on
+	int _heldFrames = 0;						  // Primary frames held back while on standby
+	byte _hold[FAILOVER_HOLD_MAX];				  // Primary frames of the unfinished epoch
+	int _holdLength[FAILOVER_HOLD_FRAMES];		  // Length of each held frame
+	int _holdType[FAILOVER_HOLD_FRAMES];		  // Message type of each held frame
+	int _holdCount = 0;							  // Frames in _hold
+	int _holdBytes = 0;							  // Bytes used in _hold
+	int _droppedPartial = 0;					  // Primary frames dropped as their epoch never finished
+	int _holdOverflows = 0;						  // Epochs too big to hold and sent as they came
+	byte _frame[RTCM_MAX_FRAME];				  // Copy of a standby frame for the station rewrite
+
+	unsigned long StallTime() const;
+	void SwitchToStandby();
+	bool Hold(RtcmFrameRing &output, const byte *pFrame, int length, int type, bool endOfEpoch);
+	void ReleaseHeld(RtcmFrameRing &output);
+	void TurnOffNoMsm();
+	void CopyStandby(RtcmFrameRing &output);
+	void LogX(std::string text);
+	template <size_t N, typename... Args>
+	void LogX(const char (&format)[N], Args... args)
+	{
+		Logf(LOG_FAILOVER, format, args...);
+	}
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <lwip/sockets.h>
+#include "RtcmFrameRing.h"
+
+// Most frames gathered into one write
+#define RING_WRITER_VIEWS_MAX 16
+
+// Results from RingWriter::Write() besides the bytes sent
+#define RING_WRITE_BLOCKED -1
+#define RING_WRITE_FAILED -2
+
+///////////////////////////////////////////////////////////////////////////////
+// One reader's position in the shared frame ring and the code to push what
+// .. is waiting to a non-blocking socket. Frames go straight from the ring
+// .. with writev and a partly sent frame is finished on the next call. The
+// .. queue for each reader is just the distance from its cursor to the head
+// .. of the ring so it is bounded by the ring and costs nothing to hold
+class RingWriter
+{
+private:
+	uint32_t _nextSeq = 0;	 // Next frame to send
+	int _offset = 0;		 // Bytes of the frame at _nextSeq already sent
+	int _drops = 0;			 // Frames overwritten before they were sent
+	uint64_t _bytesSent = 0; // Total bytes sent
+
+public:
+	inline int GetDrops() const { return _drops; }
+	inline uint64_t GetBytesSent() const { return _bytesSent; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Start from the next frame added to the ring
+	inline void Start(const RtcmFrameRing &ring)
+	{
+		_nextSeq = ring.NextSeq();
+		_offset = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Frames waiting to be sent
+	inline uint32_t Backlog(const RtcmFrameRing &ring) const
+	{
+		return ring.NextSeq() - max(_nextSeq, ring.OldestSeq());
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Age of the oldest frame waiting (0 if none)
+	inline unsigned long Lag(const RtcmFrameRing &ring) const
+	{
+		const RtcmFrame *pFrame = ring.Get(max(_nextSeq, ring.OldestSeq()));
+		return pFrame == nullptr ? 0 : millis() - pFrame->time;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Send as much as the socket will take without blocking
+	// @return Bytes sent, RING_WRITE_BLOCKED or RING_WRITE_FAILED
+	int Write(int fd, const RtcmFrameRing &ring)
+	{
+		// Frames overwritten before we took them
+		if (_nextSeq < ring.OldestSeq())
+		{
+			_drops += ring.OldestSeq() - _nextSeq;
+			_nextSeq = ring.OldestSeq();
+			_offset = 0;
+		}
+		if (_nextSeq >= ring.NextSeq())
+			return 0;
+
+		struct iovec views[RING_WRITER_VIEWS_MAX];
+		int count = 0;
+		for (uint32_t seq = _nextSeq; seq < ring.NextSeq() && count < RING_WRITER_VIEWS_MAX; seq++)
+		{
+			const RtcmFrame *pFrame = ring.Get(seq);
+			int skip = count == 0 ? _offset : 0;
+			views[count].iov_base = (void *)(pFrame->pData + skip);
+			views[count].iov_len = pFrame->length - skip;
+			count++;
+		}
+
+		int sent = lwip_writev(fd, views, count);
+		if (sent < 0)
+			return (errno == EWOULDBLOCK || errno == EAGAIN) ? RING_WRITE_BLOCKED : RING_WRITE_FAILED;
+
+		// Move the cursor past what went
+		_bytesSent += sent;
+		int remaining = sent;
+		while (remaining > 0)
+		{
+			int left = ring.Get(_nextSeq)->length - _offset;
+			if (remaining < left)
+			{
+				_offset += remaining;
+				break;
+			}
+			remaining -= left;
+			_nextSeq++;
+			_offset = 0;
+		}
+		return sent;
+	}
+};
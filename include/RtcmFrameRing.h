@@ -0,0 +1,103 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Rtcm.h"
+
+// Bytes in the shared frame arena. About 10s of MSM7 for six constellations
+#define FRAME_RING_SIZE (24 * 1024)
+
+// Number of frames that can be indexed (Must be a power of 2)
+#define FRAME_RING_SLOTS 256
+
+///////////////////////////////////////////////////////////////////////////////
+// A validated RTCM frame held in the ring
+struct RtcmFrame
+{
+	const byte *pData;		 // Start of the frame including preamble and CRC
+	uint16_t length;		 // Total frame length
+	uint16_t type;			 // RTCM message number
+	uint32_t epoch;			 // Epoch counter. Increments after each MSM end of epoch
+	unsigned long time;		 // Millis when the frame was received
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Single writer ring of complete RTCM frames. Each frame is copied once into
+// .. the arena and every consumer keeps its own sequence number cursor. This
+// .. means a slow caster only falls behind and never blocks the parser.
+// .. When the arena is full the oldest frames are overwritten and consumers
+// .. still pointing at them see a gap between their cursor and OldestSeq()
+class RtcmFrameRing
+{
+private:
+	byte _arena[FRAME_RING_SIZE];		  // Frame data
+	RtcmFrame _slots[FRAME_RING_SLOTS];	  // Frame index by sequence number
+	uint32_t _oldestSeq = 0;			  // Oldest frame still available
+	uint32_t _nextSeq = 0;				  // Sequence number of the next frame added
+	int _head = 0;						  // Where the next frame is written
+	uint32_t _epoch = 0;				  // Current epoch number
+
+public:
+	inline uint32_t OldestSeq() const { return _oldestSeq; }
+	inline uint32_t NextSeq() const { return _nextSeq; }
+	inline uint32_t CurrentEpoch() const { return _epoch; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Get a frame by sequence number
+	// @return nullptr if the frame has been overwritten or not received yet
+	inline const RtcmFrame *Get(uint32_t seq) const
+	{
+		if (seq < _oldestSeq || seq >= _nextSeq)
+			return nullptr;
+		return &_slots[seq & (FRAME_RING_SLOTS - 1)];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Copy a complete frame into the ring evicting the oldest frames as needed
+	void Add(const byte *pBytes, int length, int type)
+	{
+		if (length < 1 || length > FRAME_RING_SIZE)
+			return;
+
+		// Keep frames contiguous. Anything past the head is older than
+		// .. everything before it, so wrapping evicts those frames first
+		if (_head + length > FRAME_RING_SIZE)
+		{
+			while (_oldestSeq < _nextSeq && OffsetOf(_oldestSeq) >= _head)
+				_oldestSeq++;
+			_head = 0;
+		}
+
+		// Evict frames the new one overwrites
+		while (_oldestSeq < _nextSeq)
+		{
+			int offset = OffsetOf(_oldestSeq);
+			if (offset < _head || offset >= _head + length)
+				break;
+			_oldestSeq++;
+		}
+
+		// Evict if we have run out of index slots
+		if (_nextSeq - _oldestSeq >= FRAME_RING_SLOTS)
+			_oldestSeq = _nextSeq - FRAME_RING_SLOTS + 1;
+
+		// Save the frame
+		memcpy(_arena + _head, pBytes, length);
+		RtcmFrame &frame = _slots[_nextSeq & (FRAME_RING_SLOTS - 1)];
+		frame.pData = _arena + _head;
+		frame.length = length;
+		frame.type = type;
+		frame.epoch = _epoch;
+		frame.time = millis();
+		_head += length;
+		_nextSeq++;
+
+		if (RtcmIsEndOfEpoch(pBytes, length, type))
+			_epoch++;
+	}
+
+private:
+	inline int OffsetOf(uint32_t seq) const
+	{
+		return _slots[seq & (FRAME_RING_SLOTS - 1)].pData - _arena;
+	}
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+// Largest datagram payload. Keeps under a 1500 byte Ethernet/WiFi MTU after IP and UDP headers
+#define UDP_PAYLOAD_MAX 1400
+
+// Bytes of our header in front of the frames
+#define UDP_HEADER_SIZE 8
+
+// Flag set on the last datagram of an epoch
+#define UDP_FLAG_END_OF_EPOCH 0x01
+
+// Longest we wait for the rest of an epoch before sending what we have (ms)
+#define UDP_HOLD_TIME 1000
+
+// Most frames in one datagram
+#define UDP_VIEWS_MAX 32
+
+#include <string>
+#include <vector>
+#include <lwip/sockets.h>
+#include "RtcmFrameRing.h"
+#include "HandyLog.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Sends each RTCM epoch to a multicast or broadcast address so any number of
+// .. machines on the LAN can listen for the cost of one. Configured with
+//		address=239.0.0.1 port=2103 ttl=1
+// .. Frames are never split so each datagram can be decoded on its own.
+// .. Every datagram starts with an 8 byte header (Big endian)
+//		0	uint32	Sequence number (Increments per datagram, gaps are loss)
+//		4	uint16	Epoch number (Low 16 bits)
+//		6	uint8	Flags (UDP_FLAG_END_OF_EPOCH)
+//		7	uint8	Header version (1)
+// .. followed by whole RTCM3 frames taken straight from the ring
+class RtcmUdpSender
+{
+public:
+	~RtcmUdpSender();
+	void LoadSettings();
+	void Save(const char *options) const;
+	void Loop(const RtcmFrameRing &ring);
+
+	inline bool IsEnabled() const { return _port > 0; }
+	inline const std::string &GetAddress() const { return _sAddress; }
+	inline int GetPort() const { return _port; }
+	inline const std::string &GetOptions() const { return _sOptions; }
+	inline uint32_t GetDatagrams() const { return _sequence; }
+	inline uint64_t GetBytesSent() const { return _bytesSent; }
+	inline int GetDatagramRate() const { return _datagramRate; }
+	inline int GetByteRate() const { return _byteRate; }
+	inline int GetSendErrors() const { return _sendErrors; }
+	inline int GetDroppedFrames() const { return _droppedFrames; }
+
+private:
+	std::string _sOptions;				  // Settings line
+	std::string _sAddress;				  // Multicast or broadcast address
+	int _port = 0;						  // Destination port (0 = off)
+	int _ttl = 1;						  // Multicast hops
+	int _fd = -1;						  // UDP socket (Opened on first loop)
+	struct sockaddr_in _destination;	  // Where datagrams go
+	uint32_t _nextSeq = 0;				  // Next frame in the ring to send
+	bool _started = false;				  // Cursor set to the ring
+	uint32_t _sequence = 0;				  // Datagrams sent
+	uint64_t _bytesSent = 0;			  // Total bytes sent including headers
+	int _sendErrors = 0;				  // Datagrams the stack refused
+	int _droppedFrames = 0;				  // Frames overwritten before they were sent
+	unsigned long _rateTime = 0;		  // Start of the rate window
+	int _rateDatagrams = 0;				  // Datagrams in the rate window
+	int _rateBytes = 0;					  // Bytes in the rate window
+	int _datagramRate = 0;				  // Datagrams per second
+	int _byteRate = 0;					  // Bytes per second
+
+	bool Open();
+	bool SendNext(const RtcmFrameRing &ring);
+	void LogX(std::string text);
+	template <size_t N, typename... Args>
+	void LogX(const char (&format)[N], Args... args)
+	{
+		Logf(LOG_UDP_SENDER, format, args...);
+	}
+};
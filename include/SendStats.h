@@ -0,0 +1,161 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Number of recent writes kept for the graph
+#define SEND_STATS_SIZE 256
+
+// Histogram sub-buckets per power of two (As bits). 2 gives 4 per octave so
+// .. each bucket is within 25% of the value
+#define SEND_HISTOGRAM_SUB_BITS 2
+#define SEND_HISTOGRAM_SUB (1 << SEND_HISTOGRAM_SUB_BITS)
+
+// Buckets up to about 67 seconds. Anything longer lands in the last one
+#define SEND_HISTOGRAM_BUCKETS 100
+
+///////////////////////////////////////////////////////////////////////////////
+// One socket write
+struct SendSample
+{
+	uint32_t micros; // Time in the write call
+	uint32_t bytes;	 // Bytes written
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Write statistics for a caster. Every update is O(1)
+//	- Fixed ring of the last SEND_STATS_SIZE writes for the graph
+//	- Log bucketed histogram of write time for percentiles (HDR style, each
+//	  .. power of two split into SEND_HISTOGRAM_SUB linear buckets)
+//	- EWMA of the bytes per second actually sent
+class SendStats
+{
+private:
+	SendSample _samples[SEND_STATS_SIZE];			 // Recent writes
+	int _head = 0;									 // Where the next sample goes
+	int _count = 0;									 // Samples held
+	uint32_t _histogram[SEND_HISTOGRAM_BUCKETS] = {}; // Write count by time bucket
+	uint32_t _total = 0;							 // Writes in the histogram
+	uint32_t _max = 0;								 // Longest write (us)
+	uint64_t _ringMicros = 0;						 // Write time of the samples in the ring
+	uint64_t _ringBytes = 0;						 // Bytes of the samples in the ring
+	unsigned long _windowStart = 0;					 // Millis at the start of the rate window
+	uint32_t _windowBytes = 0;						 // Bytes in the rate window
+	uint32_t _bytesPerSecond = 0;					 // Throughput EWMA
+
+public:
+	inline int Count() const { return _count; }
+	inline uint32_t Max() const { return _max; }
+	inline uint32_t Total() const { return _total; }
+	inline uint32_t BytesPerSecond() const { return _bytesPerSecond; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Get a recent sample
+	// @param n 0 is the oldest held
+	inline const SendSample &Get(int n) const
+	{
+		return _samples[(_head - _count + n + SEND_STATS_SIZE) % SEND_STATS_SIZE];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Average write speed over the recent samples (Bytes per ms in the write)
+	inline uint32_t WriteSpeed() const
+	{
+		return _ringMicros == 0 ? 0 : (uint32_t)(_ringBytes * 1000 / _ringMicros);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Record a write
+	void Add(uint32_t micros, uint32_t bytes)
+	{
+		// Replace the oldest sample
+		SendSample &sample = _samples[_head];
+		if (_count == SEND_STATS_SIZE)
+		{
+			_ringMicros -= sample.micros;
+			_ringBytes -= sample.bytes;
+		}
+		else
+		{
+			_count++;
+		}
+		sample.micros = micros;
+		sample.bytes = bytes;
+		_ringMicros += micros;
+		_ringBytes += bytes;
+		_head = (_head + 1) % SEND_STATS_SIZE;
+
+		_histogram[Bucket(micros)]++;
+		_total++;
+		_max = max(_max, micros);
+
+		// Throughput over one second windows smoothed over about 4 windows
+		unsigned long now = millis();
+		_windowBytes += bytes;
+		if (now - _windowStart >= 1000)
+		{
+			uint32_t rate = (uint32_t)((uint64_t)_windowBytes * 1000 / (now - _windowStart));
+			_bytesPerSecond = _bytesPerSecond == 0 ? rate : (_bytesPerSecond * 3 + rate) / 4;
+			_windowBytes = 0;
+			_windowStart = now;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Write time at a percentile. Reported as the top of the bucket so it is
+	// .. never under the true value. The last bucket has no top so is the max
+	// @param percent 0 to 100
+	uint32_t Percentile(int percent) const
+	{
+		if (_total == 0)
+			return 0;
+		uint64_t target = ((uint64_t)_total * percent + 99) / 100;
+		uint64_t seen = 0;
+		for (int n = 0; n < SEND_HISTOGRAM_BUCKETS; n++)
+		{
+			seen += _histogram[n];
+			if (seen >= target && seen > 0)
+				return n == SEND_HISTOGRAM_BUCKETS - 1 ? _max : min(_max, BucketTop(n));
+		}
+		return _max;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	void Reset()
+	{
+		_head = 0;
+		_count = 0;
+		memset(_histogram, 0, sizeof(_histogram));
+		_total = 0;
+		_max = 0;
+		_ringMicros = 0;
+		_ringBytes = 0;
+		_windowBytes = 0;
+		_bytesPerSecond = 0;
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	// Values under SEND_HISTOGRAM_SUB get a bucket each. Above that the
+	// .. position of the top bit picks the octave and the next bits the
+	// .. bucket within it
+	static int Bucket(uint32_t value)
+	{
+		if (value < SEND_HISTOGRAM_SUB)
+			return value;
+		int msb = 31 - __builtin_clz(value);
+		int shift = msb - SEND_HISTOGRAM_SUB_BITS;
+		int index = (shift + 1) * SEND_HISTOGRAM_SUB + ((value >> shift) & (SEND_HISTOGRAM_SUB - 1));
+		return min(index, SEND_HISTOGRAM_BUCKETS - 1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Largest value that lands in a bucket
+	static uint32_t BucketTop(int index)
+	{
+		if (index < SEND_HISTOGRAM_SUB)
+			return index;
+		int shift = index / SEND_HISTOGRAM_SUB - 1;
+		uint32_t low = (uint32_t)(SEND_HISTOGRAM_SUB + index % SEND_HISTOGRAM_SUB) << shift;
+		return low + (1u << shift) - 1;
+	}
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+// Most addresses we try in parallel for one host
+#define CONNECTOR_MAX_ADDRESSES 4
+
+// Default time the resolved addresses are reused (ms)
+#define DEFAULT_DNS_TTL (5 * 60000)
+
+// How long the parallel connect attempts have to succeed
+#define CONNECT_TIMEOUT 5000
+
+// How long a name lookup has before the attempt fails (The lookup task carries on)
+#define RESOLVE_TIMEOUT 10000
+
+// Longest host name we look up
+#define RESOLVE_HOST_MAX 64
+
+// State of the lookup task
+#define RESOLVE_IDLE 0 // No lookup running or waiting to be read
+#define RESOLVE_BUSY 1 // Task is looking up the name
+#define RESOLVE_DONE 2 // Results are ready to be read by the main loop
+
+// TCP keepalive on the idle standby socket. A silent peer is found after
+// .. KEEPALIVE_IDLE + KEEPALIVE_INTERVAL x KEEPALIVE_COUNT seconds
+#define KEEPALIVE_IDLE 2
+#define KEEPALIVE_INTERVAL 1
+#define KEEPALIVE_COUNT 3
+
+// Results from SocketConnector::Poll()
+#define CONNECT_PENDING -1
+#define CONNECT_FAILED -2
+
+#include <string>
+#include <atomic>
+#include <Arduino.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Opens a TCP connection without blocking the main loop. The host name is
+// .. resolved by a short lived task, as getaddrinfo blocks, and cached for
+// .. the TTL. A non-blocking connect is started to every resolved address
+// .. and the first to complete wins. Call Poll() each loop until it returns
+// .. a socket or fails.
+class SocketConnector
+{
+public:
+	SocketConnector();
+	~SocketConnector();
+	void Setup(const std::string &host, int port, unsigned long dnsTtl);
+	bool Start();
+	int Poll();
+	void Cancel();
+
+	inline bool IsPending() const { return _fdCount > 0 || _resolving; }
+	inline int GetAddressCount() const { return _addressCount; }
+	inline int GetResolves() const { return _resolves; }
+	inline int GetCacheHits() const { return _cacheHits; }
+	inline unsigned long GetResolveTime() const { return _resolveTime; }
+	inline const std::string &GetLastError() const { return _lastError; }
+	static bool IsAlive(int fd);
+	static void SetKeepAlive(int fd);
+
+private:
+	std::string _host;								// Host name or dotted address
+	int _port = 0;									// Port to connect to
+	unsigned long _dnsTtl = DEFAULT_DNS_TTL;		// How long to reuse the addresses (ms)
+	uint32_t _addresses[CONNECTOR_MAX_ADDRESSES];	// Resolved IPv4 addresses (Network order)
+	int _addressCount = 0;							// Number of resolved addresses
+	unsigned long _resolvedAt = 0;					// Millis when last resolved
+	int _fds[CONNECTOR_MAX_ADDRESSES];				// Sockets with a connect in progress
+	int _fdCount = 0;								// Number of sockets in progress
+	unsigned long _startTime = 0;					// Millis when the attempts started
+	int _resolves = 0;								// Number of DNS lookups
+	int _cacheHits = 0;								// Number of connects that reused the cache
+	unsigned long _resolveTime = 0;					// Time of the last lookup (ms)
+	std::string _lastError;							// Why the last attempt failed
+	bool _resolving = false;						// Waiting on the lookup task
+	unsigned long _resolveStart = 0;				// Millis when we started waiting
+
+	// Shared with the lookup task. It only writes these while BUSY
+	std::atomic<int> _resolveState{RESOLVE_IDLE};	// RESOLVE_xxx
+	char _resolveHost[RESOLVE_HOST_MAX];			// Name being looked up
+	uint32_t _resolved[CONNECTOR_MAX_ADDRESSES];	// Addresses found (Network order)
+	int _resolvedCount = 0;							// Number of addresses found
+	int _resolveResult = 0;							// getaddrinfo result
+	unsigned long _resolveMillis = 0;				// Time the lookup took
+
+	bool StartResolve();
+	int TakeResolved();
+	bool Connect();
+	static void ResolveTask(void *param);
+	void Resolve();
+	void CloseAll(int keepFd);
+};
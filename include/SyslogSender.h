@@ -0,0 +1,84 @@
+#pragma once
+
+// Largest datagram. Keeps under a 1500 byte Ethernet/WiFi MTU after IP and UDP headers
+#define SYSLOG_PAYLOAD_MAX 1400
+
+// Seconds between sends when not set
+#define SYSLOG_DEFAULT_INTERVAL 10
+
+// Most datagrams sent on one tick so a backlog cannot stall the loop
+#define SYSLOG_BURST_MAX 8
+
+// Room kept in front of the log lines for the header
+#define SYSLOG_HEADER_MAX 160
+
+// Facility for every message (local0)
+#define SYSLOG_FACILITY 16
+
+// Private enterprise number for the structured data IDs (RFC 5612 documentation number)
+#define SYSLOG_SD_PEN "32473"
+
+#include <string>
+#include <functional>
+#include <lwip/sockets.h>
+#include "HandyLog.h"
+#include "TextBuilder.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Ships the log and a line of metrics to a collector so a fleet of stations
+// .. can be watched from one place. Configured with one line of options
+//		address=192.168.1.10 port=514 interval=10 metrics=60
+// .. On each tick the log records not yet sent are packed into as few
+// .. datagrams as possible. Each datagram is one RFC 5424 message
+//		<PRI>1 - HOST ntrip-server - LOG [log@32473 seq="120" count="9" lost="0"] lines
+// .. with one log line per record and the PRI set by the worst line (E = err,
+// .. W = warning). The log arena is the bounded buffer, so if the collector
+// .. cannot keep up the oldest records are dropped and counted in 'lost'.
+// .. Every 'metrics' seconds a METRICS message carries the values given by
+// .. the metrics callback as structured data
+class SyslogSender
+{
+public:
+	~SyslogSender();
+	void LoadSettings();
+	void Save(const char *options) const;
+	void Setup(const char *hostName, std::function<void(TextBuilder &params)> metrics);
+	void Loop();
+
+	inline bool IsEnabled() const { return _port > 0; }
+	inline const std::string &GetAddress() const { return _sAddress; }
+	inline int GetPort() const { return _port; }
+	inline const std::string &GetOptions() const { return _sOptions; }
+	inline uint32_t GetDatagrams() const { return _datagrams; }
+	inline uint32_t GetRecordsSent() const { return _recordsSent; }
+	inline uint64_t GetBytesSent() const { return _bytesSent; }
+	inline uint32_t GetLost() const { return _lost; }
+	inline int GetSendErrors() const { return _sendErrors; }
+	inline int GetBacklog() const { return GetLog().NextSeq() - max(_nextSeq, GetLog().OldestSeq()); }
+
+private:
+	std::string _sOptions;				  // Settings line
+	std::string _sAddress;				  // Collector address
+	std::string _sHost = "-";			  // HOSTNAME field
+	int _port = 0;						  // Collector port (0 = off)
+	unsigned long _interval = 0;		  // Time between sends (ms)
+	unsigned long _metricsInterval = 0;	  // Time between metrics (ms, 0 = off)
+	std::function<void(TextBuilder &)> _metrics; // Adds the metric parameters
+	int _fd = -1;						  // UDP socket (Opened on first loop)
+	struct sockaddr_in _destination;	  // Where datagrams go
+	uint32_t _nextSeq = 0;				  // Next log record to send
+	unsigned long _lastSend = 0;		  // Millis of the last tick
+	unsigned long _lastMetrics = 0;		  // Millis of the last metrics
+	uint32_t _datagrams = 0;			  // Datagrams sent
+	uint32_t _recordsSent = 0;			  // Log records sent
+	uint64_t _bytesSent = 0;			  // Total bytes sent
+	uint32_t _lost = 0;					  // Records dropped from the log before they were sent
+	int _sendErrors = 0;				  // Datagrams the stack refused
+	char _datagram[SYSLOG_PAYLOAD_MAX];	  // Message being built
+	char _line[LOG_LINE_MAX];			  // One rendered record
+
+	bool Open();
+	bool SendLog();
+	void SendMetrics();
+	bool Send(const char *pData, int length);
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+// Longest integer text including sign and '\0' (-9223372036854775808)
+#define TEXT_INTEGER_MAX 21
+
+// Longest uptime text including '\0' (49710 06:28:15.295 at the wrap of millis)
+#define TEXT_UPTIME_MAX 24
+
+///////////////////////////////////////////////////////////////////////////////
+// Formatting straight into a caller's buffer. Nothing here allocates. Each
+// .. function writes as much as fits, always ends the text with '\0' and
+// .. returns the characters written (Not counting the '\0')
+int FormatUnsigned(char *pOut, int size, uint64_t value);
+int FormatSigned(char *pOut, int size, int64_t value);
+int FormatThousands(char *pOut, int size, int64_t value);
+int FormatHex(char *pOut, int size, const byte *pData, int length, char separator = ' ');
+int FormatUptime(char *pOut, int size, unsigned long millis);
+
+///////////////////////////////////////////////////////////////////////////////
+// Builds text in a fixed buffer owned by the caller. Anything past the end
+// .. is dropped and remembered so the text is never overrun. Clear it to
+// .. use the same buffer again
+class TextBuilder
+{
+public:
+	TextBuilder(char *pBuffer, int size) : _pBuffer(pBuffer), _size(size) { Clear(); }
+
+	inline const char *c_str() const { return _pBuffer; }
+	inline int Length() const { return _length; }
+	inline bool IsTruncated() const { return _truncated; }
+
+	inline void Clear()
+	{
+		_length = 0;
+		_truncated = false;
+		if (_size > 0)
+			_pBuffer[0] = '\0';
+	}
+
+	TextBuilder &Append(const char *pText, int length)
+	{
+		int room = _size - 1 - _length;
+		if (length > room)
+		{
+			length = max(room, 0);
+			_truncated = true;
+		}
+		memcpy(_pBuffer + _length, pText, length);
+		_length += length;
+		_pBuffer[_length] = '\0';
+		return *this;
+	}
+	inline TextBuilder &Append(const char *pText) { return Append(pText, strlen(pText)); }
+	inline TextBuilder &Append(char c)
+	{
+		// Called per character by the escaping loops so kept short
+		if (_length >= _size - 1)
+		{
+			_truncated = true;
+			return *this;
+		}
+		_pBuffer[_length++] = c;
+		_pBuffer[_length] = '\0';
+		return *this;
+	}
+
+	inline TextBuilder &AppendUnsigned(uint64_t value)
+	{
+		char text[TEXT_INTEGER_MAX];
+		return Append(text, FormatUnsigned(text, sizeof(text), value));
+	}
+	inline TextBuilder &AppendSigned(int64_t value)
+	{
+		char text[TEXT_INTEGER_MAX];
+		return Append(text, FormatSigned(text, sizeof(text), value));
+	}
+	inline TextBuilder &AppendThousands(int64_t value)
+	{
+		char text[TEXT_INTEGER_MAX + 6];
+		return Append(text, FormatThousands(text, sizeof(text), value));
+	}
+	inline TextBuilder &AppendUptime(unsigned long millis)
+	{
+		char text[TEXT_UPTIME_MAX];
+		return Append(text, FormatUptime(text, sizeof(text), millis));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Append bytes as hex. Goes straight into the buffer as it can be long
+	TextBuilder &AppendHex(const byte *pData, int length, char separator = ' ')
+	{
+		int written = FormatHex(End(), Room(), pData, length, separator);
+		if (written < length * (separator == '\0' ? 2 : 3))
+			_truncated = true;
+		_length += written;
+		return *this;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Append printf style. Only for what the calls above cannot do
+	__attribute__((format(printf, 2, 3))) TextBuilder &Printf(const char *format, ...)
+	{
+		if (Room() <= 1)
+		{
+			_truncated = true;
+			return *this;
+		}
+		va_list args;
+		va_start(args, format);
+		int n = vsnprintf(End(), Room(), format, args);
+		va_end(args);
+		if (n < 0)
+			return *this;
+		if (n >= Room())
+		{
+			_truncated = true;
+			n = Room() - 1;
+		}
+		_length += n;
+		return *this;
+	}
+
+private:
+	char *_pBuffer;			 // Text being built
+	int _size;				 // Bytes in the buffer including the '\0'
+	int _length = 0;		 // Characters so far
+	bool _truncated = false; // Something did not fit
+
+	inline char *End() { return _pBuffer + _length; }
+	inline int Room() const { return _size - _length; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Text builder with its own buffer, for a line made on the stack or kept in
+// .. a class and reused
+template <int N>
+class FixedText : public TextBuilder
+{
+public:
+	FixedText() : TextBuilder(_buffer, N) {}
+	FixedText(const FixedText &) = delete;
+	FixedText &operator=(const FixedText &) = delete;
+
+private:
+	char _buffer[N];
+};
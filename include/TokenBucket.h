@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Rtcm.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Token bucket used to shape the bytes sent to a caster. Tokens are bytes and
+// .. refill at the configured rate up to the burst size. A rate of zero
+// .. disables shaping and every request is granted
+class TokenBucket
+{
+private:
+	uint32_t _rate = 0;				 // Bytes per second (0 = unlimited)
+	uint32_t _burst = 0;			 // Maximum tokens held
+	uint64_t _microTokens = 0;		 // Tokens available x 1,000,000
+	unsigned long _lastRefill = 0;	 // Micros of last refill
+
+public:
+	inline bool IsEnabled() const { return _rate > 0; }
+	inline uint32_t GetRate() const { return _rate; }
+	inline uint32_t GetBurst() const { return _burst; }
+
+	///////////////////////////////////////////////////////////////////////////
+	// Set the rate and burst. The burst is never less than the largest RTCM
+	// .. frame, otherwise a big MSM7 frame could never be sent
+	void Setup(uint32_t rate, uint32_t burst)
+	{
+		_rate = rate;
+		_burst = max(burst, (uint32_t)RTCM_MAX_FRAME);
+		_microTokens = (uint64_t)_burst * 1000000;
+		_lastRefill = micros();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Check there are tokens for a send without taking them
+	bool CanTake(uint32_t bytes)
+	{
+		if (!IsEnabled())
+			return true;
+		Refill();
+		return _microTokens >= (uint64_t)bytes * 1000000;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Take tokens for bytes that have gone. Checked first with CanTake so
+	// .. only bytes actually sent use up the budget
+	void Take(uint32_t bytes)
+	{
+		if (!IsEnabled())
+			return;
+		Refill();
+		uint64_t needed = (uint64_t)bytes * 1000000;
+		_microTokens = _microTokens > needed ? _microTokens - needed : 0;
+	}
+
+private:
+	void Refill()
+	{
+		unsigned long now = micros();
+		_microTokens += (uint64_t)(now - _lastRefill) * _rate;
+		_lastRefill = now;
+		uint64_t full = (uint64_t)_burst * 1000000;
+		if (_microTokens > full)
+			_microTokens = full;
+	}
+};
@@ -1,16 +1,43 @@
 #pragma once
 
+// Most records returned by one /api/log call. The page asks again for the rest
+#define LOG_API_RECORDS 100
+
+// Bytes of JSON built before each send. Holds the worst case escaped line
+#define LOG_API_CHUNK 8192
+
+// Longest caster options line. Room for every option with two TLS
+// .. fingerprints and three backup casters
+#define CASTER_OPTIONS_MAX 400
+
 #include "Global.h"
 #include <WiFiManager.h>
 #include "HandyString.h"
 #include "NTRIPServer.h"
+#include "LocalCaster.h"
+#include "RawRtcmServer.h"
+#include "RtcmUdpSender.h"
+#include "ReceiverFailover.h"
+#include "NtripClientInput.h"
 #include "GpsParser.h"
+#include "LogStore.h"
+#include "SyslogSender.h"
 
 extern WiFiManager _wifiManager;
 extern NTRIPServer _ntripServer0;
 extern NTRIPServer _ntripServer1;
 extern NTRIPServer _ntripServer2;
+extern LocalCaster _localCaster;
+extern RawRtcmServer _rawServer;
+extern RtcmUdpSender _udpSender;
+extern ReceiverFailover _failover;
+extern NtripClientInput _ntripInput;
 extern GpsParser _gpsParser;
+extern LogStore _logStore;
+extern SyslogSender _syslog;
+#ifdef GPS2_SERIAL
+extern GpsParser _gpsParser2;
+#endif
 
 /// @brief Class manages the web pages displayed in the device.
 class WebPortal
@@ -26,7 +53,9 @@ private:
 	void ShowStatusHtml();
 	void GraphHtml() const;
 	void GraphDetail(std::string &html, std::string divId, const NTRIPServer &server) const;
-	void HtmlLog(const char *title, const std::vector<std::string> &log) const;
+	void HtmlLog(const char *title, const char *source) const;
+	void ApiLog() const;
+	void HtmlSavedLog() const;
 	void OnSaveParamsCallback();
 
 	int _loops = 0;
@@ -35,16 +64,26 @@ private:
 	WiFiManagerParameter *_pCaster0Port;
 	WiFiManagerParameter *_pCaster0Credential;
 	WiFiManagerParameter *_pCaster0Password;
+	WiFiManagerParameter *_pCaster0Options;
 
 	WiFiManagerParameter *_pCaster1Address;
 	WiFiManagerParameter *_pCaster1Port;
 	WiFiManagerParameter *_pCaster1Credential;
 	WiFiManagerParameter *_pCaster1Password;
+	WiFiManagerParameter *_pCaster1Options;
 
 	WiFiManagerParameter *_pCaster2Address;
 	WiFiManagerParameter *_pCaster2Port;
 	WiFiManagerParameter *_pCaster2Credential;
 	WiFiManagerParameter *_pCaster2Password;
+	WiFiManagerParameter *_pCaster2Options;
+
+	WiFiManagerParameter *_pLocalCasterOptions;
+	WiFiManagerParameter *_pRawServerOptions;
+	WiFiManagerParameter *_pUdpSenderOptions;
+	WiFiManagerParameter *_pFailoverOptions;
+	WiFiManagerParameter *_pNtripInputOptions;
+	WiFiManagerParameter *_pSyslogOptions;
 };
 
 /// @brief Startup the portal
@@ -60,33 +99,52 @@ void WebPortal::Setup()
 	_pCaster0Port = new WiFiManagerParameter("port0", "Caster 1 port [Normally 2101] (0 = off)", port0String.c_str(), 6);
 	_pCaster0Credential = new WiFiManagerParameter("credential0", "Caster 1 credential ", _ntripServer0.GetCredential().c_str(), 40);
 	_pCaster0Password = new WiFiManagerParameter("password0", "Caster 1 password", _ntripServer0.GetPassword().c_str(), 40);
+	_pCaster0Options = new WiFiManagerParameter("options0", "Caster 1 options (maxage=5000 rate=2000 burst=4000 v2=1 user=name tls=1 fp=sha256,sha256 standby=1 dnsttl=300 stall=3000 input=2 msm=4 signals=2 backup=host:port,host:port)", _ntripServer0.GetOptions().c_str(), CASTER_OPTIONS_MAX);
 
 	std::string port1String = std::to_string(_ntripServer1.GetPort());
 	_pCaster1Address = new WiFiManagerParameter("address1", "Caster 2 address", _ntripServer1.GetAddress().c_str(), 40);
 	_pCaster1Port = new WiFiManagerParameter("port1", "Caster 2 port (0 = off)", port1String.c_str(), 6);
 	_pCaster1Credential = new WiFiManagerParameter("credential1", "Caster 2 credential", _ntripServer1.GetCredential().c_str(), 40);
 	_pCaster1Password = new WiFiManagerParameter("password1", "Caster 2 password", _ntripServer1.GetPassword().c_str(), 40);
+	_pCaster1Options = new WiFiManagerParameter("options1", "Caster 2 options (maxage=5000 rate=2000 burst=4000 v2=1 user=name tls=1 fp=sha256,sha256 standby=1 dnsttl=300 stall=3000 input=2 msm=4 signals=2 backup=host:port,host:port)", _ntripServer1.GetOptions().c_str(), CASTER_OPTIONS_MAX);
 
 	std::string port2String = std::to_string(_ntripServer2.GetPort());
 	_pCaster2Address = new WiFiManagerParameter("address2", "Caster 3 address", _ntripServer2.GetAddress().c_str(), 40);
 	_pCaster2Port = new WiFiManagerParameter("port2", "Caster 3 port (0 = off)", port2String.c_str(), 6);
 	_pCaster2Credential = new WiFiManagerParameter("credential2", "Caster 3 credential", _ntripServer2.GetCredential().c_str(), 40);
 	_pCaster2Password = new WiFiManagerParameter("password2", "Caster 3 password", _ntripServer2.GetPassword().c_str(), 40);
+	_pCaster2Options = new WiFiManagerParameter("options2", "Caster 3 options (maxage=5000 rate=2000 burst=4000 v2=1 user=name tls=1 fp=sha256,sha256 standby=1 dnsttl=300 stall=3000 input=2 msm=4 signals=2 backup=host:port,host:port)", _ntripServer2.GetOptions().c_str(), CASTER_OPTIONS_MAX);
 
 	_wifiManager.addParameter(_pCaster0Address);
 	_wifiManager.addParameter(_pCaster0Port);
 	_wifiManager.addParameter(_pCaster0Credential);
 	_wifiManager.addParameter(_pCaster0Password);
+	_wifiManager.addParameter(_pCaster0Options);
 
 	_wifiManager.addParameter(_pCaster1Address);
 	_wifiManager.addParameter(_pCaster1Port);
 	_wifiManager.addParameter(_pCaster1Credential);
 	_wifiManager.addParameter(_pCaster1Password);
+	_wifiManager.addParameter(_pCaster1Options);
 
 	_wifiManager.addParameter(_pCaster2Address);
 	_wifiManager.addParameter(_pCaster2Port);
 	_wifiManager.addParameter(_pCaster2Credential);
 	_wifiManager.addParameter(_pCaster2Password);
+	_wifiManager.addParameter(_pCaster2Options);
+
+	_pLocalCasterOptions = new WiFiManagerParameter("localcaster", "Local caster for LAN rovers (port=2101 mount=RTK user=name password=pass) (Empty = off)", _localCaster.GetOptions().c_str(), 80);
+	_wifiManager.addParameter(_pLocalCasterOptions);
+	_pRawServerOptions = new WiFiManagerParameter("rawserver", "Raw RTCM TCP server (port=2102 backlog=64) (Empty = off)", _rawServer.GetOptions().c_str(), 80);
+	_wifiManager.addParameter(_pRawServerOptions);
+	_pUdpSenderOptions = new WiFiManagerParameter("udpsender", "UDP multicast/broadcast RTCM (address=239.0.0.1 port=2103 ttl=1) (Empty = off)", _udpSender.GetOptions().c_str(), 80);
+	_wifiManager.addParameter(_pUdpSenderOptions);
+	_pNtripInputOptions = new WiFiManagerParameter("ntripinput", "Relay an upstream caster instead of the UART (host=caster.com port=2101 mount=XYZ user=name password=pass v2=1) (Empty = off)", _ntripInput.GetOptions().c_str(), 120);
+	_wifiManager.addParameter(_pNtripInputOptions);
+	_pFailoverOptions = new WiFiManagerParameter("failover", "Hot standby receiver on input 2 (standby=2 epochs=2 station=1234) (Empty = off)", _failover.GetOptions().c_str(), 80);
+	_wifiManager.addParameter(_pFailoverOptions);
+	_pSyslogOptions = new WiFiManagerParameter("syslog", "Syslog collector for the log and metrics (address=192.168.1.10 port=514 interval=10 metrics=60) (Empty = off)", _syslog.GetOptions().c_str(), 80);
+	_wifiManager.addParameter(_pSyslogOptions);
 
 	_wifiManager.setConfigPortalTimeout(0);
 	_wifiManager.setConfigPortalBlocking(false);
@@ -124,15 +182,31 @@ void WebPortal::OnBindServerCallback()
 	_wifiManager.server->on("/castergraph", std::bind(&WebPortal::GraphHtml, this));
 	_wifiManager.server->on("/status", HTTP_GET, std::bind(&WebPortal::ShowStatusHtml, this));
 	_wifiManager.server->on("/log", HTTP_GET, [this]()
-							{ HtmlLog("System log", CopyMainLog());	});
+							{ HtmlLog("System log", "all");	});
 	_wifiManager.server->on("/gpslog", HTTP_GET, [this]()
-							{ HtmlLog("GPS log", _gpsParser.GetLogHistory()); });
+							{ HtmlLog("GPS log", "gps"); });
+#ifdef GPS2_SERIAL
+	_wifiManager.server->on("/gps2log", HTTP_GET, [this]()
+							{ HtmlLog("GPS 2 log", "gps2"); });
+#endif
 	_wifiManager.server->on("/caster1log", HTTP_GET, [this]()
-							{ HtmlLog("Caster 1 log", _ntripServer0.GetLogHistory()); });
+							{ HtmlLog("Caster 1 log", "caster1"); });
 	_wifiManager.server->on("/caster2log", HTTP_GET, [this]()
-							{ HtmlLog("Caster 2 log", _ntripServer1.GetLogHistory()); });
+							{ HtmlLog("Caster 2 log", "caster2"); });
 	_wifiManager.server->on("/caster3log", HTTP_GET, [this]()
-							{ HtmlLog("Caster 3 log", _ntripServer2.GetLogHistory()); });
+							{ HtmlLog("Caster 3 log", "caster3"); });
+	_wifiManager.server->on("/localcasterlog", HTTP_GET, [this]()
+							{ HtmlLog("Local caster log", "localcaster"); });
+	_wifiManager.server->on("/rawserverlog", HTTP_GET, [this]()
+							{ HtmlLog("Raw server log", "rawserver"); });
+	_wifiManager.server->on("/udplog", HTTP_GET, [this]()
+							{ HtmlLog("UDP sender log", "udp"); });
+	_wifiManager.server->on("/failoverlog", HTTP_GET, [this]()
+							{ HtmlLog("Receiver failover log", "failover"); });
+	_wifiManager.server->on("/upstreamlog", HTTP_GET, [this]()
+							{ HtmlLog("Upstream log", "upstream"); });
+	_wifiManager.server->on("/savedlog", HTTP_GET, std::bind(&WebPortal::HtmlSavedLog, this));
+	_wifiManager.server->on("/api/log", HTTP_GET, std::bind(&WebPortal::ApiLog, this));
 
 	_wifiManager.server->on("/FRESET_GPS_CONFIRMED", HTTP_GET, [this]()
 							{ 
@@ -142,6 +216,7 @@ void WebPortal::OnBindServerCallback()
 	_wifiManager.server->on("/RESET_WIFI", HTTP_GET, [this]()
 							{ 
 								_wifiManager.erase();
+								_logStore.Flush();
 								ESP.restart();
 							});
 							
@@ -170,10 +245,17 @@ void WebPortal::OnSaveParamsCallback()
 {
 	Logf("SaveParamsCallback");
 
-	_ntripServer0.Save(_pCaster0Address->getValue(), _pCaster0Port->getValue(), _pCaster0Credential->getValue(), _pCaster0Password->getValue());
-	_ntripServer1.Save(_pCaster1Address->getValue(), _pCaster1Port->getValue(), _pCaster1Credential->getValue(), _pCaster1Password->getValue());
-	_ntripServer2.Save(_pCaster2Address->getValue(), _pCaster2Port->getValue(), _pCaster2Credential->getValue(), _pCaster2Password->getValue());
-
+	_ntripServer0.Save(_pCaster0Address->getValue(), _pCaster0Port->getValue(), _pCaster0Credential->getValue(), _pCaster0Password->getValue(), _pCaster0Options->getValue());
+	_ntripServer1.Save(_pCaster1Address->getValue(), _pCaster1Port->getValue(), _pCaster1Credential->getValue(), _pCaster1Password->getValue(), _pCaster1Options->getValue());
+	_ntripServer2.Save(_pCaster2Address->getValue(), _pCaster2Port->getValue(), _pCaster2Credential->getValue(), _pCaster2Password->getValue(), _pCaster2Options->getValue());
+	_localCaster.Save(_pLocalCasterOptions->getValue());
+	_rawServer.Save(_pRawServerOptions->getValue());
+	_udpSender.Save(_pUdpSenderOptions->getValue());
+	_failover.Save(_pFailoverOptions->getValue());
+	_ntripInput.Save(_pNtripInputOptions->getValue());
+	_syslog.Save(_pSyslogOptions->getValue());
+
+	_logStore.Flush();
 	ESP.restart();
 }
 
@@ -205,44 +287,168 @@ void WebPortal::GraphDetail(std::string &html, std::string divId, const NTRIPSer
 
 	html += "<div id='myPlot" + divId + "' style='width:100%;max-width:700px'></div>\n";
 	html += "<script>";
+	const SendStats &stats = server.GetSendStats();
+	FixedText<TEXT_INTEGER_MAX + 1> value;
 	html += "const xValues" + divId + " = [";
-	for (int n = 0; n < server.GetSendMicroSeconds().size(); n++)
+	for (int n = 0; n < stats.Count(); n++)
 	{
+		value.Clear();
 		if (n != 0)
-			html += ",";
-		html += StringPrintf("%d", n);
+			value.Append(',');
+		value.AppendSigned(n);
+		html.append(value.c_str(), value.Length());
 	}
 	html += "];";
 	html += "const yValues" + divId + " = [";
-	for (int n = 0; n < server.GetSendMicroSeconds().size(); n++)
+	for (int n = 0; n < stats.Count(); n++)
 	{
+		value.Clear();
 		if (n != 0)
-			html += ",";
-		html += StringPrintf("%d", server.GetSendMicroSeconds()[n]);
+			value.Append(',');
+		value.AppendUnsigned(stats.Get(n).micros);
+		html.append(value.c_str(), value.Length());
 	}
 	html += "];";
-	html += "Plotly.newPlot('myPlot" + divId + "', [{x:xValues" + divId + ", y:yValues" + divId + ", mode:'lines'}], {title: '" + server.GetAddress() + " (Mbps)'});";
+	html += "Plotly.newPlot('myPlot" + divId + "', [{x:xValues" + divId + ", y:yValues" + divId + ", mode:'lines'}], {title: '" + server.GetAddress() + 
+		StringPrintf(" write (us) p50 %u p99 %u'});", stats.Percentile(50), stats.Percentile(99));
 	html += "</script>\n";
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Display a log in html format
+/// @brief Display a log in html format. The page only holds the script that
+/// .. polls /api/log for the records it has not seen and appends them
 /// @param title Title of the log
-/// @param log The log to display
-/// TODO : Force to DOS Codepage 437
-void WebPortal::HtmlLog(const char *title, const std::vector<std::string> &log) const
+/// @param source Key of the messages to show ("all" for the system log)
+void WebPortal::HtmlLog(const char *title, const char *source) const
 {
 	Logf("Show %s", title);
 	std::string html = "<html><head></head><h3>Log ";
 	html += title;
 	html += "</h3>";
-	html += "<pre>";
-	for (const auto &entry : log)
+	html += "<pre id='log'></pre>\
+<script>\
+var since = 0;\
+function poll() {\
+	fetch('/api/log?source=";
+	html += source;
+	html += "&since=' + since).then(r => r.json()).then(d => {\
+		var lines = d.lines.join('\\n');\
+		if (d.evicted > 0) lines = '... ' + d.evicted + ' messages (All sources) overwritten before they were read\\n' + lines;\
+		if (lines.length > 0) document.getElementById('log').appendChild(document.createTextNode(lines + '\\n'));\
+		since = d.next;\
+		setTimeout(poll, d.more ? 0 : 2000);\
+	}).catch(() => setTimeout(poll, 5000));\
+}\
+poll();\
+</script></html>";
+	_wifiManager.server->send(200, "text/html", html.c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Send the log records after a sequence number as JSON
+///		{"lines":["0 00:00:01.000 Text",...],"next":123,"evicted":0,"more":false}
+/// .. 'next' is the 'since' for the following call. 'evicted' counts records
+/// .. of every source that left the log before they were read, as the log
+/// .. does not keep the source of a record it has overwritten. Each line is
+/// .. rendered and escaped straight into a fixed buffer that is sent in pieces
+void WebPortal::ApiLog() const
+{
+	LogDrain();
+	WebServer *pServer = _wifiManager.server.get();
+	uint8_t source = LogSourceFromKey(pServer->arg("source").c_str());
+	uint32_t since = strtoul(pServer->arg("since").c_str(), nullptr, 10);
+	const LogRing<LOG_ARENA_SIZE> &log = GetLog();
+	uint32_t evicted = (since > 0 && since < log.OldestSeq()) ? log.OldestSeq() - since : 0;
+	uint32_t next = max(since, log.OldestSeq());
+
+	static char buffer[LOG_API_CHUNK];
+	static char line[LOG_LINE_MAX];
+	TextBuilder json(buffer, sizeof(buffer));
+	int count = 0;
+	bool more = false;
+	pServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+	pServer->send(200, "application/json", "{\"lines\":[");
+	log.ForEach(source, [&](const LogRecord &record)
+				{
+		if (count >= LOG_API_RECORDS)
+		{
+			more = true;
+			return;
+		}
+		int n = LogRender(record, line, sizeof(line));
+		if (json.Length() + n * 6 + 4 >= LOG_API_CHUNK)
+		{
+			pServer->sendContent(json.c_str(), json.Length());
+			json.Clear();
+		}
+		if (count++ > 0)
+			json.Append(',');
+		json.Append('"');
+		int plain = 0;
+		for (int i = 0; i < n; i++)
+		{
+			byte c = line[i];
+			if (c >= ' ' && c < 0x80 && c != '"' && c != '\\')
+				continue;
+
+			// Copy the run of plain text in one go then the escape
+			json.Append(line + plain, i - plain);
+			plain = i + 1;
+			if (c == '"' || c == '\\')
+			{
+				json.Append('\\').Append((char)c);
+			}
+			else if (c == '\n')
+			{
+				// One line per record as before
+				json.Append("\\t", 2);
+			}
+			else
+			{
+				// Bytes from binary or broken UTF-8 would make the JSON invalid
+				json.Append("\\u00", 4).AppendHex(&c, 1, '\0');
+			}
+		}
+		json.Append(line + plain, n - plain).Append('"');
+		next = record.seq + 1; }, next);
+	if (!more)
+		next = log.NextSeq();
+	if (json.Length() + 80 >= LOG_API_CHUNK)
 	{
-		html += (Replace(ReplaceNewlineWithTab(entry), "<", "&lt;") + "\n");
+		pServer->sendContent(json.c_str(), json.Length());
+		json.Clear();
 	}
-	html += "</pre></html>";
-	_wifiManager.server->send(200, "text/html", html.c_str());
+	json.Append("],\"next\":").AppendUnsigned(next).Append(",\"evicted\":").AppendUnsigned(evicted);
+	json.Append(",\"more\":").Append(more ? "true}" : "false}");
+	pServer->sendContent(json.c_str(), json.Length());
+	pServer->sendContent("");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Display the log files kept on flash. Sent in pieces as the files
+/// .. can be larger than the free heap wants
+void WebPortal::HtmlSavedLog() const
+{
+	Logf("Show saved log");
+	_logStore.Flush();
+	WebServer *pServer = _wifiManager.server.get();
+	pServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+	pServer->send(200, "text/html", "<html><head></head><h3>Saved log</h3><pre>");
+	_logStore.ReadSegments([pServer](const char *pText, int length)
+						   {
+							// Worst case every character is a '<'
+							static FixedText<LOG_READ_CHUNK * 4 + 1> chunk;
+							chunk.Clear();
+							for (int n = 0; n < length; n++)
+							{
+								if (pText[n] == '<')
+									chunk.Append("&lt;", 4);
+								else
+									chunk.Append(pText[n]);
+							}
+							pServer->sendContent(chunk.c_str(), chunk.Length()); });
+	pServer->sendContent("</pre></html>");
+	pServer->sendContent("");
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -300,7 +506,20 @@ void TableRow(std::string &html, int indent, const std::string &name, const std:
 }
 void TableRow(std::string &html, int indent, const std::string &name, int32_t value)
 {
-	TableRow(html, indent, name, ToThousands(value).c_str(), true);
+	FixedText<TEXT_INTEGER_MAX + 6> text;
+	TableRow(html, indent, name, text.AppendThousands(value).c_str(), true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Counters for one receiver input
+void GpsStatsHtml(const GpsParser &parser, std::string &html)
+{
+	TableRow(html, 1, "Read errors", parser.GetReadErrorCount());
+	TableRow(html, 1, "Max buffer size", parser.GetMaxBufferSize());
+	TableRow(html, 1, "CPU share", StringPrintf("%d.%d%%", parser.GetCpuShare() / 10, parser.GetCpuShare() % 10));
+	TableRow(html, 1, "Message counts", "");
+	for (const auto &pair : parser.GetMsgTypeTotals())
+		TableRow(html, 2, std::to_string(pair.first), pair.second);
 }
 
 void ServerStatsHtml(NTRIPServer &server, std::string &html)
@@ -310,10 +529,71 @@ void ServerStatsHtml(NTRIPServer &server, std::string &html)
 	TableRow(html, 3, "Port", server.GetPort());
 	TableRow(html, 3, "Credential", server.GetCredential());
 	TableRow(html, 3, "Status", server.GetStatus());
+	TableRow(html, 3, "Input", server.GetInput());
 	TableRow(html, 3, "Reconnects", server.GetReconnects());
 	TableRow(html, 3, "Packets sent", server.GetPacketsSent());
-	TableRow(html, 3, "Speed (Mbps)", server.AverageSendTime());
-	TableRow(html, 3, "Max send (us)", server.GetMaxSendTime());
+	const SendStats &stats = server.GetSendStats();
+	TableRow(html, 3, "Write p50 (us)", stats.Percentile(50));
+	TableRow(html, 3, "Write p90 (us)", stats.Percentile(90));
+	TableRow(html, 3, "Write p99 (us)", stats.Percentile(99));
+	TableRow(html, 3, "Max write (us)", stats.Max());
+	TableRow(html, 3, "Write speed (KB/s)", stats.WriteSpeed());
+	TableRow(html, 3, "Throughput (B/s)", stats.BytesPerSecond());
+	TableRow(html, 3, "Dropped frames", server.GetDroppedFrames());
+	TableRow(html, 3, "Dropped bytes", server.GetDroppedBytes());
+	TableRow(html, 3, "Correction age (ms)", server.GetCorrectionAge());
+	TableRow(html, 3, "Max age (ms)", server.GetMaxCorrectionAge());
+	TableRow(html, 3, "Queue delay (ms)", server.GetQueueDelay());
+	TableRow(html, 3, "Achieved (B/s)", server.GetAchievedRate());
+	TableRow(html, 3, "DNS lookups", server.GetConnector().GetResolves());
+	TableRow(html, 3, "DNS cache hits", server.GetConnector().GetCacheHits());
+	TableRow(html, 3, "Standby swaps", server.GetStandbySwaps());
+	TableRow(html, 3, "Stall drops", server.GetStallDrops());
+	TableRow(html, 3, "Stall detect (ms)", server.GetStallDetectTime());
+	const CasterGroup &group = server.GetGroup();
+	if (group.GetEndpoints().size() > 1)
+	{
+		TableRow(html, 3, "Failovers", group.GetFailovers());
+		TableRow(html, 3, "Switch latency (ms)", server.GetSwitchLatency());
+		for (int n = 0; n < (int)group.GetEndpoints().size(); n++)
+		{
+			const CasterEndpoint &endpoint = group.GetEndpoints()[n];
+			TableRow(html, 3, StringPrintf("%s%s:%d", n == group.CurrentIndex() ? "* " : "", endpoint.host.c_str(), endpoint.port),
+					 StringPrintf("Score %d, %lus, %d errors", group.Score(n), endpoint.activeTime / 1000, endpoint.errors));
+		}
+	}
+	TableRow(html, 3, "Drop to data (ms)", server.GetFirstByteLatency());
+	TableRow(html, 3, "Max drop to data (ms)", server.GetMaxFirstByteLatency());
+	if (server.IsNtripV2())
+		TableRow(html, 3, "V2 chunks sent", server.GetChunksSent());
+	TableRow(html, 3, "Writes per epoch", StringPrintf("%.2f", server.GetWriteCalls() / (double)max(1, server.GetEpochsSent())));
+	TableRow(html, 3, "V2 copy avoided (B)", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(server.GetCopyAvoided()).c_str());
+	TableRow(html, 3, "Max epoch (B)", server.GetMaxEpochBytes());
+	const MsmReencoder &reencoder = server.GetReencoder();
+	if (reencoder.IsEnabled())
+	{
+		TableRow(html, 3, "Rewrite to MSM (0 = same)", reencoder.GetMsm());
+		TableRow(html, 3, "Signals kept (0 = all)", reencoder.GetSignals());
+		TableRow(html, 3, "Rewritten frames", (int32_t)reencoder.GetFrames());
+		TableRow(html, 3, "Rewrite saved (B)", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(reencoder.GetBytesSaved()).c_str());
+		TableRow(html, 3, "Rewrite saved (%)", reencoder.GetBytesIn() == 0 ? 0 : (int32_t)(reencoder.GetBytesSaved() * 100 / reencoder.GetBytesIn()));
+		TableRow(html, 3, "Rewrite (us/epoch)", (int32_t)reencoder.GetEpochMicros());
+		TableRow(html, 3, "Max rewrite (us/epoch)", (int32_t)reencoder.GetMaxEpochMicros());
+	}
+	TableRow(html, 3, "Partial writes", server.GetPartialWrites());
+	TableRow(html, 3, "Blocked writes", server.GetBlockedWrites());
+	if (server.IsTls())
+	{
+		TableRow(html, 3, "TLS check", server.IsTlsCaChecked() ? "CA certificate" : "Pinned fingerprint");
+		TableRow(html, 3, "TLS rejects", server.GetTlsRejects());
+		TableRow(html, 3, "TLS write (ns/B)", server.GetTlsWriteNsPerByte());
+	}
+	if (server.GetBucket().IsEnabled())
+	{
+		TableRow(html, 3, "Shaped rate (B/s)", server.GetBucket().GetRate());
+		TableRow(html, 3, "Throttled (ms)", server.GetThrottleTime());
+		TableRow(html, 3, "Deferred evicted", server.GetDeferredEvicted());
+	}
 	html += "</td></Table>";
 }
 
@@ -333,9 +613,18 @@ void WebPortal::IndexHtml()
 	html += "<li><a href='/info?'>Device info</a></li>";
 	html += "<li><a href='/log'>System log</a></li>";
 	html += "<li><a href='/gpslog'>GPS log</a></li>";
+#ifdef GPS2_SERIAL
+	html += "<li><a href='/gps2log'>GPS 2 log</a></li>";
+#endif
 	html += "<li><a href='/caster1log'>Caster 1 log</a></li>";
 	html += "<li><a href='/caster2log'>Caster 2 log</a></li>";
 	html += "<li><a href='/caster3log'>Caster 3 log</a></li>";
+	html += "<li><a href='/localcasterlog'>Local caster log</a></li>";
+	html += "<li><a href='/rawserverlog'>Raw server log</a></li>";
+	html += "<li><a href='/udplog'>UDP sender log</a></li>";
+	html += "<li><a href='/upstreamlog'>Upstream log</a></li>";
+	html += "<li><a href='/failoverlog'>Receiver failover log</a></li>";
+	html += "<li><a href='/savedlog'>Saved log (Survives restart)</a></li>";
 	html += "<li><a href='/castergraph'>Caster graph</a></li>";
 	html += "<li><a href='/Confirm_Reset'>Reset GPS or WIFI/Config</a></li>";
 	html += "</ul>";
@@ -397,18 +686,33 @@ void WebPortal::ShowStatusHtml()
 	TableRow(html, 1, "Device type", _gpsParser.GetCommandQueue().GetDeviceType());
 	TableRow(html, 1, "Device firmware", _gpsParser.GetCommandQueue().GetDeviceFirmware());
 	TableRow(html, 1, "Device serial #", _gpsParser.GetCommandQueue().GetDeviceSerial());
+	if (_ntripInput.IsEnabled())
+	{
+		TableRow(html, 1, "Upstream", StringPrintf("%s /%s", _ntripInput.GetHost().c_str(), _ntripInput.GetMount().c_str()));
+		TableRow(html, 2, "Status", _ntripInput.GetStatus());
+		TableRow(html, 2, "Reconnects", _ntripInput.GetReconnects());
+		TableRow(html, 2, "Received (B)", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(_ntripInput.GetBytesReceived()).c_str());
+		TableRow(html, 2, "Data age (ms)", (int32_t)_ntripInput.GetDataAge());
+		TableRow(html, 2, "Max gap (ms)", (int32_t)_ntripInput.GetMaxGap());
+		TableRow(html, 2, "DNS lookups", _ntripInput.GetConnector().GetResolves());
+	}
 
 	int32_t resetCount, reinitialize, messageCount;
 	//// _display.GetGpsStats(resetCount, reinitialize, messageCount);
 	TableRow(html, 1, "Reset count", resetCount);
 	TableRow(html, 1, "Reinitialize count", reinitialize);
-	TableRow(html, 1, "Read errors", _gpsParser.GetReadErrorCount());
-	TableRow(html, 1, "Max buffer size", _gpsParser.GetMaxBufferSize());
-
-	TableRow(html, 0, "Message counts", "");
-	for (const auto &pair : _gpsParser.GetMsgTypeTotals())
-		TableRow(html, 1, std::to_string(pair.first), pair.second);
+	GpsStatsHtml(_gpsParser, html);
 	TableRow(html, 1, "Total messages", messageCount);
+#ifdef GPS2_SERIAL
+	if (_gpsParser2.HasServers())
+	{
+		TableRow(html, 0, "GPS 2", "");
+		TableRow(html, 1, "Device type", _gpsParser2.GetCommandQueue().GetDeviceType());
+		TableRow(html, 1, "Device firmware", _gpsParser2.GetCommandQueue().GetDeviceFirmware());
+		TableRow(html, 1, "Device serial #", _gpsParser2.GetCommandQueue().GetDeviceSerial());
+		GpsStatsHtml(_gpsParser2, html);
+	}
+#endif
 	html += "</table>";
 
 
@@ -418,6 +722,122 @@ void WebPortal::ShowStatusHtml()
 	ServerStatsHtml(_ntripServer2, html);
 	html += "</tr></Table>";
 
+	// Rovers on the local caster
+	if (_localCaster.IsEnabled())
+	{
+		html += "<table class='striped'>";
+		TableRow(html, 0, "Local caster", StringPrintf("%d /%s", _localCaster.GetPort(), _localCaster.GetMount().c_str()));
+		TableRow(html, 1, "Rovers", (int32_t)_localCaster.GetRovers().size());
+		TableRow(html, 1, "Rovers served", _localCaster.GetRoversServed());
+		TableRow(html, 1, "Refused", _localCaster.GetRejected());
+		TableRow(html, 1, "Source tables", _localCaster.GetSourceTables());
+		for (const auto &pRover : _localCaster.GetRovers())
+		{
+			TableRow(html, 1, pRover->address, pRover->streaming ? (pRover->ntripV2 ? "NTRIP v2" : "NTRIP v1") : "Request");
+			TableRow(html, 2, "Connected (s)", (int32_t)((millis() - pRover->connectTime) / 1000));
+			TableRow(html, 2, "Lag (ms)", (int32_t)pRover->lag);
+			TableRow(html, 2, "Dropped frames", pRover->writer.GetDrops());
+			TableRow(html, 2, "Sent (B)", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(pRover->writer.GetBytesSent()).c_str());
+			TableRow(html, 2, "Received (B)", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(pRover->received).c_str());
+		}
+		html += "</table>";
+	}
+
+	// Tools on the raw RTCM port
+	if (_rawServer.IsEnabled())
+	{
+		html += "<table class='striped'>";
+		TableRow(html, 0, "Raw RTCM server", _rawServer.GetPort());
+		TableRow(html, 1, "Clients", (int32_t)_rawServer.GetClients().size());
+		TableRow(html, 1, "Clients served", _rawServer.GetClientsServed());
+		TableRow(html, 1, "Slow drops", _rawServer.GetSlowDrops());
+		for (const auto &pClient : _rawServer.GetClients())
+		{
+			TableRow(html, 1, pClient->address, "");
+			TableRow(html, 2, "Connected (s)", (int32_t)((millis() - pClient->connectTime) / 1000));
+			TableRow(html, 2, "Lag (ms)", (int32_t)pClient->writer.Lag(_gpsParser.GetFrameRing()));
+			TableRow(html, 2, "Backlog (frames)", (int32_t)pClient->writer.Backlog(_gpsParser.GetFrameRing()));
+			TableRow(html, 2, "Dropped frames", pClient->writer.GetDrops());
+			TableRow(html, 2, "Sent (B)", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(pClient->writer.GetBytesSent()).c_str());
+		}
+		html += "</table>";
+	}
+
+	// UDP distribution
+	if (_udpSender.IsEnabled())
+	{
+		html += "<table class='striped'>";
+		TableRow(html, 0, "UDP sender", StringPrintf("%s:%d", _udpSender.GetAddress().c_str(), _udpSender.GetPort()));
+		TableRow(html, 1, "Datagrams", (int32_t)_udpSender.GetDatagrams());
+		TableRow(html, 1, "Datagrams/s", _udpSender.GetDatagramRate());
+		TableRow(html, 1, "Bytes/s", _udpSender.GetByteRate());
+		TableRow(html, 1, "Sent (B)", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(_udpSender.GetBytesSent()).c_str());
+		TableRow(html, 1, "Send errors", _udpSender.GetSendErrors());
+		TableRow(html, 1, "Dropped frames", _udpSender.GetDroppedFrames());
+		html += "</table>";
+	}
+
+	// Hot standby receiver
+	if (_failover.IsEnabled())
+	{
+		html += "<table class='striped'>";
+		TableRow(html, 0, "Receiver failover", _failover.GetStatus());
+		TableRow(html, 1, "Epoch interval (ms)", (int32_t)_failover.GetEpochInterval());
+		TableRow(html, 1, "Primary epochs", _failover.GetPrimaryEpochs());
+		TableRow(html, 1, "Switches", _failover.GetSwitches());
+		TableRow(html, 1, "Returns", _failover.GetReturns());
+		TableRow(html, 1, "Switch gap (ms)", (int32_t)_failover.GetSwitchLatency());
+		TableRow(html, 1, "Max switch gap (ms)", (int32_t)_failover.GetMaxSwitchLatency());
+		TableRow(html, 1, "Time on standby", Uptime(_failover.GetTimeOnStandby()));
+		TableRow(html, 1, "Standby frames", _failover.GetStandbyFrames());
+		TableRow(html, 1, "Held primary frames", _failover.GetHeldFrames());
+		TableRow(html, 1, "Unfinished epoch frames dropped", _failover.GetDroppedPartial());
+		TableRow(html, 1, "Epochs too big to hold", _failover.GetHoldOverflows());
+		html += "</table>";
+	}
+
+	// Log shipping
+	if (_syslog.IsEnabled())
+	{
+		html += "<table class='striped'>";
+		TableRow(html, 0, "Syslog", StringPrintf("%s:%d", _syslog.GetAddress().c_str(), _syslog.GetPort()));
+		TableRow(html, 1, "Datagrams", (int32_t)_syslog.GetDatagrams());
+		TableRow(html, 1, "Records sent", (int32_t)_syslog.GetRecordsSent());
+		TableRow(html, 1, "Bytes sent", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(_syslog.GetBytesSent()).c_str());
+		TableRow(html, 1, "Waiting", _syslog.GetBacklog());
+		TableRow(html, 1, "Lost (Collector too slow)", (int32_t)_syslog.GetLost());
+		TableRow(html, 1, "Send errors", _syslog.GetSendErrors());
+		html += "</table>";
+	}
+
+	// Log use and the message codes seen
+	html += "<table class='striped'>";
+	TableRow(html, 0, "Log", "");
+	TableRow(html, 1, "Messages held", GetLog().Count());
+	TableRow(html, 1, "Messages dropped for room", (int32_t)GetLog().Evicted());
+	TableRow(html, 1, "Messages lost (Ingest full)", (int32_t)GetLogIngestDropped());
+	if (_logStore.IsEnabled())
+	{
+		TableRow(html, 1, "Saved to", StringPrintf("%s (%u bytes)", LogStore::SegmentPath(_logStore.GetSegment()).c_str(), _logStore.GetSegmentBytes()));
+		TableRow(html, 1, "Flash bytes written", (int32_t)_logStore.GetBytesWritten());
+		TableRow(html, 1, "Flash bytes per hour", (int32_t)_logStore.GetBytesPerHour());
+		TableRow(html, 1, "Flash writes", (int32_t)_logStore.GetWrites());
+		TableRow(html, 1, "Not saved (Too old)", (int32_t)_logStore.GetLost());
+		TableRow(html, 1, "Failed writes", (int32_t)_logStore.GetFailures());
+		TableRow(html, 1, "Worst batch render on loop (us)", (int32_t)_logStore.GetWorstRender());
+		TableRow(html, 1, "Worst flash write on writer (us)", (int32_t)_logStore.GetWorstWrite());
+	}
+	const LogLimiter &limiter = GetLogLimiter();
+	for (int n = 0; n < limiter.Count(); n++)
+	{
+		const LogCodeStats &stats = limiter.Get(n);
+		TableRow(html, 1, StringPrintf("%s %s", stats.code, LogSourceName(stats.source)),
+				 StringPrintf("%u (%u suppressed)", stats.count, stats.suppressed));
+	}
+	if (limiter.GetUntracked() > 0)
+		TableRow(html, 1, "Codes not tracked", (int32_t)limiter.GetUntracked());
+	html += "</table>";
+
 		// Memory stuff
 	html += "<table class='striped'>";
 	auto free = ESP.getFreeHeap();
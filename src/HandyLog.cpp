@@ -1,101 +1,190 @@
 #include "HandyLog.h"
 #include <HandyString.h>
 #include <Global.h>
-// #include "freertos/semphr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
-std::string AddToLog(const char *msg);
+// Messages from any task waiting to be moved to the log
+static LogIngest<LOG_INGEST_SIZE> _ingest;
 
-std::vector<std::string> _mainLog;
+// Every log message from every source. Only touched by the consumer task
+static LogRing<LOG_ARENA_SIZE> _log;
 
-// static SemaphoreHandle_t _serialMutex;
+// Counts of the coded messages. Only touched by the consumer task
+static LogLimiter _limiter;
+
+// Task that drains the messages (The Arduino loop)
+static TaskHandle_t _consumerTask = nullptr;
+static bool _draining = false;
+
+static bool LogAllowed(LogSource source, const char *text, unsigned long now);
 
 //////////////////////////////////////////////////////////////////////////
-// Setup the logging stuff
+// Setup the logging stuff. Called from the task that will read the log
 void SetupLog()
 {
-	//	_serialMutex = xSemaphoreCreateMutex();
-	//	if (_serialMutex == NULL)
-	{
-		perror("Failed to create serial mutex\n");
-	}
+	_consumerTask = xTaskGetCurrentTaskHandle();
+}
+
+////////////////////////////////////////////////////////////////////////////
+// The log for the web pages to read
+const LogRing<LOG_ARENA_SIZE> &GetLog()
+{
+	return _log;
 }
 
 ////////////////////////////////////////////////////////////////////////////
-// Get a copy of the main log safely
-const std::vector<std::string> CopyMainLog()
+// The message counts for the status page
+const LogLimiter &GetLogLimiter()
 {
-	std::vector<std::string> copyVector;
-	//	if (xSemaphoreTake(_serialMutex, portMAX_DELAY))
+	return _limiter;
+}
+
+// Name and URL key of each source
+static const char *_sourceNames[] = {"System", "GPS", "GPS 2", "Caster 1", "Caster 2", "Caster 3",
+									 "Local caster", "Raw server", "UDP sender", "Failover", "Upstream"};
+static const char *_sourceKeys[] = {"system", "gps", "gps2", "caster1", "caster2", "caster3",
+									"localcaster", "rawserver", "udp", "failover", "upstream"};
+
+////////////////////////////////////////////////////////////////////////////
+// Name of a source for the status page
+const char *LogSourceName(uint8_t source)
+{
+	return source < sizeof(_sourceNames) / sizeof(_sourceNames[0]) ? _sourceNames[source] : "?";
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Source from the key used in the log URLs
+// @return LOG_ALL for "all" or an unknown key
+uint8_t LogSourceFromKey(const char *key)
+{
+	for (uint8_t source = 0; source < sizeof(_sourceKeys) / sizeof(_sourceKeys[0]); source++)
 	{
-		copyVector.insert(copyVector.end(), _mainLog.begin(), _mainLog.end());
-		//		xSemaphoreGive(_serialMutex);
+		if (strcmp(key, _sourceKeys[source]) == 0)
+			return source;
 	}
-	return copyVector;
+	return LOG_ALL;
 }
 
 const std::string Uptime(unsigned long millis)
 {
-	uint32_t t = millis / 1000;
-	std::string uptime = StringPrintf(":%02d.%03d", t % 60, millis % 1000);
-	t /= 60;
-	uptime = StringPrintf(":%02d", t % 60) + uptime;
-	t /= 60;
-	uptime = StringPrintf("%02d", t % 24) + uptime;
-	t /= 24;
-	uptime = StringPrintf("%d ", t) + uptime;
-	return uptime;
+	char text[TEXT_UPTIME_MAX];
+	return std::string(text, FormatUptime(text, sizeof(text), millis));
 }
 
-std::string Logln(const char *msg)
+////////////////////////////////////////////////////////////////////////////
+// Add a text message to the log. The uptime is added when it is shown.
+// .. Safe from any task
+// @param source Which log page shows the message
+void Logln(const char *msg, LogSource source)
 {
-	std::string s;
-	//	if (xSemaphoreTake(_serialMutex, portMAX_DELAY))
-	{
-		s = AddToLog(msg);
-		if (SERIAL_LOG)
-		{
-			// perror(s.c_str());
-			Serial.print(s.c_str());
-			Serial.print("\r\n");
-		}
-		//		xSemaphoreGive(_serialMutex);
-	}
-	return s;
+	int length = min(LOG_RECORD_MAX, (int)strlen(msg));
+	byte *pPayload = _ingest.Reserve(source, LOG_KIND_TEXT, length);
+	if (pPayload == nullptr)
+		return;
+	memcpy(pPayload, msg, length);
+	pPayload[length] = '\0';
+	LogCommit(pPayload);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Trim the log to the size limit
-const void TruncateLog(std::vector<std::string> &log)
+////////////////////////////////////////////////////////////////////////////
+// Make room for a format record. Safe from any task
+// @param length Bytes for the format address and the arguments
+// @return nullptr if the message has to be dropped
+byte *LogReserve(LogSource source, int length)
 {
-	// Truncate based on total log size
-	while (log.size() > MAX_LOG_LENGTH)
-		log.erase(log.begin());
+	return _ingest.Reserve(source, LOG_KIND_FORMAT, length);
+}
 
-	// Truncate based on total size
-	while (true)
-	{
-		int total = 0;
-		for (std::string line : log)
-			total += line.length();
-		if (total < MAX_LOG_SIZE)
-			break;
-		log.erase(log.begin());
-	}
+////////////////////////////////////////////////////////////////////////////
+// Hand a written message to the consumer. Messages from the consumer task
+// .. itself are moved straight away so the log stays in step with the code
+void LogCommit(byte *pPayload)
+{
+	LogIngest<LOG_INGEST_SIZE>::Commit(pPayload);
+	if (xTaskGetCurrentTaskHandle() == _consumerTask)
+		LogDrain();
 }
 
-std::string AddToLog(const char *msg)
+////////////////////////////////////////////////////////////////////////////
+// Messages lost because the ingest ring was full
+uint32_t GetLogIngestDropped()
 {
-	std::string s = StringPrintf("%s %s", Uptime(millis()).c_str(), msg);
+	return _ingest.Dropped();
+}
 
-	if (_mainLog.capacity() < MAX_LOG_LENGTH)
-		_mainLog.reserve(MAX_LOG_LENGTH);
+////////////////////////////////////////////////////////////////////////////
+// Copy the newest record to the serial port
+static void LogEcho()
+{
+	static char line[LOG_LINE_MAX];
+	LogRender(_log.Last(), line, sizeof(line));
+	Serial.print(line);
+	Serial.print("\r\n");
+}
 
-	// Remove the oldest while too long
-	while (_mainLog.size() > MAX_LOG_LENGTH)
-		_mainLog.erase(_mainLog.begin());
+////////////////////////////////////////////////////////////////////////////
+// Move the waiting messages into the log, applying the code limits and
+// .. echoing to the serial port. Only called by the consumer task
+void LogDrain()
+{
+	// Summaries logged while draining are picked up by the same pass
+	if (_draining)
+		return;
+	_draining = true;
+	_ingest.Drain([](const LogSlot &slot)
+				  {
+		const char *pText = (const char *)slot.Payload();
+		if (slot.kind == LOG_KIND_FORMAT)
+			memcpy(&pText, slot.Payload(), sizeof(pText));
+		if (!LogAllowed((LogSource)slot.source, pText, slot.time))
+			return;
+		byte *pPayload = _log.Reserve((LogSource)slot.source, slot.kind, slot.length, slot.time);
+		memcpy(pPayload, slot.Payload(), slot.length);
+		pPayload[slot.length] = '\0';
+		if (SERIAL_LOG)
+			LogEcho(); });
+	_draining = false;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Log how many messages of a code were held back in the window
+static void LogSummary(const LogCodeStats &stats)
+{
+	if (stats.windowSuppressed > 0)
+		Logf((LogSource)stats.source, "%s suppressed %u times in %lus", stats.code, stats.windowSuppressed, (millis() - stats.windowStart) / 1000);
+}
 
-	// Add everything except the last CR and LF
+////////////////////////////////////////////////////////////////////////////
+// Count a message if it has a code
+// @param text Message or format string
+// @param now Millis when the message was logged
+// @return false if the code has been logged too often and the message should be dropped
+static bool LogAllowed(LogSource source, const char *text, unsigned long now)
+{
+	LogCodeStats *pStats = _limiter.Find(source, text, now);
+	if (pStats == nullptr)
+		return true;
+	if (LogLimiter::IsWindowOver(*pStats, now))
+	{
+		LogSummary(*pStats);
+		LogLimiter::Restart(*pStats, now);
+	}
+	return LogLimiter::Take(*pStats);
+}
 
-	_mainLog.push_back(s);
-	return s;
+////////////////////////////////////////////////////////////////////////////
+// Called every second to log the summary of any code that has gone quiet
+void LogFlushSuppressed()
+{
+	unsigned long now = millis();
+	for (int n = 0; n < _limiter.Count(); n++)
+	{
+		LogCodeStats &stats = _limiter.Get(n);
+		if (stats.windowSuppressed > 0 && LogLimiter::IsWindowOver(stats, now))
+		{
+			LogSummary(stats);
+			LogLimiter::Restart(stats, now);
+		}
+	}
 }
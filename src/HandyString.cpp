@@ -35,33 +35,16 @@ bool StartsWith(const char *szA, const char *szB)
 /// @return 1,234,567
 std::string ToThousands(int number)
 {
-	std::string value = std::to_string(number);
-	int len = value.length();
-	int dlen = 3;
-
-	while (len > dlen)
-	{
-		value.insert(len - dlen, 1, ',');
-		dlen += 4;
-		len += 1;
-	}
-	return value;
-
-	// std::stringstream ss;
-	// ss.imbue(std::locale("en_US.UTF-8"));
-	//	 ss << std::fixed << number;
-	// return ss.str();
+	char text[TEXT_INTEGER_MAX + 6];
+	return std::string(text, FormatThousands(text, sizeof(text), number));
 }
 
 ///////////////////////////////////////////////////////////////////////////
 /// @brief Convert a array of bytes to string of hex numbers
 std::string HexDump( const unsigned char *data, int len )
 {
-	std::string hex;
-	for (int n = 0; n < len; n++)
-	{
-		hex += StringPrintf("%02x ", data[n]);
-	}
+	std::string hex(max(len, 0) * 3, '\0');
+	FormatHex(&hex[0], hex.length() + 1, data, len);
 	return hex;
 }
 
@@ -90,7 +73,7 @@ std::string HexAsciDump(const unsigned char* data, int len)
 
 		// Add the hex value to szText as position 3 * n
 		auto offset = 3 * index;
-		snprintf(szText + offset, 3, "%02x", data[n]);
+		FormatHex(szText + offset, 3, &data[n], 1, '\0');
 		szText[offset + 2] = ' ';
 		szText[3 * 16 + 1 + index] = data[n] < 0x20 ? 0xfa : data[n];
 	}
@@ -237,3 +220,56 @@ void ReplaceCrLfEncode(std::string &str)
 }
     
 
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Base64 encode a string. Used for HTTP basic authentication
+std::string Base64Encode(const std::string &text)
+{
+	static const char *table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string result;
+	result.reserve((text.length() + 2) / 3 * 4);
+	size_t n = 0;
+	for (; n + 2 < text.length(); n += 3)
+	{
+		uint32_t v = ((uint8_t)text[n] << 16) | ((uint8_t)text[n + 1] << 8) | (uint8_t)text[n + 2];
+		result += table[(v >> 18) & 0x3F];
+		result += table[(v >> 12) & 0x3F];
+		result += table[(v >> 6) & 0x3F];
+		result += table[v & 0x3F];
+	}
+	if (n < text.length())
+	{
+		uint32_t v = (uint8_t)text[n] << 16;
+		if (n + 1 < text.length())
+			v |= (uint8_t)text[n + 1] << 8;
+		result += table[(v >> 18) & 0x3F];
+		result += table[(v >> 12) & 0x3F];
+		result += (n + 1 < text.length()) ? table[(v >> 6) & 0x3F] : '=';
+		result += '=';
+	}
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Find a value in a space separated list of key=value pairs
+/// @param options Like "maxage=5000 rate=2000"
+/// @param key Name of the option
+/// @param defaultValue Returned if the option is not present
+std::string GetOption(const std::string &options, const std::string &key, const std::string &defaultValue)
+{
+	for (const auto &part : Split(options, " "))
+	{
+		if (part.length() > key.length() && part[key.length()] == '=' && StartsWith(part, key))
+			return part.substr(key.length() + 1);
+	}
+	return defaultValue;
+}
+
+int GetOption(const std::string &options, const std::string &key, int defaultValue)
+{
+	std::string value = GetOption(options, key, "");
+	if (value.empty())
+		return defaultValue;
+	return atoi(value.c_str());
+}
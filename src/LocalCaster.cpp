@@ -0,0 +1,235 @@
+#include "LocalCaster.h"
+
+#include <WiFi.h>
+
+#include "HandyLog.h"
+#include "HandyString.h"
+#include <MyFiles.h>
+
+extern MyFiles _myFiles;
+
+//////////////////////////////////////////////////////////////////////////////
+// Load the configuration if it exists
+void LocalCaster::LoadSettings()
+{
+	if (!_myFiles.ReadFile("/LocalCaster.txt", _sOptions))
+	{
+		LogX(" - Local caster not configured");
+		return;
+	}
+	_port = GetOption(_sOptions, "port", 0);
+	_sMount = GetOption(_sOptions, "mount", LOCAL_CASTER_MOUNT);
+	std::string user = GetOption(_sOptions, "user", "");
+	if (!user.empty())
+		_sAuth = Base64Encode(user + ":" + GetOption(_sOptions, "password", ""));
+	LogX(" - Local caster port %d mount '%s'%s", _port, _sMount.c_str(), _sAuth.empty() ? " (Open)" : "");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Save the setting to the file
+void LocalCaster::Save(const char *options) const
+{
+	_myFiles.WriteFile("/LocalCaster.txt", options);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loop called every pass to take new rovers and send anything new in the ring
+void LocalCaster::Loop(const RtcmFrameRing &ring)
+{
+	if (_port < 1)
+		return;
+
+	// Listen once the network is up
+	if (!_pServer)
+	{
+		_pServer.reset(new WiFiServer(_port, LOCAL_CASTER_MAX_CLIENTS));
+		_pServer->begin();
+		_pServer->setNoDelay(true);
+		LogX("Local caster listening on %d", _port);
+	}
+
+	Accept();
+
+	for (int n = 0; n < (int)_rovers.size(); n++)
+	{
+		LocalRover &rover = *_rovers[n];
+		bool keep = rover.client.connected() && (rover.streaming ? StreamTo(rover, ring) : ReadRequest(rover, ring));
+		if (keep)
+			continue;
+
+		LogX("Rover %s gone after %lus, %llu bytes, %d dropped", rover.address.c_str(),
+						  (millis() - rover.connectTime) / 1000, rover.writer.GetBytesSent(), rover.writer.GetDrops());
+		rover.client.stop();
+		_rovers.erase(_rovers.begin() + n--);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Take any new connection
+void LocalCaster::Accept()
+{
+	WiFiClient client = _pServer->accept();
+	if (!client)
+		return;
+
+	if (_rovers.size() >= LOCAL_CASTER_MAX_CLIENTS)
+	{
+		LogX("E520 - Local caster full. Refused %s", client.remoteIP().toString().c_str());
+		_rejected++;
+		client.stop();
+		return;
+	}
+
+	std::unique_ptr<LocalRover> pRover(new LocalRover());
+	pRover->client = client;
+	pRover->address = client.remoteIP().toString().c_str();
+	pRover->connectTime = millis();
+	pRover->progressTime = millis();
+	pRover->client.setNoDelay(true);
+
+	// Writes to rovers must never hold up the main loop
+	int fd = pRover->client.fd();
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	_rovers.push_back(std::move(pRover));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Collect the request header and answer it once complete. Typical requests
+//		GET /RTK HTTP/1.0				(NTRIP v1)
+//		GET /RTK HTTP/1.1				(NTRIP v2 with Ntrip-Version: Ntrip/2.0)
+//		GET / HTTP/1.0					(Source table)
+// @return false if the rover should be dropped
+bool LocalCaster::ReadRequest(LocalRover &rover, const RtcmFrameRing &ring)
+{
+	int count = rover.client.read((uint8_t *)rover.request + rover.requestLength, LOCAL_CASTER_REQUEST_MAX - rover.requestLength);
+	if (count > 0)
+	{
+		rover.requestLength += count;
+		rover.request[rover.requestLength] = '\0';
+	}
+
+	if (strstr(rover.request, "\r\n\r\n") == nullptr)
+	{
+		if (rover.requestLength >= LOCAL_CASTER_REQUEST_MAX || (millis() - rover.connectTime) > LOCAL_CASTER_REQUEST_TIMEOUT)
+		{
+			LogX("E521 - Rover %s incomplete request", rover.address.c_str());
+			_rejected++;
+			return false;
+		}
+		return true;
+	}
+
+	// Mount point from the request line
+	std::string mount;
+	if (strncmp(rover.request, "GET /", 5) == 0)
+	{
+		const char *pStart = rover.request + 5;
+		const char *pEnd = strpbrk(pStart, " \r");
+		mount = std::string(pStart, pEnd == nullptr ? strlen(pStart) : pEnd - pStart);
+	}
+	rover.ntripV2 = HeaderValue(rover.request, "Ntrip-Version").find("2.0") != std::string::npos;
+
+	if (mount != _sMount)
+	{
+		SendSourceTable(rover);
+		return false;
+	}
+
+	// Credentials
+	std::string auth = HeaderValue(rover.request, "Authorization");
+	if (!_sAuth.empty() && auth != "Basic " + _sAuth)
+	{
+		LogX("E522 - Rover %s bad credentials", rover.address.c_str());
+		_rejected++;
+		if (rover.ntripV2)
+			rover.client.print(StringPrintf("HTTP/1.1 401 Unauthorized\r\nNtrip-Version: Ntrip/2.0\r\nWWW-Authenticate: Basic realm=\"/%s\"\r\nConnection: close\r\n\r\n", _sMount.c_str()).c_str());
+		else
+			rover.client.print("ERROR - Bad Password\r\n");
+		return false;
+	}
+
+	// Accepted. The v2 stream is not chunked and ends when the connection closes
+	if (rover.ntripV2)
+		rover.client.print("HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nServer: NTRIP ESP32_T_Display_SX\r\nCache-Control: no-store, no-cache, max-age=0\r\nPragma: no-cache\r\nConnection: close\r\nContent-Type: gnss/data\r\n\r\n");
+	else
+		rover.client.print("ICY 200 OK\r\n\r\n");
+
+	LogX("Rover %s streaming /%s (NTRIP v%d)", rover.address.c_str(), mount.c_str(), rover.ntripV2 ? 2 : 1);
+	rover.streaming = true;
+	rover.writer.Start(ring);
+	rover.progressTime = millis();
+	_roversServed++;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Reply with the one mount point we serve
+void LocalCaster::SendSourceTable(LocalRover &rover)
+{
+	std::string table = StringPrintf("STR;%s;%s;RTCM 3.3;;2;GPS+GLO+GAL+BDS;NONE;XXX;0.00;0.00;0;0;ESP32_T_Display_SX;none;%s;N;0;\r\nENDSOURCETABLE\r\n",
+									 _sMount.c_str(), _sMount.c_str(), _sAuth.empty() ? "N" : "B");
+	std::string reply;
+	if (rover.ntripV2)
+		reply = StringPrintf("HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nServer: NTRIP ESP32_T_Display_SX\r\nContent-Type: gnss/sourcetable\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", (int)table.length());
+	else
+		reply = StringPrintf("SOURCETABLE 200 OK\r\nServer: NTRIP ESP32_T_Display_SX\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n\r\n", (int)table.length());
+	reply += table;
+	rover.client.write((const uint8_t *)reply.c_str(), reply.length());
+	_sourceTables++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send the rover whatever its socket will take straight from the ring
+// @return false if the rover should be dropped
+bool LocalCaster::StreamTo(LocalRover &rover, const RtcmFrameRing &ring)
+{
+	// Rovers send GGA for VRS casters. Nothing to do with it here but unread
+	// .. it would sit in lwip buffers the other sockets need
+	byte buffer[64];
+	int count;
+	while (rover.client.available() > 0 && (count = rover.client.read(buffer, sizeof(buffer))) > 0)
+		rover.received += count;
+
+	rover.lag = rover.writer.Lag(ring);
+	int sent = rover.writer.Write(rover.client.fd(), ring);
+	if (sent == RING_WRITE_FAILED)
+		return false;
+	if (sent != RING_WRITE_BLOCKED || rover.writer.Backlog(ring) == 0)
+	{
+		rover.progressTime = millis();
+		return true;
+	}
+	if ((millis() - rover.progressTime) > LOCAL_CASTER_STALL_TIMEOUT)
+	{
+		LogX("E523 - Rover %s stopped taking data", rover.address.c_str());
+		return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Find a header in the request (Case insensitive name)
+// @return The value or empty if not found
+std::string LocalCaster::HeaderValue(const char *request, const char *name)
+{
+	int nameLength = strlen(name);
+	for (const char *pLine = strstr(request, "\r\n"); pLine != nullptr; pLine = strstr(pLine, "\r\n"))
+	{
+		pLine += 2;
+		if (strncasecmp(pLine, name, nameLength) != 0 || pLine[nameLength] != ':')
+			continue;
+		const char *pValue = pLine + nameLength + 1;
+		while (*pValue == ' ')
+			pValue++;
+		const char *pEnd = strstr(pValue, "\r\n");
+		return std::string(pValue, pEnd == nullptr ? strlen(pValue) : pEnd - pValue);
+	}
+	return "";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write to the log tagged so the page for this local caster can find it
+void LocalCaster::LogX(std::string text)
+{
+	Logln(text.c_str(), LOG_LOCAL_CASTER);
+}
@@ -0,0 +1,243 @@
+#include "LogFormat.h"
+#include "TextBuilder.h"
+
+#include <stdarg.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads the packed arguments of a record in order
+class LogArgReader
+{
+public:
+	LogArgReader(const byte *p, const byte *pEnd) : _p(p), _pEnd(pEnd) {}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Move to the next argument
+	// @return false if there are no more
+	bool Next()
+	{
+		if (_p + 3 > _pEnd)
+			return false;
+		_type = _p[0];
+		if (_type == LOG_ARG_STRING || _type == LOG_ARG_HEX)
+		{
+			uint16_t length;
+			memcpy(&length, _p + 1, 2);
+			_pValue = _p + 3;
+			_size = min((int)length, (int)(_pEnd - _pValue));
+		}
+		else
+		{
+			_pValue = _p + 2;
+			_size = min((int)_p[1], (int)(_pEnd - _pValue));
+		}
+		_p = _pValue + _size;
+		return true;
+	}
+
+	inline byte Type() const { return _type; }
+	inline int Size() const { return _size; }
+	inline const char *Text() const { return (const char *)_pValue; }
+
+	// Integer with the sign of the argument extended
+	int64_t Signed() const
+	{
+		uint64_t value = Unsigned();
+		if (_size > 0 && _size < 8 && (value >> (_size * 8 - 1)) & 1)
+			value |= ~0ULL << (_size * 8);
+		return (int64_t)value;
+	}
+
+	// Integer cut to the size of the argument (Little endian like the ESP32)
+	uint64_t Unsigned() const
+	{
+		uint64_t value = 0;
+		memcpy(&value, _pValue, min(_size, 8));
+		return value;
+	}
+
+	double Double() const
+	{
+		double value = 0;
+		if (_size == sizeof(value))
+			memcpy(&value, _pValue, sizeof(value));
+		return value;
+	}
+
+	const void *Pointer() const
+	{
+		const void *pValue = nullptr;
+		if (_size == sizeof(pValue))
+			memcpy(&pValue, _pValue, sizeof(pValue));
+		return pValue;
+	}
+
+private:
+	const byte *_p;
+	const byte *_pEnd;
+	const byte *_pValue = nullptr;
+	byte _type = 0;
+	int _size = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Append to a fixed line without overrunning it
+static void Append(char *pOut, int size, int &length, const char *format, ...)
+{
+	if (length >= size - 1)
+		return;
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(pOut + length, size - length, format, args);
+	va_end(args);
+	if (n > 0)
+		length = min(length + n, size - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Format one conversion using the packed argument. The length modifiers of
+// .. the original are dropped as the argument carries its own size
+// @param spec Flags, width and precision from the format
+static void RenderArg(char *pOut, int size, int &length, const char *spec, char conversion, LogArgReader &arg)
+{
+	char format[24];
+	switch (conversion)
+	{
+	case 'd':
+	case 'i':
+		if (arg.Type() != LOG_ARG_INTEGER)
+			break;
+		snprintf(format, sizeof(format), "%%%slld", spec);
+		Append(pOut, size, length, format, (long long)arg.Signed());
+		return;
+
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		if (arg.Type() != LOG_ARG_INTEGER)
+			break;
+		snprintf(format, sizeof(format), "%%%sll%c", spec, conversion);
+		Append(pOut, size, length, format, (unsigned long long)arg.Unsigned());
+		return;
+
+	case 'c':
+		if (arg.Type() != LOG_ARG_INTEGER)
+			break;
+		snprintf(format, sizeof(format), "%%%sc", spec);
+		Append(pOut, size, length, format, (int)arg.Signed());
+		return;
+
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		if (arg.Type() != LOG_ARG_DOUBLE)
+			break;
+		snprintf(format, sizeof(format), "%%%s%c", spec, conversion);
+		Append(pOut, size, length, format, arg.Double());
+		return;
+
+	case 's':
+		if (arg.Type() == LOG_ARG_HEX)
+		{
+			length += FormatHex(pOut + length, size - length, (const byte *)arg.Text(), arg.Size());
+			return;
+		}
+		if (arg.Type() != LOG_ARG_STRING)
+			break;
+		{
+			// The text is not terminated so the precision limits it
+			const char *pDot = strchr(spec, '.');
+			int precision = pDot == nullptr ? arg.Size() : min(atoi(pDot + 1), arg.Size());
+			snprintf(format, sizeof(format), "%%%.*s.*s", pDot == nullptr ? (int)strlen(spec) : (int)(pDot - spec), spec);
+			Append(pOut, size, length, format, precision, arg.Text());
+		}
+		return;
+
+	case 'p':
+		if (arg.Type() != LOG_ARG_POINTER)
+			break;
+		Append(pOut, size, length, "%p", arg.Pointer());
+		return;
+	}
+	Append(pOut, size, length, "?");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Make the text of a record with the uptime in front. Only done when a log
+// .. is viewed so logging itself never formats
+// @return Length of the line
+int LogRender(const LogRecord &record, char *pOut, int size)
+{
+	int length = FormatUptime(pOut, size, record.time);
+	Append(pOut, size, length, " ");
+	if (record.source == LOG_GPS2)
+		Append(pOut, size, length, "GPS2 ");
+
+	if (record.kind == LOG_KIND_TEXT)
+	{
+		Append(pOut, size, length, "%.*s", (int)record.length, (const char *)record.Payload());
+		return length;
+	}
+
+	const char *pFormat;
+	if (record.length < sizeof(pFormat))
+		return length;
+	memcpy(&pFormat, record.Payload(), sizeof(pFormat));
+	LogArgReader args(record.Payload() + sizeof(pFormat), record.Payload() + record.length);
+
+	for (const char *p = pFormat; *p != '\0' && length < size - 1;)
+	{
+		// Copy the plain text up to the next conversion
+		const char *pPercent = strchr(p, '%');
+		if (pPercent == nullptr)
+		{
+			Append(pOut, size, length, "%s", p);
+			break;
+		}
+		Append(pOut, size, length, "%.*s", (int)(pPercent - p), p);
+		p = pPercent + 1;
+		if (*p == '%')
+		{
+			Append(pOut, size, length, "%%");
+			p++;
+			continue;
+		}
+
+		// Flags, width and precision. A '*' takes its value from the arguments
+		char spec[16];
+		int specLength = 0;
+		while (*p != '\0' && strchr("-+ #0123456789.*", *p) != nullptr)
+		{
+			if (*p == '*')
+			{
+				int value = args.Next() ? (int)args.Signed() : 0;
+				specLength += snprintf(spec + specLength, sizeof(spec) - specLength, "%d", value);
+			}
+			else if (specLength < (int)sizeof(spec) - 1)
+			{
+				spec[specLength++] = *p;
+			}
+			specLength = min(specLength, (int)sizeof(spec) - 1);
+			p++;
+		}
+		spec[specLength] = '\0';
+
+		// Skip the length modifiers
+		while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr)
+			p++;
+		if (*p == '\0')
+			break;
+
+		char conversion = *p++;
+		if (args.Next())
+			RenderArg(pOut, size, length, spec, conversion, args);
+		else
+			Append(pOut, size, length, "?");
+	}
+	return length;
+}
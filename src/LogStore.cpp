@@ -0,0 +1,259 @@
+#include "LogStore.h"
+
+#include "FS.h"
+#include "SPIFFS.h"
+#include "HandyLog.h"
+#include "HandyString.h"
+#include "TextBuilder.h"
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Find the files left by earlier boots and start a new one. Called once the
+// .. file system is mounted
+void LogStore::Setup()
+{
+	// Find the files from earlier boots
+	std::vector<uint32_t> segments;
+	fs::File root = SPIFFS.open("/");
+	for (fs::File file = root.openNextFile(); file; file = root.openNextFile())
+	{
+		const char *pName = file.name();
+		if (*pName == '/')
+			pName++;
+		unsigned segment;
+		if (sscanf(pName, "Log%u.txt", &segment) == 1)
+			segments.push_back(segment);
+	}
+
+	// Each boot starts a file so the restart is easy to find. Drop any
+	// .. files too old to keep
+	uint32_t next = 0;
+	for (uint32_t segment : segments)
+		next = max(next, segment + 1);
+	for (uint32_t segment : segments)
+	{
+		if (segment + LOG_SEGMENTS <= next)
+			SPIFFS.remove(SegmentPath(segment).c_str());
+	}
+	_segment = next;
+	_enabled = true;
+	_lastFlush = millis();
+	Logf(" - Log saved to %s", SegmentPath(_segment).c_str());
+
+	// The writer owns the file from here
+	for (int n = 0; n < LOG_BATCHES; n++)
+		_batchLengths[n].store(0, std::memory_order_relaxed);
+	_writerRunning = xTaskCreatePinnedToCore(WriterTask, "LogWriter", LOG_WRITER_STACK, this, LOG_WRITER_PRIORITY, NULL, PRO_CPU_NUM) == pdPASS;
+	if (!_writerRunning)
+		Logf("E571 - No log writer task. Writing from the loop");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Start a flush when enough has built up or it has waited long enough, then
+// .. render one batch per call till it is done. Called from the main loop
+// .. after the data has been moved
+void LogStore::Loop()
+{
+	if (!_enabled)
+		return;
+	if (!_flushing && (GetLog().NextSeq() - _savedSeq >= LOG_FLUSH_RECORDS || (millis() - _lastFlush) >= LOG_FLUSH_INTERVAL))
+	{
+		_flushing = true;
+		_lastFlush = millis();
+	}
+	if (_flushing)
+		_flushing = RenderBatch();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Save every message now and wait for the writer to finish. Called before a
+// .. restart so nothing is lost and before the saved log is shown
+void LogStore::Flush()
+{
+	if (!_enabled)
+		return;
+	_lastFlush = millis();
+	while (RenderBatch() || !IsWriterIdle())
+	{
+		if ((millis() - _lastFlush) >= LOG_FLUSH_WAIT)
+			break;
+		vTaskDelay(1);
+	}
+	_flushing = false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Render the messages not yet saved into the next batch and hand it to the
+// .. writer. Stops when the batch is full so the loop is never held for
+// .. more than one batch
+// @return true if messages are left for the next call
+bool LogStore::RenderBatch()
+{
+	// The writer still has this batch
+	if (_batchLengths[_filling].load(std::memory_order_acquire) != 0)
+		return true;
+
+	unsigned long start = micros();
+	LogDrain();
+	const LogRing<LOG_ARENA_SIZE> &log = GetLog();
+	if (_savedSeq < log.OldestSeq())
+	{
+		_lost += log.OldestSeq() - _savedSeq;
+		_savedSeq = log.OldestSeq();
+	}
+	if (_savedSeq == log.NextSeq())
+		return false;
+
+	// Nothing may be logged until the walk is done as it would change the log
+	TextBuilder batch(_batches[_filling], LOG_BATCH_SIZE);
+	bool full = false;
+	log.ForEach(LOG_ALL, [this, &batch, &full](const LogRecord &record)
+				{
+		if (full || batch.Length() + LOG_LINE_MAX + 2 >= LOG_BATCH_SIZE)
+		{
+			full = true;
+			return;
+		}
+		batch.Append(_line, LogRender(record, _line, sizeof(_line))).Append("\r\n", 2);
+		_savedSeq = record.seq + 1; }, _savedSeq);
+	_worstRender = max(_worstRender, (uint32_t)(micros() - start));
+
+	int filled = _filling;
+	_filling = (_filling + 1) % LOG_BATCHES;
+	_batchLengths[filled].store(batch.Length(), std::memory_order_release);
+	if (!_writerRunning)
+		WriteBatch(filled);
+	return full;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// @return true once every batch handed over has been written
+bool LogStore::IsWriterIdle() const
+{
+	for (int n = 0; n < LOG_BATCHES; n++)
+	{
+		if (_batchLengths[n].load(std::memory_order_acquire) != 0)
+			return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Write the batches in the order they were handed over. Sleeps between
+// .. checks as the log only needs saving every few seconds at most, and
+// .. between appends so a backlog does not stall the cache back to back
+void LogStore::WriterTask(void *param)
+{
+	LogStore *pStore = static_cast<LogStore *>(param);
+	while (true)
+	{
+		if (pStore->_batchLengths[pStore->_writing].load(std::memory_order_acquire) == 0)
+		{
+			vTaskDelay(10 / portTICK_PERIOD_MS);
+			continue;
+		}
+		unsigned long since = millis() - pStore->_lastWrite;
+		if (since < LOG_WRITE_SPACING)
+		{
+			vTaskDelay(max(1UL, (LOG_WRITE_SPACING - since) / portTICK_PERIOD_MS));
+			continue;
+		}
+		pStore->WriteBatch(pStore->_writing);
+		pStore->_lastWrite = millis();
+		pStore->_writing = (pStore->_writing + 1) % LOG_BATCHES;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Append a batch and give it back to the loop
+void LogStore::WriteBatch(int batch)
+{
+	unsigned long start = micros();
+	bool written = Append(_batches[batch], _batchLengths[batch].load(std::memory_order_acquire));
+	uint32_t time = micros() - start;
+	if (time > _worstWrite.load(std::memory_order_relaxed))
+		_worstWrite.store(time, std::memory_order_relaxed);
+	_batchLengths[batch].store(0, std::memory_order_release);
+	if (!written)
+		Logf("E570 - Log file %s write failed", SegmentPath(_segment).c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Add a block of text to the current file. Moves to the next file when full
+// @return false if the write failed
+bool LogStore::Append(const char *pText, int length)
+{
+	fs::File file = SPIFFS.open(SegmentPath(_segment).c_str(), FILE_APPEND);
+	if (!file)
+	{
+		_failures++;
+		return false;
+	}
+	size_t written = file.write((const uint8_t *)pText, length);
+	file.close();
+
+	_writes++;
+	_bytesWritten += written;
+	if ((_segmentBytes += written) >= LOG_SEGMENT_SIZE)
+		NextSegment();
+	if (written == (size_t)length)
+		return true;
+	_failures++;
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Start the next file and delete the oldest
+void LogStore::NextSegment()
+{
+	uint32_t segment = ++_segment;
+	_segmentBytes = 0;
+	if (segment >= LOG_SEGMENTS)
+	{
+		std::string path = SegmentPath(segment - LOG_SEGMENTS);
+		if (SPIFFS.exists(path.c_str()))
+			SPIFFS.remove(path.c_str());
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Pass the text of the kept files to the callback oldest first
+void LogStore::ReadSegments(std::function<void(const char *pText, int length)> callback) const
+{
+	// The writer may move to the next file while this reads
+	uint32_t last = _segment.load(std::memory_order_relaxed);
+	char buffer[LOG_READ_CHUNK];
+	for (uint32_t segment = last >= LOG_SEGMENTS - 1 ? last - (LOG_SEGMENTS - 1) : 0; segment <= last; segment++)
+	{
+		std::string path = SegmentPath(segment);
+		fs::File file = SPIFFS.open(path.c_str(), FILE_READ);
+		if (!file || file.isDirectory())
+			continue;
+		int length = snprintf(buffer, sizeof(buffer), "======== %s ========\r\n", path.c_str());
+		callback(buffer, length);
+		while (file.available())
+		{
+			length = file.read((uint8_t *)buffer, sizeof(buffer));
+			if (length <= 0)
+				break;
+			callback(buffer, length);
+		}
+		file.close();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Average flash written since boot for the wear budget
+uint32_t LogStore::GetBytesPerHour() const
+{
+	return (uint64_t)_bytesWritten.load(std::memory_order_relaxed) * 3600000 / max(millis(), 1UL);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Name of a log file
+std::string LogStore::SegmentPath(uint32_t segment)
+{
+	return StringPrintf("/Log%u.txt", segment);
+}
@@ -1,19 +1,30 @@
 #include "NTRIPServer.h"
 
 #include <WiFi.h>
+#include <lwip/sockets.h>
 
 #include "HandyLog.h"
 #include <GpsParser.h>
 #include <MyFiles.h>
 
-#define SOCKET_RETRY_INTERVAL 30000
+// Longest wait between retries after the caster rejects our credentials
+#define SOCKET_RETRY_MAX (10 * 60000)
+
+// How long the caster has to reply to the SOURCE request
+#define CASTER_RESPONSE_TIMEOUT 10000
+
+// Time between attempts to open a standby connection
+#define CASTER_STANDBY_RETRY 10000
+
+// A connection up this long counts as working. Dropping one of those retries
+// .. at once. A caster that drops us sooner waits the retry interval
+#define CASTER_STABLE_TIME 30000
 
 extern MyFiles _myFiles;
 
 NTRIPServer::NTRIPServer(int index)
 	: _index(index)
 {
-	_sendMicroSeconds.reserve(AVERAGE_SEND_TIMERS);	
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -26,7 +37,7 @@ void NTRIPServer::LoadSettings()
 	std::string llText;
 	if (_myFiles.ReadFile(fileName.c_str(), llText))
 	{
-		LogX(StringPrintf(" - Read config '%s'", llText.c_str()));
+		LogX(" - Read config '%s'", llText.c_str());
 		auto parts = Split(llText, "\n");
 		if (parts.size() > 3)
 		{
@@ -34,31 +45,132 @@ void NTRIPServer::LoadSettings()
 			_port = atoi(parts[1].c_str());
 			_sCredential = parts[2];
 			_sPassword = parts[3];
-			LogX(StringPrintf(" - Recovered\r\n\t Address  : %s\r\n\t Port     : %d\r\n\t Mid/Cred : %s\r\n\t Pass     : %s", _sAddress.c_str(), _port, _sCredential.c_str(), _sPassword.c_str()));
+			if (parts.size() > 4)
+				_sOptions = parts[4];
+			_group.Setup(_sAddress, _port, GetOption(_sOptions, "backup", ""));
+			_maxFrameAge = GetOption(_sOptions, "maxage", DEFAULT_MAX_FRAME_AGE);
+			int rate = GetOption(_sOptions, "rate", 0);
+			_bucket.Setup(rate, GetOption(_sOptions, "burst", rate));
+			_ntripV2 = GetOption(_sOptions, "v2", 0) != 0;
+			_sUser = GetOption(_sOptions, "user", _sCredential);
+			if (GetOption(_sOptions, "tls", 0) != 0)
+				SetupTls();
+			_standbyEnabled = GetOption(_sOptions, "standby", 0) != 0;
+			_dnsTtl = GetOption(_sOptions, "dnsttl", DEFAULT_DNS_TTL / 1000) * 1000UL;
+			_stallTimeout = GetOption(_sOptions, "stall", DEFAULT_STALL_TIMEOUT);
+			_input = GetOption(_sOptions, "input", 1);
+			_reencoder.Setup(GetOption(_sOptions, "msm", 0), GetOption(_sOptions, "signals", 0));
+			_connector.Setup(Host(), Port(), _dnsTtl);
+			LogX(" - Recovered\r\n\t Address  : %s\r\n\t Port     : %d\r\n\t Mid/Cred : %s\r\n\t Pass     : %s\r\n\t Options  : %s", _sAddress.c_str(), _port, _sCredential.c_str(), _sPassword.c_str(), _sOptions.c_str());
 		}
 		else
 		{
-			LogX(StringPrintf(" - E341 - Cannot read saved Server settings %s", llText.c_str()));
+			LogX(" - E341 - Cannot read saved Server settings %s", llText.c_str());
 		}
 	}
 	else
 	{
-		LogX(StringPrintf(" - E342 - Cannot read saved Server setting %s", fileName.c_str()));
+		LogX(" - E342 - Cannot read saved Server setting %s", fileName.c_str());
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Switch to a TLS connection. The server is checked one of two ways
+//	- Against a CA certificate in /CasterNCa.pem (Full chain check by mbedtls)
+//	- Against the SHA256 fingerprints given with fp=<hex>[,<hex>]. Any of them
+//	  is accepted so a rotated certificate can be added before it goes live.
+//	  Colons, spaces and case in the fingerprint do not matter
+// .. With neither nothing is trusted and the connection is refused. The
+// .. fingerprint the server sent is logged so it can be checked and copied
+void NTRIPServer::SetupTls()
+{
+	_pSecureClient.reset(new WiFiClientSecure());
+	_pSecureClient->setHandshakeTimeout(CASTER_RESPONSE_TIMEOUT / 1000);
+	_pClient = _pSecureClient.get();
+
+	_tlsFingerprints.clear();
+	for (const auto &item : Split(GetOption(_sOptions, "fp", ""), ","))
+	{
+		std::string fingerprint = NormaliseFingerprint(item);
+		if (fingerprint.length() == 64)
+			_tlsFingerprints.push_back(fingerprint);
+		else if (!item.empty())
+			LogX("E508 - TLS fingerprint '%s' is not 32 bytes of hex", item.c_str());
+	}
+
+	// WiFiClientSecure keeps a pointer to the certificate
+	_caCert.clear();
+	if (_myFiles.ReadFile(StringPrintf("/Caster%dCa.pem", _index).c_str(), _caCert) && !_caCert.empty())
+	{
+		_pSecureClient->setCACert(_caCert.c_str());
+		LogX(" - TLS enabled. Checked against /Caster%dCa.pem", _index);
+	}
+	else
+	{
+		_caCert.clear();
+		_pSecureClient->setInsecure();
+		LogX(" - TLS enabled. %d pinned fingerprints", (int)_tlsFingerprints.size());
 	}
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Lower case hex without separators so "AB:CD" matches "abcd"
+std::string NTRIPServer::NormaliseFingerprint(const std::string &text)
+{
+	std::string result;
+	for (char c : text)
+	{
+		if (isxdigit(c))
+			result += tolower(c);
+		else if (c != ':' && c != ' ')
+			return "";
+	}
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Check the server certificate after the handshake. A CA checked connection
+// .. is already verified. Otherwise it must match a pinned fingerprint
+// @return false if the server is not trusted
+bool NTRIPServer::VerifyFingerprint()
+{
+	uint8_t sha[32];
+	if (!_pSecureClient->getFingerprintSHA256(sha))
+	{
+		LogX("E505 - %s No TLS certificate", Host());
+		return false;
+	}
+	char text[2 * sizeof(sha) + 1];
+	std::string fingerprint(text, FormatHex(text, sizeof(text), sha, sizeof(sha), '\0'));
+
+	if (!_caCert.empty() && _tlsFingerprints.empty())
+		return true;
+	for (const auto &pinned : _tlsFingerprints)
+	{
+		if (fingerprint == pinned)
+			return true;
+	}
+
+	_tlsRejects++;
+	if (_tlsFingerprints.empty())
+		LogX("E508 - %s No trusted certificate. Add fp=%s if this is the caster", Host(), fingerprint.c_str());
+	else
+		LogX("E506 - %s TLS certificate not pinned %s", Host(), fingerprint.c_str());
+	return false;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Save the setting to the file
-void NTRIPServer::Save(const char *address, const char *port, const char *credential, const char *password) const
+void NTRIPServer::Save(const char *address, const char *port, const char *credential, const char *password, const char *options) const
 {
-	std::string llText = StringPrintf("%s\n%s\n%s\n%s", address, port, credential, password);
+	std::string llText = StringPrintf("%s\n%s\n%s\n%s\n%s", address, port, credential, password, options);
 	std::string fileName = StringPrintf("/Caster%d.txt", _index);
 	_myFiles.WriteFile(fileName.c_str(), llText.c_str());
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Loop called when we have new data to send
-void NTRIPServer::Loop(const byte *pBytes, int length)
+// Loop called every pass to send anything new in the ring
+void NTRIPServer::Loop(const RtcmFrameRing &ring)
 {
 	// Disable the port if not used
 	if (_port < 1 || _sAddress.length() < 1)
@@ -71,75 +183,656 @@ void NTRIPServer::Loop(const byte *pBytes, int length)
 	// Check the index is valid
 	if (_index > RTK_SERVERS)
 	{
-		LogX(StringPrintf("E501 - RTK Server index %d too high", index));
+		LogX("E501 - RTK Server index %d too high", _index);
 		return;
 	}
 
+	_group.Tick(_wasConnected);
+
 	// Wifi check interval
-	if (_client.connected())
+	if (_pClient->connected())
 	{
-		ConnectedProcessing(pBytes, length);
+		if (_wasConnected)
+			ConnectedProcessing(ring);
+		else
+			HandshakeProcessing(ring);
 	}
 	else
 	{
-		_wasConnected = false;
-		_status = "Disconn...";
-		//// _display.RefreshRtk(_index);
-		Reconnect();
+		// Nothing queues while disconnected. Start with fresh data on reconnect
+		_nextSeq = ring.NextSeq();
+		_deferredCount = 0;
+		_viewCount = 0;
+		_viewBytes = 0;
+		_reencodedLength = 0;
+		_reencodedSeq = UINT32_MAX;
+		_pendingLength = 0;
+		_pendingOffset = 0;
+		if (_wasConnected)
+		{
+			_wasConnected = false;
+			_status = "Disconn...";
+			//// _display.RefreshRtk(_index);
+
+			// Lost a working connection so try again straight away. A caster
+			// .. that accepts then closes (Bad mount point, caster full) would
+			// .. loop, so a quick drop waits and from the second on backs off
+			_dropTime = millis();
+			unsigned long upTime = millis() - _acceptTime;
+			if (upTime >= CASTER_STABLE_TIME)
+			{
+				_quickDrops = 0;
+				_retryInterval = SOCKET_RETRY_INTERVAL;
+				_wifiConnectTime = millis() - _retryInterval;
+			}
+			else
+			{
+				if (++_quickDrops > 1)
+					_retryInterval = min(_retryInterval * 2, (unsigned long)SOCKET_RETRY_MAX);
+				_wifiConnectTime = millis();
+				LogX("E509 - %s Dropped %lums after accepting. Retry in %lus", Host(), upTime, _retryInterval / 1000);
+			}
+			if (!_plannedSwitch)
+				_group.OnFailure(CASTER_PENALTY_DROP);
+			_plannedSwitch = false;
+		}
+		if (_connector.IsPending())
+			PollConnect();
+		else
+			Reconnect();
 	}
 }
 
-void NTRIPServer::ConnectedProcessing(const byte *pBytes, int length)
+//////////////////////////////////////////////////////////////////////////////
+// Wait for the caster to accept or reject the SOURCE or POST request. Nothing is sent
+// .. until it says ICY 200 OK (or HTTP 200 for v2). A bad password backs off the retries so we do
+// .. not hammer the caster with a login it will never accept
+void NTRIPServer::HandshakeProcessing(const RtcmFrameRing &ring)
 {
-	if (!_wasConnected)
+	_nextSeq = ring.NextSeq();
+
+	byte buffer[SOCKET_IN_BUFFER_MAX];
+	int available = _pClient->available();
+	if (available > 0)
 	{
+		int length = _pClient->read(buffer, min(available, SOCKET_IN_BUFFER_MAX));
+		if (length > 0)
+			_response.Add(buffer, length);
+	}
+
+	unsigned long elapsed = millis() - _wifiConnectTime;
+	switch (_response.GetResult())
+	{
+	case NtripResponse::Pending:
+		if (elapsed < CASTER_RESPONSE_TIMEOUT)
+			return;
+		LogX("E502 - %s No response from caster (%lums)", Host(), elapsed);
+		_status = "No reply";
+		break;
+
+	case NtripResponse::Ok:
+		LogX("Caster %s accepted '%s' (%lums)", Host(), _response.GetStatusLine().c_str(), elapsed);
 		_reconnects++;
 		_status = "Connected";
 		//// _display.RefreshRtk(_index);
 		_wasConnected = true;
+		_acceptTime = millis();
+		_earlySwitched = false;
+		return;
+
+	case NtripResponse::AuthFailed:
+		_retryInterval = min(_retryInterval * 2, (unsigned long)SOCKET_RETRY_MAX);
+		LogX("E503 - %s Authentication failed '%s'. Retry in %lus", Host(), _response.GetStatusLine().c_str(), _retryInterval / 1000);
+		_status = "Bad password";
+		break;
+
+	case NtripResponse::Rejected:
+		LogX("E504 - %s Rejected '%s'", Host(), _response.GetStatusLine().c_str());
+		_status = "Rejected";
+		break;
 	}
 
+	// Rejected so start the retry wait from now
+	_group.OnFailure(CASTER_PENALTY_REJECT);
+	_wifiConnectTime = millis();
+	_pClient->stop();
+}
+
+void NTRIPServer::ConnectedProcessing(const RtcmFrameRing &ring)
+{
 	// Send what we have received
-	ConnectedProcessingSend(pBytes, length);
+	SendQueued(ring);
+	if (CheckStall(ring))
+		return;
 
 	// Check for new data (Not expecting much)
 	ConnectedProcessingReceive();
+
+	KeepStandby();
+
+	// Give up this connection if another caster in the group is clearly healthier
+	if (_group.ShouldSwitch())
+	{
+		LogX("Caster %s leaving for a healthier caster", Host());
+		_plannedSwitch = true;
+		_pClient->stop();
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////
-// Send the data to the RTK Caster
-void NTRIPServer::ConnectedProcessingSend(const byte *pBytes, int length)
+// A half-open connection keeps accepting writes until the socket send buffer
+// .. is full and lwip then retries for minutes. TCP keepalive is no help as
+// .. it only probes when nothing is unacknowledged, which never happens while
+// .. streaming. If the socket will not take data for _stallTimeout the caster
+// .. is treated as gone
+// @return true if the connection was closed
+bool NTRIPServer::CheckStall(const RtcmFrameRing &ring)
 {
-	if (length < 1)
+	if (_stallTimeout == 0 || !_pClient->connected())
+		return false;
+
+	// Nothing waiting or the socket has room
+	bool waiting = _nextSeq < ring.NextSeq() || _viewCount > 0 || _pendingLength > 0;
+	if (!waiting || CanWrite())
+	{
+		_stallStart = 0;
+		return false;
+	}
+
+	if (_stallStart == 0)
+		_stallStart = millis();
+	if ((millis() - _stallStart) < _stallTimeout)
+		return false;
+
+	// Measured from when data last went in as that is when the caster went quiet
+	_stallDetectTime = millis() - (_lastWriteTime != 0 ? _lastWriteTime : _stallStart);
+	_stallDrops++;
+	_stallStart = 0;
+	LogX("E507 - %s Caster stopped taking data (%lums)", Host(), _stallDetectTime);
+	_pClient->stop();
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Keep a spare TCP connection open so a dropped caster can be replaced
+// .. without waiting for DNS and the TCP handshake. The NTRIP request is only
+// .. sent when it is swapped in as casters take one source per mount point
+void NTRIPServer::KeepStandby()
+{
+	if (!_standbyEnabled || _pSecureClient)
 		return;
 
-	// Clear out extra send history
-	while (_sendMicroSeconds.size() >= AVERAGE_SEND_TIMERS)
-		_sendMicroSeconds.erase(_sendMicroSeconds.begin());
+	if (_connector.IsPending())
+	{
+		int fd = _connector.Poll();
+		if (fd >= 0)
+		{
+			// Nothing is sent on the standby so keepalive can find a dead peer
+			SocketConnector::SetKeepAlive(fd);
+			_standbyFd = fd;
+		}
+		return;
+	}
+
+	if ((millis() - _standbyTime) < (_standbyFd < 0 ? CASTER_STANDBY_RETRY : 1000))
+		return;
+	_standbyTime = millis();
+
+	// Casters drop idle connections so check it is still there
+	if (_standbyFd >= 0)
+	{
+		if (SocketConnector::IsAlive(_standbyFd))
+			return;
+		close(_standbyFd);
+		_standbyFd = -1;
+	}
+	_connector.Start();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send queued frames while the socket can take them. Once the oldest waiting
+// .. frame is older than the age limit its whole epoch is dropped so the
+// .. caster never gets a partial epoch. Station frames (1005, 1033 etc) are
+// .. always sent as rovers need them however old they are.
+// .. When the uplink is shaped, low value frames step aside for the MSM
+void NTRIPServer::SendQueued(const RtcmFrameRing &ring)
+{
+	_throttled = false;
+	SendPending();
+
+	// Frames overwritten in the ring before we could send them
+	if (_nextSeq < ring.OldestSeq())
+	{
+		_droppedFrames += ring.OldestSeq() - _nextSeq;
+		_nextSeq = ring.OldestSeq();
+	}
+
+	while (_nextSeq < ring.NextSeq())
+	{
+		const RtcmFrame *pFrame = ring.Get(_nextSeq);
+		unsigned long age = millis() - pFrame->time;
+
+		// Drop stale epochs
+		if (!RtcmIsStatic(pFrame->type) && (pFrame->epoch < _dropEpoch || age > _maxFrameAge))
+		{
+			_dropEpoch = max(_dropEpoch, pFrame->epoch + 1);
+			_droppedFrames++;
+			_droppedBytes += pFrame->length;
+			_nextSeq++;
+			continue;
+		}
+
+		// Hold back low value frames till the MSM are out. Only while the
+		// .. bucket is short, otherwise there is nothing to make way for
+		if (_bucket.IsEnabled() && RtcmIsLowValue(pFrame->type) && (_throttled || _deferredCount > 0 || !_bucket.CanTake(pFrame->length)))
+		{
+			Defer(_nextSeq++);
+			continue;
+		}
+
+		// Leave it in the queue if the socket is backed up or throttled
+		if (!TrySend(ring, _nextSeq, age))
+			break;
+		_nextSeq++;
+	}
+
+	// Low value frames go once we have caught up
+	if (_nextSeq == ring.NextSeq())
+		SendDeferred(ring);
+
+	// Plain uplinks write everything gathered this pass. NTRIP v2 waits for the
+	// .. epoch to complete (Or the receiver to go quiet) so it goes as one chunk
+	if (_viewCount > 0 && (!_ntripV2 || _viewEpoch < ring.CurrentEpoch() || (millis() - _viewStart) > 1000))
+		FlushViews(ring);
+
+	UpdateSendStats();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send the low value frames held back while shaping
+void NTRIPServer::SendDeferred(const RtcmFrameRing &ring)
+{
+	while (_deferredCount > 0)
+	{
+		const RtcmFrame *pFrame = ring.Get(_deferred[0]);
+		if (pFrame != nullptr)
+		{
+			unsigned long age = millis() - pFrame->time;
+			if (age <= _maxFrameAge)
+			{
+				if (!TrySend(ring, _deferred[0], age))
+					return;
+			}
+			else
+			{
+				_droppedFrames++;
+				_droppedBytes += pFrame->length;
+			}
+		}
+		else
+		{
+			_droppedFrames++;
+		}
+
+		_deferredCount--;
+		memmove(_deferred, _deferred + 1, _deferredCount * sizeof(_deferred[0]));
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Add a frame to the deferred list dropping the oldest if full
+void NTRIPServer::Defer(uint32_t seq)
+{
+	if (_deferredCount >= CASTER_DEFERRED_MAX)
+	{
+		_droppedFrames++;
+		_deferredEvicted++;
+		_deferredCount--;
+		memmove(_deferred, _deferred + 1, _deferredCount * sizeof(_deferred[0]));
+	}
+	_deferred[_deferredCount++] = seq;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gather one frame for the next write if the socket and the token bucket allow.
+// .. Only a pointer to the frame in the ring is kept, nothing is copied unless
+// .. the MSM is being reduced for this caster
+// @return false if the frame was not taken and should be tried again later
+bool NTRIPServer::TrySend(const RtcmFrameRing &ring, uint32_t seq, unsigned long age)
+{
+	const RtcmFrame *pFrame = ring.Get(seq);
+
+	// NTRIP v2 sends each epoch as one chunk
+	// .. A shaped caster also writes before the gathered frames outgrow the burst
+	bool newEpoch = _ntripV2 && pFrame->epoch != _viewEpoch;
+	bool overBurst = _bucket.IsEnabled() && _viewBytes + pFrame->length > (int)_bucket.GetBurst();
+	if (_viewCount > 0 && (newEpoch || overBurst || _viewCount >= CASTER_VIEWS_MAX || _viewBytes + pFrame->length > CASTER_CHUNK_MAX))
+	{
+		if (!FlushViews(ring))
+			return false;
+	}
+
+	if (!_ntripV2 && (_pendingLength > 0 || !CanWrite()))
+		return false;
+
+	// Reduce the MSM for this caster. The rewrite is kept at the end of the
+	// .. buffer until it is taken so a throttled frame is only done once
+	const byte *pData = pFrame->pData;
+	int length = pFrame->length;
+	if (_reencoder.IsEnabled())
+	{
+		if (_reencodedSeq != seq)
+		{
+			_reencodedFrame = _reencoder.Reencode(pFrame->pData, pFrame->length, pFrame->type, pFrame->epoch, _reencoded + _reencodedLength);
+			_reencodedSeq = seq;
+		}
+		if (_reencodedFrame > 0)
+		{
+			pData = _reencoded + _reencodedLength;
+			length = _reencodedFrame;
+		}
+	}
+
+	// The tokens are taken when the frames are written
+	if (!_bucket.CanTake(_viewBytes + length))
+	{
+		_throttled = true;
+		return false;
+	}
+
+	if (pData != pFrame->pData)
+		_reencodedLength += length;
+	_reencodedSeq = UINT32_MAX;
+
+	if (_viewCount == 0)
+	{
+		_viewStart = millis();
+		_viewOldestSeq = seq;
+	}
+	_views[1 + _viewCount].iov_base = (void *)pData;
+	_views[1 + _viewCount].iov_len = length;
+	_viewCount++;
+	_viewBytes += length;
+	_viewEpoch = pFrame->epoch;
+	_viewOldestSeq = min(_viewOldestSeq, seq);
+
+	// Epoch size for the stats and send buffer
+	if (pFrame->epoch != _sentEpoch)
+	{
+		_maxEpochBytes = max(_maxEpochBytes, _epochBytes);
+		_epochBytes = 0;
+		_sentEpoch = pFrame->epoch;
+		_epochsSent++;
+	}
+	_epochBytes += length;
+
+	_correctionAge = age;
+	_maxCorrectionAge = max(_maxCorrectionAge, age);
+	_queueDelay = (_queueDelay * 7 + age) / 8;
+	_rateBytes += length;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Write the gathered frames with a single call. For NTRIP v2 the chunk length
+// .. line and trailing CRLF are extra views around the frames
+bool NTRIPServer::FlushViews(const RtcmFrameRing &ring)
+{
+	if (_viewCount < 1)
+		return true;
+	if (!SendPending() || !CanWrite())
+		return false;
+
+	// The parser may have reused the arena while a v2 chunk waited
+	if (_viewOldestSeq < ring.OldestSeq())
+	{
+		_droppedFrames += _viewCount;
+		_droppedBytes += _viewBytes;
+		_viewCount = 0;
+		_viewBytes = 0;
+		_reencodedLength = 0;
+		_reencodedSeq = UINT32_MAX;
+		return true;
+	}
+
+	const struct iovec *pViews = _views + 1;
+	int count = _viewCount;
+	if (_ntripV2)
+	{
+		_views[0].iov_base = _chunkHeader;
+		_views[0].iov_len = snprintf(_chunkHeader, sizeof(_chunkHeader), "%X\r\n", _viewBytes);
+		_views[1 + count].iov_base = (void *)"\r\n";
+		_views[1 + count].iov_len = 2;
+		pViews = _views;
+		count += 2;
+	}
+
+	if (_ntripV2)
+		_copyAvoided += _viewBytes - _reencodedLength;
+	_bucket.Take(_viewBytes);
+	_viewCount = 0;
+	_viewBytes = 0;
+	_reencodedLength = 0;
+	_reencodedSeq = UINT32_MAX;
+	if (!SendViews(pViews, count))
+		return false;
+	if (_ntripV2)
+		_chunksSent++;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Update the achieved rate and throttle time
+void NTRIPServer::UpdateSendStats()
+{
+	unsigned long now = millis();
+	if (_throttled)
+	{
+		if (_throttleStart == 0)
+			_throttleStart = now;
+	}
+	else if (_throttleStart != 0)
+	{
+		_throttleTime += now - _throttleStart;
+		_throttleStart = 0;
+	}
+
+	if (now - _rateTime >= 1000)
+	{
+		_achievedRate = _rateBytes * 1000 / (now - _rateTime);
+		_rateBytes = 0;
+		_rateTime = now;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Total time the token bucket has held back sends including any current hold
+unsigned long NTRIPServer::GetThrottleTime() const
+{
+	if (_throttleStart == 0)
+		return _throttleTime;
+	return _throttleTime + (millis() - _throttleStart);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Check if the socket send buffer has room without blocking
+bool NTRIPServer::CanWrite()
+{
+	// WiFiClientSecure keeps its socket to itself so TLS writes just block
+	if (_pSecureClient)
+		return true;
+
+	int fd = _pClient->fd();
+	if (fd < 0)
+		return false;
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+	struct timeval tv = {0, 0};
+	return select(fd + 1, NULL, &set, NULL, &tv) > 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send a list of buffers to the RTK Caster. Plain sockets take them all in
+// .. one writev without blocking. Whatever does not fit is kept and goes
+// .. from SendPending() before anything new. WiFiClientSecure has no
+// .. gathered write so TLS writes each in turn and blocks
+// @return false if the connection has been closed
+bool NTRIPServer::SendViews(const struct iovec *pViews, int count)
+{
+	int length = 0;
+	for (int n = 0; n < count; n++)
+		length += pViews[n].iov_len;
+	if (length < 1)
+		return true;
 
 	// Send and record time
 	unsigned long startT = micros();
-	int sent = _client.write(pBytes, length);
+	int sent = 0;
+	if (_pSecureClient)
+	{
+		for (int n = 0; n < count; n++)
+		{
+			_writeCalls++;
+			int written = _pClient->write((const uint8_t *)pViews[n].iov_base, pViews[n].iov_len);
+			sent += max(0, written);
+			if (written != (int)pViews[n].iov_len)
+				break;
+		}
+	}
+	else
+	{
+		_writeCalls++;
+		sent = lwip_writev(_pClient->fd(), pViews, count);
+		if (sent < 0 && (errno == EWOULDBLOCK || errno == EAGAIN))
+			sent = 0;
+	}
 
+	// A full socket returns at once having moved nothing. Counting those as
+	// .. writes would pull the percentiles and caster score toward zero
 	unsigned long time = micros() - startT;
-	if (_maxSendTime == 0)
-		_maxSendTime = time;
+	if (sent > 0)
+	{
+		_group.OnSend(time);
+		_sendStats.Add(time, sent);
+	}
 	else
-		_maxSendTime = max(_maxSendTime, time);
+	{
+		_blockedWrites++;
+	}
+
+	if (_pSecureClient)
+	{
+		_tlsWriteMicros += time;
+		_tlsWriteBytes += max(0, sent);
+	}
+
+	// Socket is full. Keep the rest rather than drop the connection
+	if (!_pSecureClient && sent >= 0 && sent < length && length - sent <= CASTER_PENDING_MAX)
+	{
+		_partialWrites++;
+		_pendingLength = 0;
+		_pendingOffset = 0;
+		int skip = sent;
+		for (int n = 0; n < count; n++)
+		{
+			int size = pViews[n].iov_len;
+			if (skip >= size)
+			{
+				skip -= size;
+				continue;
+			}
+			memcpy(_pending + _pendingLength, (const byte *)pViews[n].iov_base + skip, size - skip);
+			_pendingLength += size - skip;
+			skip = 0;
+		}
+		if (sent > 0)
+			OnWritten();
+		return true;
+	}
 
 	if (sent != length)
 	{
-		LogX(StringPrintf("E500 - %s Only sent %d of %d (%sms)", _sAddress.c_str(), sent, length, time/1000));
-		_client.stop();
+		LogX("E500 - %s Only sent %d of %d (%lums)", Host(), sent, length, time/1000);
+		_pClient->stop();
+		return false;
 	}
-	else
+	OnWritten();
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Carry on with a write the socket only took part of. Like RingWriter this
+// .. resumes from the saved offset and never blocks
+// @return true once nothing is left waiting
+bool NTRIPServer::SendPending()
+{
+	if (_pendingLength == 0)
+		return true;
+	int fd = _pClient->fd();
+	if (fd < 0)
+		return false;
+
+	int sent = send(fd, _pending + _pendingOffset, _pendingLength - _pendingOffset, MSG_DONTWAIT);
+	if (sent < 0)
 	{
-		// Logf("RTK %s Sent %d OK", _sAddress.c_str(), sent);
-		_sendMicroSeconds.push_back(sent * 8 * 1000 / max(1UL, time));
-		_wifiConnectTime = millis();
-		_packetsSent++;
-		//// _display.RefreshRtk(_index);
+		if (errno == EWOULDBLOCK || errno == EAGAIN)
+		{
+			_blockedWrites++;
+			return false;
+		}
+		LogX("E500 - %s Send failed with %d of %d left", Host(), _pendingLength - _pendingOffset, _pendingLength);
+		_pendingLength = 0;
+		_pendingOffset = 0;
+		_pClient->stop();
+		return false;
+	}
+
+	_writeCalls++;
+	_pendingOffset += sent;
+	if (sent > 0)
+		OnWritten();
+	if (_pendingOffset < _pendingLength)
+		return false;
+	_pendingLength = 0;
+	_pendingOffset = 0;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Data went into the socket
+void NTRIPServer::OnWritten()
+{
+	// Logf("RTK %s Sent %d OK", Host(), sent);
+	_wifiConnectTime = millis();
+	_lastWriteTime = millis();
+	_packetsSent++;
+
+	// First data since the connection dropped
+	if (_dropTime != 0)
+	{
+		_firstByteLatency = millis() - _dropTime;
+		_maxFirstByteLatency = max(_maxFirstByteLatency, _firstByteLatency);
+		_dropTime = 0;
 	}
+	if (_switchPending)
+	{
+		_switchLatency = millis() - _switchStart;
+		_switchPending = false;
+	}
+	//// _display.RefreshRtk(_index);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Use a connected plain socket for the caster. It stays non-blocking so a
+// .. full send buffer never holds up the loop
+void NTRIPServer::TakeSocket(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	_pendingLength = 0;
+	_pendingOffset = 0;
+	_client = WiFiClient(fd);
+	_client.setNoDelay(true);					// This results in 0.5s latency when RTK2GO.com is skipped?
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -147,75 +840,160 @@ void NTRIPServer::ConnectedProcessingSend(const byte *pBytes, int length)
 void NTRIPServer::ConnectedProcessingReceive()
 {
 	// Read the data
-	int buffSize = _client.available();
+	int buffSize = _pClient->available();
 	if (buffSize < 1)
 		return;
 
-	buffSize = min(buffSize, SOCKET_IN_BUFFER_MAX);
-
-	std::unique_ptr<byte[]> buffer(new byte[buffSize + 1]);
-	auto _pSocketBuffer = buffer.get();
-	_client.read(_pSocketBuffer, buffSize);
-
-	_pSocketBuffer[buffSize] = 0;
+	byte buffer[SOCKET_IN_BUFFER_MAX];
+	buffSize = _pClient->read(buffer, min(buffSize, SOCKET_IN_BUFFER_MAX));
+	if (buffSize < 1)
+		return;
 
 	// Log the data
-	LogX("RECV. " + _sAddress + "\r\n" + HexAsciDump(_pSocketBuffer, buffSize));
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// Get the average send time
-int NTRIPServer::AverageSendTime()
-{
-	if (_sendMicroSeconds.size() < 1)
-		return 0;
-	int total = 0;
-	for (int n : _sendMicroSeconds)
-		total += n;
-	return total / _sendMicroSeconds.size();
+	LogX("RECV. " + _group.Current().host + "\r\n" + HexAsciDump(buffer, buffSize));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Write to the debug log and keep the last few messages for display
+// Write to the log tagged so the page for this caster can find it
 void NTRIPServer::LogX(std::string text)
 {
-	auto s = Logln(text.c_str());
-	_logHistory.push_back(s);
-	TruncateLog(_logHistory);
+	Logln(text.c_str(), (LogSource)(LOG_CASTER1 + _index));
 	//// _display.RefreshRtkLog();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 bool NTRIPServer::Reconnect()
 {
-	// Limit how soon the connection is retried
-	if ((millis() - _wifiConnectTime) < SOCKET_RETRY_INTERVAL)
+	// Every attempt waits the retry interval. The first failure after a caster
+	// .. accepted us may move to a healthier caster straight away, but only
+	// .. once, as the group has no hysteresis between attempts and with every
+	// .. caster down we would otherwise bounce between them each loop. The
+	// .. backoff after a bad password or quick drops is for the whole group
+	// .. (The backups share the credentials) so no early switch while it runs
+	bool waited = (millis() - _wifiConnectTime) >= _retryInterval;
+	if (!waited && (_earlySwitched || _retryInterval > SOCKET_RETRY_INTERVAL))
+		return false;
+	if (_group.Choose())
+	{
+		if (!waited)
+			_earlySwitched = true;
+		OnEndpointChanged();
+	}
+	else if (!waited)
+	{
 		return false;
+	}
 
 	_wifiConnectTime = millis();
 
 	// Start the connection process
-	LogX(StringPrintf("RTK Connecting to %s : %d", _sAddress.c_str(), _port));
-	_client.setNoDelay(false);
+	// Swap in the warm standby if it is still good
+	if (_standbyFd >= 0)
+	{
+		int fd = _standbyFd;
+		_standbyFd = -1;
+		if (SocketConnector::IsAlive(fd))
+		{
+			LogX("RTK Using standby connection to %s", Host());
+			_standbySwaps++;
+			TakeSocket(fd);
+			return SendRequest();
+		}
+		close(fd);
+	}
 
-	int status = _client.connect(_sAddress.c_str(), _port);
-	_client.setNoDelay(true);					// This results in 0.5s latency when RTK2GO.com is skipped?
-	if (!_client.connected())
+	// Start the connection process
+	LogX("RTK Connecting to %s : %d", Host(), Port());
+	_status = "Connecting";
+
+	// TLS connects block inside WiFiClientSecure
+	if (_pSecureClient)
 	{
-		LogX(StringPrintf("E500 - RTK %s Not connected %d. (%dms)", _sAddress.c_str(), status, millis() - _wifiConnectTime));
-		return false;
+		int status = _pClient->connect(Host(), Port());
+		if (!_pClient->connected())
+		{
+			LogX("E500 - RTK %s Not connected %d. (%lums)", Host(), status, millis() - _wifiConnectTime);
+			_status = "Disconn...";
+			_group.OnFailure(CASTER_PENALTY_CONNECT);
+			return false;
+		}
+		LogX("Connected %s OK. (%lums)", Host(), millis() - _wifiConnectTime);
+		if (!VerifyFingerprint())
+		{
+			_group.OnFailure(CASTER_PENALTY_REJECT);
+			_status = "Bad cert";
+			_pClient->stop();
+			return false;
+		}
+		return SendRequest();
 	}
-	LogX(StringPrintf("Connected %s OK. (%dms)", _sAddress.c_str(), millis() - _wifiConnectTime));
 
-	if (!WriteText(StringPrintf("SOURCE %s %s\r\n", _sPassword.c_str(), _sCredential.c_str()).c_str()))
-		return false;
-	if (!WriteText("Source-Agent: NTRIP UM98/ESP32_T_Display_SX\r\n"))
-		return false;
-	if (!WriteText("STR: \r\n"))
-		return false;
-	if (!WriteText("\r\n"))
-		return false;
-	return true;
+	// Plain connections race every address and are picked up in PollConnect()
+	if (_connector.Start())
+		return true;
+	LogX("E500 - RTK %s Not connected %s", Host(), _connector.GetLastError().c_str());
+	_status = "Disconn...";
+	_group.OnFailure(CASTER_PENALTY_CONNECT);
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The group has picked a different caster. Drop anything tied to the old one
+void NTRIPServer::OnEndpointChanged()
+{
+	LogX("Caster failover to %s : %d (Score %d)", Host(), Port(), _group.Score(_group.CurrentIndex()));
+	_connector.Cancel();
+	_connector.Setup(Host(), Port(), _dnsTtl);
+	if (_standbyFd >= 0)
+	{
+		close(_standbyFd);
+		_standbyFd = -1;
+	}
+	_switchStart = _dropTime != 0 ? _dropTime : millis();
+	_switchPending = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Check on the connect attempts started by Reconnect()
+void NTRIPServer::PollConnect()
+{
+	int fd = _connector.Poll();
+	if (fd == CONNECT_PENDING)
+		return;
+	if (fd == CONNECT_FAILED)
+	{
+		LogX("E500 - RTK %s Not connected %s. (%lums)", Host(), _connector.GetLastError().c_str(), millis() - _wifiConnectTime);
+		_status = "Disconn...";
+		_group.OnFailure(CASTER_PENALTY_CONNECT);
+		return;
+	}
+
+	TakeSocket(fd);
+	LogX("Connected %s OK. (%lums)", Host(), millis() - _wifiConnectTime);
+	SendRequest();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Send the NTRIP request on a new connection
+bool NTRIPServer::SendRequest()
+{
+	// Send the request in one write then wait for the reply in HandshakeProcessing()
+	_response.Reset();
+	_status = "Handshake";
+	std::string request;
+	if (_ntripV2)
+	{
+		request = StringPrintf("POST /%s HTTP/1.1\r\nHost: %s:%d\r\nNtrip-Version: Ntrip/2.0\r\nAuthorization: Basic %s\r\nUser-Agent: NTRIP UM98/ESP32_T_Display_SX\r\nConnection: keep-alive\r\nTransfer-Encoding: chunked\r\n\r\n",
+							   _sCredential.c_str(), Host(), Port(), Base64Encode(_sUser + ":" + _sPassword).c_str());
+	}
+	else
+	{
+		request = StringPrintf("SOURCE %s %s\r\nSource-Agent: NTRIP UM98/ESP32_T_Display_SX\r\nSTR: \r\n\r\n", _sPassword.c_str(), _sCredential.c_str());
+	}
+	if (WriteText(request.c_str()))
+		return true;
+	_pClient->stop();
+	return false;
 }
 
 bool NTRIPServer::WriteText(const char *str)
@@ -228,11 +1006,11 @@ bool NTRIPServer::WriteText(const char *str)
 	LogX(message);
 
 	size_t len = strlen(str);
-	size_t written = _client.write((const uint8_t *)str, len);
+	size_t written = _pClient->write((const uint8_t *)str, len);
 	if (len == written)
 		return true;
 
 	// Failed to write
-	LogX(StringPrintf("Write failed %s", _sAddress.c_str()));
+	LogX("Write failed %s", Host());
 	return false;
 }
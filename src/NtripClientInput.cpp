@@ -0,0 +1,295 @@
+#include "NtripClientInput.h"
+
+#include <WiFi.h>
+
+#include "HandyLog.h"
+#include "HandyString.h"
+#include <MyFiles.h>
+
+extern MyFiles _myFiles;
+
+//////////////////////////////////////////////////////////////////////////////
+// Load the configuration if it exists
+void NtripClientInput::LoadSettings()
+{
+	if (!_myFiles.ReadFile("/NtripInput.txt", _sOptions))
+	{
+		LogX(" - Upstream NTRIP input not configured");
+		return;
+	}
+	_sHost = GetOption(_sOptions, "host", "");
+	_port = GetOption(_sOptions, "port", 2101);
+	_sMount = GetOption(_sOptions, "mount", "");
+	std::string user = GetOption(_sOptions, "user", "");
+	if (!user.empty())
+		_sAuth = Base64Encode(user + ":" + GetOption(_sOptions, "password", ""));
+	_ntripV2 = GetOption(_sOptions, "v2", 0) != 0;
+	_connector.Setup(_sHost, _port, DEFAULT_DNS_TTL);
+	_stateTime = millis() - NTRIP_INPUT_RETRY;
+	LogX(" - Upstream NTRIP input %s : %d /%s", _sHost.c_str(), _port, _sMount.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Save the setting to the file
+void NtripClientInput::Save(const char *options) const
+{
+	_myFiles.WriteFile("/NtripInput.txt", options);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loop called every pass before the parser reads us
+void NtripClientInput::Loop()
+{
+	if (!IsEnabled())
+		return;
+
+	switch (_state)
+	{
+	case Idle:
+		if ((millis() - _stateTime) >= NTRIP_INPUT_RETRY)
+			StartConnect();
+		break;
+	case Connecting:
+		PollConnect();
+		break;
+	case Handshake:
+		HandshakeProcessing();
+		break;
+	case Streaming:
+		StreamingProcessing();
+		break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void NtripClientInput::SetState(State state, const char *status)
+{
+	_state = state;
+	_status = status;
+	_stateTime = millis();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Start the TCP connection to the upstream caster
+void NtripClientInput::StartConnect()
+{
+	LogX("Upstream connecting to %s : %d", _sHost.c_str(), _port);
+	if (_connector.Start())
+	{
+		SetState(Connecting, "Connecting");
+		return;
+	}
+	LogX("E550 - Upstream %s not connected %s", _sHost.c_str(), _connector.GetLastError().c_str());
+	SetState(Idle, "Disconn...");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Wait for the connection and send the request
+void NtripClientInput::PollConnect()
+{
+	int fd = _connector.Poll();
+	if (fd == CONNECT_PENDING)
+		return;
+	if (fd == CONNECT_FAILED)
+	{
+		LogX("E550 - Upstream %s not connected %s", _sHost.c_str(), _connector.GetLastError().c_str());
+		SetState(Idle, "Disconn...");
+		return;
+	}
+
+	_client = WiFiClient(fd);
+	std::string auth = _sAuth.empty() ? "" : "Authorization: Basic " + _sAuth + "\r\n";
+	std::string request;
+	if (_ntripV2)
+		request = StringPrintf("GET /%s HTTP/1.1\r\nHost: %s\r\nNtrip-Version: Ntrip/2.0\r\nUser-Agent: NTRIP ESP32_T_Display_SX\r\n%sConnection: close\r\n\r\n",
+							   _sMount.c_str(), _sHost.c_str(), auth.c_str());
+	else
+		request = StringPrintf("GET /%s HTTP/1.0\r\nUser-Agent: NTRIP ESP32_T_Display_SX\r\n%s\r\n", _sMount.c_str(), auth.c_str());
+	if (_client.write((const uint8_t *)request.c_str(), request.length()) != request.length())
+	{
+		LogX("E550 - Upstream %s request failed", _sHost.c_str());
+		_client.stop();
+		SetState(Idle, "Disconn...");
+		return;
+	}
+
+	_response.Reset();
+	_head = _tail = 0;
+	_chunkState = ChunkSize;
+	_chunkLineLength = 0;
+	SetState(Handshake, "Handshake");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Wait for the caster to accept the request. Anything after the header is
+// .. the start of the RTCM
+void NtripClientInput::HandshakeProcessing()
+{
+	byte buffer[NTRIP_RESPONSE_MAX];
+	int count = _client.connected() ? _client.read(buffer, sizeof(buffer)) : 0;
+	int used = count > 0 ? _response.Add(buffer, count) : 0;
+
+	if (_response.GetResult() == NtripResponse::Ok && _response.HeadersComplete())
+	{
+		_chunked = strstr(_response.GetText(), "chunked") != nullptr;
+		LogX("Upstream %s accepted '%s'%s", _sHost.c_str(), _response.GetStatusLine().c_str(), _chunked ? " (Chunked)" : "");
+		_reconnects++;
+		_lastDataTime = millis();
+		SetState(Streaming, "Streaming");
+		AddBody(buffer + used, count - used);
+		return;
+	}
+
+	if (_response.GetResult() == NtripResponse::Pending || (_response.GetResult() == NtripResponse::Ok && _client.connected()))
+	{
+		if ((millis() - _stateTime) < NTRIP_INPUT_RESPONSE_TIMEOUT)
+			return;
+		LogX("E551 - Upstream %s no response", _sHost.c_str());
+	}
+	else if (_response.GetResult() == NtripResponse::AuthFailed)
+	{
+		LogX("E552 - Upstream %s authentication failed '%s'", _sHost.c_str(), _response.GetStatusLine().c_str());
+	}
+	else
+	{
+		LogX("E553 - Upstream %s rejected '%s'", _sHost.c_str(), _response.GetStatusLine().c_str());
+	}
+	_client.stop();
+	SetState(Idle, "Disconn...");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Move new data into the buffer for the parser
+void NtripClientInput::StreamingProcessing()
+{
+	if (!_client.connected())
+	{
+		LogX("E554 - Upstream %s dropped", _sHost.c_str());
+		_client.stop();
+
+		// Was working so try again straight away
+		SetState(Idle, "Disconn...");
+		_stateTime = millis() - NTRIP_INPUT_RETRY;
+		return;
+	}
+
+	// Make room at the end of the buffer
+	if (_head > 0)
+	{
+		memmove(_buffer, _buffer + _head, _tail - _head);
+		_tail -= _head;
+		_head = 0;
+	}
+
+	byte buffer[NTRIP_INPUT_BUFFER];
+	int count = _tail < NTRIP_INPUT_BUFFER ? _client.read(buffer, NTRIP_INPUT_BUFFER - _tail) : 0;
+	if (count > 0)
+	{
+		AddBody(buffer, count);
+		return;
+	}
+
+	if ((millis() - _lastDataTime) > NTRIP_INPUT_DATA_TIMEOUT)
+	{
+		LogX("E555 - Upstream %s no data for %lums", _sHost.c_str(), millis() - _lastDataTime);
+		_client.stop();
+		SetState(Idle, "No data");
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Add body bytes from the caster removing any chunk framing
+void NtripClientInput::AddBody(const byte *pBytes, int length)
+{
+	if (!_chunked)
+	{
+		AddData(pBytes, length);
+		return;
+	}
+
+	int n = 0;
+	while (n < length)
+	{
+		switch (_chunkState)
+		{
+		case ChunkSize:
+			if (pBytes[n] == '\n')
+			{
+				_chunkLine[_chunkLineLength] = '\0';
+				_chunkRemaining = strtol(_chunkLine, nullptr, 16);
+				_chunkLineLength = 0;
+				_chunkState = _chunkRemaining > 0 ? ChunkData : ChunkEnd;
+			}
+			else if (_chunkLineLength < (int)sizeof(_chunkLine) - 1)
+			{
+				_chunkLine[_chunkLineLength++] = pBytes[n];
+			}
+			n++;
+			break;
+		case ChunkData:
+		{
+			int count = min(_chunkRemaining, length - n);
+			AddData(pBytes + n, count);
+			_chunkRemaining -= count;
+			n += count;
+			if (_chunkRemaining == 0)
+				_chunkState = ChunkEnd;
+			break;
+		}
+		case ChunkEnd:
+			if (pBytes[n++] == '\n')
+				_chunkState = ChunkSize;
+			break;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Add RTCM bytes for the parser
+void NtripClientInput::AddData(const byte *pBytes, int length)
+{
+	if (length < 1)
+		return;
+	int count = min(length, NTRIP_INPUT_BUFFER - _tail);
+	memcpy(_buffer + _tail, pBytes, count);
+	_tail += count;
+	_bytesReceived += count;
+
+	unsigned long now = millis();
+	_maxGap = max(_maxGap, now - _lastDataTime);
+	_lastDataTime = now;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int NtripClientInput::available()
+{
+	return _tail - _head;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int NtripClientInput::read()
+{
+	return _head < _tail ? _buffer[_head++] : -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int NtripClientInput::peek()
+{
+	return _head < _tail ? _buffer[_head] : -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+size_t NtripClientInput::readBytes(char *buffer, size_t length)
+{
+	int count = min((int)length, _tail - _head);
+	memcpy(buffer, _buffer + _head, count);
+	_head += count;
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write to the log tagged so the page for this input can find it
+void NtripClientInput::LogX(std::string text)
+{
+	Logln(text.c_str(), LOG_UPSTREAM);
+}
@@ -0,0 +1,137 @@
+#include "RawRtcmServer.h"
+
+#include <WiFi.h>
+
+#include "HandyLog.h"
+#include "HandyString.h"
+#include <MyFiles.h>
+
+extern MyFiles _myFiles;
+
+//////////////////////////////////////////////////////////////////////////////
+// Load the configuration if it exists
+void RawRtcmServer::LoadSettings()
+{
+	if (!_myFiles.ReadFile("/RawServer.txt", _sOptions))
+	{
+		LogX(" - Raw RTCM server not configured");
+		return;
+	}
+	_port = GetOption(_sOptions, "port", 0);
+	_maxBacklog = max(1, GetOption(_sOptions, "backlog", RAW_SERVER_BACKLOG));
+	LogX(" - Raw RTCM server port %d backlog %u", _port, _maxBacklog);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Save the setting to the file
+void RawRtcmServer::Save(const char *options) const
+{
+	_myFiles.WriteFile("/RawServer.txt", options);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loop called every pass to take new clients and send anything new in the ring
+void RawRtcmServer::Loop(const RtcmFrameRing &ring)
+{
+	if (_port < 1)
+		return;
+
+	// Listen once the network is up
+	if (!_pServer)
+	{
+		_pServer.reset(new WiFiServer(_port, RAW_SERVER_MAX_CLIENTS));
+		_pServer->begin();
+		_pServer->setNoDelay(true);
+		LogX("Raw RTCM server listening on %d", _port);
+	}
+
+	Accept(ring);
+
+	for (int n = 0; n < (int)_clients.size(); n++)
+	{
+		RawClient &client = *_clients[n];
+		if (Service(client, ring))
+			continue;
+
+		LogX("Client %s gone after %lus, %llu bytes, %d dropped", client.address.c_str(),
+						  (millis() - client.connectTime) / 1000, client.writer.GetBytesSent(), client.writer.GetDrops());
+		client.client.stop();
+		_clients.erase(_clients.begin() + n--);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Take any new connection. It gets frames from now on
+void RawRtcmServer::Accept(const RtcmFrameRing &ring)
+{
+	WiFiClient client = _pServer->accept();
+	if (!client)
+		return;
+
+	if (_clients.size() >= RAW_SERVER_MAX_CLIENTS)
+	{
+		LogX("E530 - Raw server full. Refused %s", client.remoteIP().toString().c_str());
+		client.stop();
+		return;
+	}
+
+	std::unique_ptr<RawClient> pClient(new RawClient());
+	pClient->client = client;
+	pClient->address = client.remoteIP().toString().c_str();
+	pClient->connectTime = millis();
+	pClient->progressTime = millis();
+	pClient->writer.Start(ring);
+	pClient->client.setNoDelay(true);
+
+	// Writes must never hold up the parser
+	int fd = pClient->client.fd();
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+	LogX("Client %s connected", pClient->address.c_str());
+	_clients.push_back(std::move(pClient));
+	_clientsServed++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send what the client can take
+// @return false if the client should be dropped
+bool RawRtcmServer::Service(RawClient &client, const RtcmFrameRing &ring)
+{
+	if (!client.client.connected())
+		return false;
+
+	// Tools sometimes send NMEA or keep alives. Nothing to do with them
+	byte buffer[64];
+	while (client.client.available() > 0 && client.client.read(buffer, sizeof(buffer)) > 0)
+		;
+
+	if (client.writer.Backlog(ring) > _maxBacklog)
+	{
+		LogX("E531 - Client %s too slow (%u frames behind)", client.address.c_str(), client.writer.Backlog(ring));
+		_slowDrops++;
+		return false;
+	}
+
+	int sent = client.writer.Write(client.client.fd(), ring);
+	if (sent == RING_WRITE_FAILED)
+		return false;
+	if (sent != RING_WRITE_BLOCKED || client.writer.Backlog(ring) == 0)
+	{
+		client.progressTime = millis();
+		return true;
+	}
+	if ((millis() - client.progressTime) > RAW_SERVER_STALL_TIMEOUT)
+	{
+		LogX("E532 - Client %s stopped taking data", client.address.c_str());
+		_slowDrops++;
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write to the log tagged so the page for this server can find it
+void RawRtcmServer::LogX(std::string text)
+{
+	Logln(text.c_str(), LOG_RAW_SERVER);
+}
@@ -0,0 +1,300 @@
+#include "ReceiverFailover.h"
+
+#include "HandyLog.h"
+#include "HandyString.h"
+#include <MyFiles.h>
+
+extern MyFiles _myFiles;
+
+//////////////////////////////////////////////////////////////////////////////
+// Load the configuration if it exists
+void ReceiverFailover::LoadSettings()
+{
+	if (!_myFiles.ReadFile("/Failover.txt", _sOptions))
+	{
+		LogX(" - Receiver failover not configured");
+		return;
+	}
+	_standbyInput = GetOption(_sOptions, "standby", 0);
+	_stallEpochs = max(1, GetOption(_sOptions, "epochs", FAILOVER_STALL_EPOCHS));
+	_station = GetOption(_sOptions, "station", -1);
+	if (_station > 4095)
+		_station = -1;
+	LogX(" - Receiver failover to input %d after %d epochs, station %d", _standbyInput, _stallEpochs, _station);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Save the setting to the file
+void ReceiverFailover::Save(const char *options) const
+{
+	_myFiles.WriteFile("/Failover.txt", options);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Link to the ring of the standby receiver. Failover is off until this is set
+void ReceiverFailover::Setup(const RtcmFrameRing *pStandby)
+{
+	_pStandby = pStandby;
+	_standbyEpoch = pStandby->CurrentEpoch();
+
+	// Give the primary the same time to start as it would have to recover
+	_primaryEpochTime = millis();
+	_primaryFrameTime = _primaryEpochTime;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Called by the primary parser for each good frame to track its epochs.
+// .. Frames of an unfinished epoch are held and go into the output just ahead
+// .. of the frame that ends it
+// @return true if the frame should go to the casters now
+bool ReceiverFailover::TakePrimary(RtcmFrameRing &output, const byte *pFrame, int length, int type)
+{
+	if (_pStandby == nullptr || _noMsm)
+		return true;
+
+	unsigned long now = millis();
+	_primaryFrameTime = now;
+	if (_firstFrameTime == 0)
+		_firstFrameTime = now;
+
+	bool endOfEpoch = RtcmIsEndOfEpoch(pFrame, length, type);
+	if (endOfEpoch)
+	{
+		unsigned long gap = now - _primaryEpochTime;
+		if (_primaryEpochs++ > 0 && gap < FAILOVER_MAX_INTERVAL)
+			_epochInterval = _epochInterval == 0 ? gap : (_epochInterval * 7 + gap) / 8;
+
+		// Count regular epochs before trusting the primary again
+		if (_onStandby && !_returning)
+		{
+			_recoverEpochs = gap <= StallTime() ? _recoverEpochs + 1 : 0;
+			if (_recoverEpochs >= FAILOVER_RECOVER_EPOCHS)
+			{
+				LogX("Primary receiver back. Returning at the end of the standby epoch");
+				_returning = true;
+			}
+		}
+		_primaryEpochTime = now;
+	}
+	else if (_primaryEpochs == 0 && (now - _firstFrameTime) > FAILOVER_MSM_WAIT)
+	{
+		TurnOffNoMsm();
+		return true;
+	}
+
+	if (_onStandby)
+	{
+		_heldFrames++;
+		return false;
+	}
+
+	// After a return the primary joins at the start of its next epoch
+	if (!_primaryAligned)
+	{
+		_heldFrames++;
+		_primaryAligned = endOfEpoch;
+		return false;
+	}
+
+	// No epoch to hold till the first marker
+	if (_primaryEpochs == 0)
+		return true;
+	return Hold(output, pFrame, length, type, endOfEpoch);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Keep a primary frame till its epoch is complete. The end of the epoch lets
+// .. the held frames go then passes itself. An epoch too big to hold goes
+// .. on as it comes
+// @return true if the frame should go to the casters now
+bool ReceiverFailover::Hold(RtcmFrameRing &output, const byte *pFrame, int length, int type, bool endOfEpoch)
+{
+	if (endOfEpoch)
+	{
+		ReleaseHeld(output);
+		return true;
+	}
+	if (_holdCount >= FAILOVER_HOLD_FRAMES || _holdBytes + length > FAILOVER_HOLD_MAX)
+	{
+		_holdOverflows++;
+		ReleaseHeld(output);
+		return true;
+	}
+	memcpy(_hold + _holdBytes, pFrame, length);
+	_holdLength[_holdCount] = length;
+	_holdType[_holdCount] = type;
+	_holdCount++;
+	_holdBytes += length;
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Pass the held primary frames to the casters in the order they came
+void ReceiverFailover::ReleaseHeld(RtcmFrameRing &output)
+{
+	int offset = 0;
+	for (int n = 0; n < _holdCount; n++)
+	{
+		output.Add(_hold + offset, _holdLength[n], _holdType[n]);
+		offset += _holdLength[n];
+	}
+	_holdCount = 0;
+	_holdBytes = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// The primary sends frames but never ends an MSM epoch. Without epochs we
+// .. cannot switch cleanly so hand everything back to the primary
+void ReceiverFailover::TurnOffNoMsm()
+{
+	_noMsm = true;
+	if (_onStandby)
+	{
+		_onStandby = false;
+		_returning = false;
+		_returns++;
+		_standbyTotal += millis() - _switchTime;
+	}
+	LogX("E562 - Primary receiver sends no MSM end of epoch in %lus. Failover turned off", FAILOVER_MSM_WAIT / 1000);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loop called after the primary is read to check its health and pass on the
+// .. standby frames when it has stopped
+void ReceiverFailover::Loop(RtcmFrameRing &output)
+{
+	if (_pStandby == nullptr || _noMsm)
+		return;
+
+	unsigned long now = millis();
+	if (_pStandby->CurrentEpoch() != _standbyEpoch)
+	{
+		_standbyEpoch = _pStandby->CurrentEpoch();
+		_standbyEpochTime = now;
+	}
+	bool standbyGood = _standbyEpochTime != 0 && (now - _standbyEpochTime) <= StallTime();
+
+	if (!_onStandby)
+	{
+		// Until the primary shows it sends MSM any frame shows it is alive
+		unsigned long last = _primaryEpochs > 0 ? _primaryEpochTime : _primaryFrameTime;
+		if ((now - last) <= StallTime() || !standbyGood)
+			return;
+		SwitchToStandby();
+	}
+
+	// Nothing more is coming from the standby so hand straight back
+	if (_returning && !standbyGood)
+	{
+		_standbySeq = _pStandby->NextSeq();
+		_onStandby = false;
+		_returning = false;
+		_primaryAligned = false;
+		_returns++;
+		_standbyTotal += now - _switchTime;
+		LogX("Standby receiver silent. Returned to the primary");
+		return;
+	}
+
+	CopyStandby(output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stop the primary and start sending the standby from the first frame of the
+// .. epoch it is building now. The primary's unfinished epoch never went out
+// .. so it is dropped
+void ReceiverFailover::SwitchToStandby()
+{
+	if (_holdCount > 0)
+	{
+		LogX("Dropped %d primary frames of an unfinished epoch", _holdCount);
+		_droppedPartial += _holdCount;
+		_holdCount = 0;
+		_holdBytes = 0;
+	}
+
+	uint32_t seq = _pStandby->NextSeq();
+	while (seq > _pStandby->OldestSeq() && _pStandby->Get(seq - 1)->epoch == _pStandby->CurrentEpoch())
+		seq--;
+	_standbySeq = seq;
+
+	unsigned long now = millis();
+	_onStandby = true;
+	_returning = false;
+	_recoverEpochs = 0;
+	_switchTime = now;
+	_switches++;
+	_switchLatency = now - _primaryEpochTime;
+	_maxSwitchLatency = max(_maxSwitchLatency, _switchLatency);
+	LogX("E560 - Primary receiver silent for %lums. Switched to input %d", now - _primaryEpochTime, _standbyInput);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy the new standby frames to the casters. When the primary is back the
+// .. copy stops after the last frame of a standby epoch
+void ReceiverFailover::CopyStandby(RtcmFrameRing &output)
+{
+	if (_standbySeq < _pStandby->OldestSeq())
+		_standbySeq = _pStandby->OldestSeq();
+
+	for (; _standbySeq < _pStandby->NextSeq(); _standbySeq++)
+	{
+		const RtcmFrame *pFrame = _pStandby->Get(_standbySeq);
+		const byte *pData = pFrame->pData;
+		if (_station >= 0 && RtcmHasStationId(pFrame->type))
+		{
+			memcpy(_frame, pFrame->pData, pFrame->length);
+			RtcmSetStationId(_frame, pFrame->length, pFrame->type, _station);
+			pData = _frame;
+		}
+		output.Add(pData, pFrame->length, pFrame->type);
+		_standbyFrames++;
+
+		if (_returning && RtcmIsEndOfEpoch(pFrame->pData, pFrame->length, pFrame->type))
+		{
+			_standbySeq++;
+			_onStandby = false;
+			_returning = false;
+			_primaryAligned = false;
+			_returns++;
+			_standbyTotal += millis() - _switchTime;
+			LogX("Returned to the primary receiver after %lus on standby", (millis() - _switchTime) / 1000);
+			return;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Time without a primary epoch before we switch
+unsigned long ReceiverFailover::StallTime() const
+{
+	unsigned long interval = _epochInterval == 0 ? FAILOVER_DEFAULT_INTERVAL : _epochInterval;
+	return interval * _stallEpochs + FAILOVER_MARGIN;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Total time the output came from the standby (ms)
+unsigned long ReceiverFailover::GetTimeOnStandby() const
+{
+	return _standbyTotal + (_onStandby ? millis() - _switchTime : 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Where the output comes from for the status page
+std::string ReceiverFailover::GetStatus() const
+{
+	if (_pStandby == nullptr)
+		return "Off";
+	if (_noMsm)
+		return "Off (Primary has no MSM)";
+	if (_onStandby)
+		return _returning ? "Standby (Returning)" : "Standby";
+	return _primaryAligned ? "Primary" : "Primary (Aligning)";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write to the log tagged so the page for this failover can find it
+void ReceiverFailover::LogX(std::string text)
+{
+	Logln(text.c_str(), LOG_FAILOVER);
+}
@@ -0,0 +1,183 @@
+#include "RtcmUdpSender.h"
+
+#include <WiFi.h>
+
+#include "HandyLog.h"
+#include "HandyString.h"
+#include <MyFiles.h>
+
+extern MyFiles _myFiles;
+
+RtcmUdpSender::~RtcmUdpSender()
+{
+	if (_fd >= 0)
+		close(_fd);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Load the configuration if it exists
+void RtcmUdpSender::LoadSettings()
+{
+	if (!_myFiles.ReadFile("/UdpSender.txt", _sOptions))
+	{
+		LogX(" - UDP sender not configured");
+		return;
+	}
+	_sAddress = GetOption(_sOptions, "address", "255.255.255.255");
+	_port = GetOption(_sOptions, "port", 0);
+	_ttl = GetOption(_sOptions, "ttl", 1);
+	LogX(" - UDP sender %s : %d", _sAddress.c_str(), _port);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Save the setting to the file
+void RtcmUdpSender::Save(const char *options) const
+{
+	_myFiles.WriteFile("/UdpSender.txt", options);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loop called every pass to send any complete epochs
+void RtcmUdpSender::Loop(const RtcmFrameRing &ring)
+{
+	if (_port < 1)
+		return;
+	if (_fd < 0 && !Open())
+		return;
+
+	if (!_started)
+	{
+		_nextSeq = ring.NextSeq();
+		_started = true;
+	}
+
+	// Frames overwritten before we sent them
+	if (_nextSeq < ring.OldestSeq())
+	{
+		_droppedFrames += ring.OldestSeq() - _nextSeq;
+		_nextSeq = ring.OldestSeq();
+	}
+
+	while (SendNext(ring))
+		;
+
+	unsigned long now = millis();
+	if (now - _rateTime >= 1000)
+	{
+		_datagramRate = _rateDatagrams * 1000 / (now - _rateTime);
+		_byteRate = _rateBytes * 1000 / (now - _rateTime);
+		_rateDatagrams = 0;
+		_rateBytes = 0;
+		_rateTime = now;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Create the socket and allow it to reach the destination
+bool RtcmUdpSender::Open()
+{
+	memset(&_destination, 0, sizeof(_destination));
+	_destination.sin_family = AF_INET;
+	_destination.sin_port = htons(_port);
+	if (inet_aton(_sAddress.c_str(), &_destination.sin_addr) == 0)
+	{
+		LogX("E540 - UDP address '%s' not valid", _sAddress.c_str());
+		_port = 0;
+		return false;
+	}
+
+	_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (_fd < 0)
+	{
+		LogX("E541 - UDP socket failed %d", errno);
+		return false;
+	}
+	fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+
+	uint32_t address = ntohl(_destination.sin_addr.s_addr);
+	if ((address >> 28) == 0xE)
+	{
+		uint8_t ttl = _ttl;
+		setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+	}
+	else
+	{
+		int value = 1;
+		setsockopt(_fd, SOL_SOCKET, SO_BROADCAST, &value, sizeof(value));
+	}
+	LogX("UDP sending to %s : %d", _sAddress.c_str(), _port);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send one datagram of whole frames from a single epoch. An epoch still
+// .. arriving is held until it completes, the datagram is full or it has
+// .. waited UDP_HOLD_TIME
+// @return true if something was sent and there may be more
+bool RtcmUdpSender::SendNext(const RtcmFrameRing &ring)
+{
+	if (_nextSeq >= ring.NextSeq())
+		return false;
+
+	struct iovec views[UDP_VIEWS_MAX + 1];
+	byte header[UDP_HEADER_SIZE];
+	int count = 1;
+	int bytes = UDP_HEADER_SIZE;
+	const RtcmFrame *pFirst = ring.Get(_nextSeq);
+	uint32_t seq = _nextSeq;
+	for (; seq < ring.NextSeq() && count <= UDP_VIEWS_MAX; seq++)
+	{
+		const RtcmFrame *pFrame = ring.Get(seq);
+		if (pFrame->epoch != pFirst->epoch || bytes + pFrame->length > UDP_PAYLOAD_MAX)
+			break;
+		views[count].iov_base = (void *)pFrame->pData;
+		views[count].iov_len = pFrame->length;
+		bytes += pFrame->length;
+		count++;
+	}
+
+	// Anything after these frames means the datagram cannot grow
+	bool endOfEpoch = seq < ring.NextSeq() ? ring.Get(seq)->epoch != pFirst->epoch : pFirst->epoch < ring.CurrentEpoch();
+	bool full = seq < ring.NextSeq();
+	if (!full && !endOfEpoch && (millis() - pFirst->time) < UDP_HOLD_TIME)
+		return false;
+
+	header[0] = _sequence >> 24;
+	header[1] = _sequence >> 16;
+	header[2] = _sequence >> 8;
+	header[3] = _sequence;
+	header[4] = pFirst->epoch >> 8;
+	header[5] = pFirst->epoch;
+	header[6] = endOfEpoch ? UDP_FLAG_END_OF_EPOCH : 0;
+	header[7] = 1;
+	views[0].iov_base = header;
+	views[0].iov_len = UDP_HEADER_SIZE;
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_name = &_destination;
+	message.msg_namelen = sizeof(_destination);
+	message.msg_iov = views;
+	message.msg_iovlen = count;
+
+	// Sequence moves on even if the stack drops it so receivers see the loss
+	_sequence++;
+	_nextSeq = seq;
+	if (sendmsg(_fd, &message, 0) != bytes)
+	{
+		if (_sendErrors++ == 0)
+			LogX("E542 - UDP send failed %d", errno);
+		return false;
+	}
+	_bytesSent += bytes;
+	_rateDatagrams++;
+	_rateBytes += bytes;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write to the log tagged so the page for this sender can find it
+void RtcmUdpSender::LogX(std::string text)
+{
+	Logln(text.c_str(), LOG_UDP_SENDER);
+}
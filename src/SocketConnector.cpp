@@ -0,0 +1,299 @@
+#include "SocketConnector.h"
+
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "HandyString.h"
+
+SocketConnector::SocketConnector()
+{
+}
+
+SocketConnector::~SocketConnector()
+{
+	Cancel();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Set where to connect. Changing the host clears the address cache
+void SocketConnector::Setup(const std::string &host, int port, unsigned long dnsTtl)
+{
+	if (host != _host)
+		_addressCount = 0;
+	_host = host;
+	_port = port;
+	_dnsTtl = dnsTtl;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Start connecting to every address of the host. When the name has to be
+// .. looked up the connects start from Poll() once the lookup is done
+// @return false if nothing could be started
+bool SocketConnector::Start()
+{
+	Cancel();
+
+	// Use the cached addresses while they are fresh
+	if (_addressCount > 0 && (millis() - _resolvedAt) < _dnsTtl)
+	{
+		_cacheHits++;
+		return Connect();
+	}
+
+	// Dotted addresses need no lookup
+	struct in_addr address;
+	if (inet_aton(_host.c_str(), &address))
+	{
+		_addresses[0] = address.s_addr;
+		_addressCount = 1;
+		_resolvedAt = millis();
+		return Connect();
+	}
+	return StartResolve();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Start the lookup task. If one is still running (Or its result has not been
+// .. read) we wait for that instead
+bool SocketConnector::StartResolve()
+{
+	_resolving = true;
+	_resolveStart = millis();
+	if (_resolveState.load(std::memory_order_acquire) != RESOLVE_IDLE)
+		return true;
+
+	if (_host.length() >= RESOLVE_HOST_MAX)
+	{
+		_resolving = false;
+		_lastError = "Host name too long";
+		return false;
+	}
+	strcpy(_resolveHost, _host.c_str());
+	_resolveState.store(RESOLVE_BUSY, std::memory_order_release);
+	if (xTaskCreatePinnedToCore(ResolveTask, "Resolve", 4096, this, 1, NULL, APP_CPU_NUM) != pdPASS)
+	{
+		_resolveState.store(RESOLVE_IDLE, std::memory_order_release);
+		_resolving = false;
+		_lastError = "No lookup task";
+		return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Read the lookup result and start the connects
+// @return CONNECT_PENDING or CONNECT_FAILED
+int SocketConnector::TakeResolved()
+{
+	int state = _resolveState.load(std::memory_order_acquire);
+	if (state == RESOLVE_BUSY)
+	{
+		if ((millis() - _resolveStart) < RESOLVE_TIMEOUT)
+			return CONNECT_PENDING;
+		_resolving = false;
+		_lastError = "DNS timeout";
+		return CONNECT_FAILED;
+	}
+
+	_resolving = false;
+	_resolves++;
+	_resolveTime = _resolveMillis;
+	bool sameHost = _host == _resolveHost;
+	int count = _resolvedCount;
+	memcpy(_addresses, _resolved, sizeof(_addresses));
+	_resolveState.store(RESOLVE_IDLE, std::memory_order_release);
+
+	// The host changed while the old name was looked up
+	if (!sameHost)
+		return StartResolve() ? CONNECT_PENDING : CONNECT_FAILED;
+	if (count == 0)
+	{
+		_addressCount = 0;
+		_lastError = StringPrintf("DNS failed %d", _resolveResult);
+		return CONNECT_FAILED;
+	}
+	_addressCount = count;
+	_resolvedAt = millis();
+	return Connect() ? CONNECT_PENDING : CONNECT_FAILED;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Start a non-blocking connect to each address
+bool SocketConnector::Connect()
+{
+	_startTime = millis();
+	for (int n = 0; n < _addressCount; n++)
+	{
+		int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (fd < 0)
+			continue;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(_port);
+		address.sin_addr.s_addr = _addresses[n];
+		if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0 && errno != EINPROGRESS)
+		{
+			_lastError = StringPrintf("Connect errno %d", errno);
+			close(fd);
+			continue;
+		}
+		_fds[_fdCount++] = fd;
+	}
+	return _fdCount > 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Check the connect attempts without waiting
+// @return The connected socket, CONNECT_PENDING or CONNECT_FAILED
+int SocketConnector::Poll()
+{
+	if (_resolving)
+		return TakeResolved();
+	if (_fdCount < 1)
+		return CONNECT_FAILED;
+
+	fd_set writeSet;
+	FD_ZERO(&writeSet);
+	int maxFd = 0;
+	for (int n = 0; n < _fdCount; n++)
+	{
+		FD_SET(_fds[n], &writeSet);
+		maxFd = max(maxFd, _fds[n]);
+	}
+	struct timeval tv = {0, 0};
+	if (select(maxFd + 1, NULL, &writeSet, NULL, &tv) > 0)
+	{
+		for (int n = 0; n < _fdCount; n++)
+		{
+			int fd = _fds[n];
+			if (!FD_ISSET(fd, &writeSet))
+				continue;
+
+			int error = 0;
+			socklen_t length = sizeof(error);
+			getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+			if (error == 0)
+			{
+				// Winner. Back to blocking as WiFiClient::connect() would leave it
+				CloseAll(fd);
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+				return fd;
+			}
+
+			// This address refused. Keep waiting on the others
+			_lastError = StringPrintf("Connect errno %d", error);
+			close(fd);
+			_fds[n--] = _fds[--_fdCount];
+		}
+	}
+
+	if (_fdCount > 0 && (millis() - _startTime) < CONNECT_TIMEOUT)
+		return CONNECT_PENDING;
+
+	if (_fdCount > 0)
+		_lastError = "Timeout";
+
+	// Everything failed so look the host up again next time
+	CloseAll(-1);
+	_addressCount = 0;
+	return CONNECT_FAILED;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Abandon any connections in progress. A running lookup finishes on its own
+// .. and is read by the next Start()
+void SocketConnector::Cancel()
+{
+	CloseAll(-1);
+	_resolving = false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Check an idle socket has not been closed by the other end
+bool SocketConnector::IsAlive(int fd)
+{
+	if (fd < 0)
+		return false;
+	byte b;
+	int result = recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (result > 0)
+		return true;
+	if (result == 0)
+		return false;
+	return errno == EWOULDBLOCK || errno == EAGAIN;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Probe an idle connection so a half-open caster is found in seconds rather
+// .. than the two hours lwip would wait by default. Only for a socket that
+// .. sends nothing. Probes never go while data is unacknowledged so a
+// .. streaming socket is left to NTRIPServer::CheckStall
+void SocketConnector::SetKeepAlive(int fd)
+{
+	if (fd < 0)
+		return;
+	int value = 1;
+	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &value, sizeof(value));
+	value = KEEPALIVE_IDLE;
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &value, sizeof(value));
+	value = KEEPALIVE_INTERVAL;
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &value, sizeof(value));
+	value = KEEPALIVE_COUNT;
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &value, sizeof(value));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Lookup task. Runs once and deletes itself
+void SocketConnector::ResolveTask(void *param)
+{
+	static_cast<SocketConnector *>(param)->Resolve();
+	vTaskDelete(NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Look up the host addresses. Runs on the lookup task so only touches the
+// .. shared members then marks them ready
+void SocketConnector::Resolve()
+{
+	unsigned long start = millis();
+	_resolvedCount = 0;
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *pResult = NULL;
+	_resolveResult = getaddrinfo(_resolveHost, NULL, &hints, &pResult);
+	if (_resolveResult == 0 && pResult != NULL)
+	{
+		for (struct addrinfo *p = pResult; p != NULL && _resolvedCount < CONNECTOR_MAX_ADDRESSES; p = p->ai_next)
+		{
+			uint32_t address = ((struct sockaddr_in *)p->ai_addr)->sin_addr.s_addr;
+			bool duplicate = false;
+			for (int n = 0; n < _resolvedCount; n++)
+				duplicate |= _resolved[n] == address;
+			if (!duplicate)
+				_resolved[_resolvedCount++] = address;
+		}
+		freeaddrinfo(pResult);
+	}
+	_resolveMillis = millis() - start;
+	_resolveState.store(RESOLVE_DONE, std::memory_order_release);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Close the sockets in progress except the one we are keeping
+void SocketConnector::CloseAll(int keepFd)
+{
+	for (int n = 0; n < _fdCount; n++)
+	{
+		if (_fds[n] != keepFd)
+			close(_fds[n]);
+	}
+	_fdCount = 0;
+}
@@ -0,0 +1,186 @@
+#include "SyslogSender.h"
+
+#include "HandyLog.h"
+#include "HandyString.h"
+#include <MyFiles.h>
+
+extern MyFiles _myFiles;
+
+SyslogSender::~SyslogSender()
+{
+	if (_fd >= 0)
+		close(_fd);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Load the configuration if it exists
+void SyslogSender::LoadSettings()
+{
+	if (!_myFiles.ReadFile("/Syslog.txt", _sOptions))
+	{
+		Logln(" - Syslog not configured");
+		return;
+	}
+	_sAddress = GetOption(_sOptions, "address", "");
+	_port = _sAddress.empty() ? 0 : GetOption(_sOptions, "port", 514);
+	_interval = max(1, GetOption(_sOptions, "interval", SYSLOG_DEFAULT_INTERVAL)) * 1000UL;
+	_metricsInterval = max(0, GetOption(_sOptions, "metrics", 0)) * 1000UL;
+	Logf(" - Syslog to %s : %d every %lus", _sAddress.c_str(), _port, _interval / 1000);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Save the setting to the file
+void SyslogSender::Save(const char *options) const
+{
+	_myFiles.WriteFile("/Syslog.txt", options);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Set the name the collector files us under and where the metrics come from
+void SyslogSender::Setup(const char *hostName, std::function<void(TextBuilder &params)> metrics)
+{
+	_sHost = (hostName == nullptr || *hostName == '\0') ? "-" : hostName;
+	_metrics = metrics;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loop called every pass. Sends what has built up once per interval
+void SyslogSender::Loop()
+{
+	if (_port < 1)
+		return;
+	unsigned long now = millis();
+	if ((now - _lastSend) < _interval)
+		return;
+	_lastSend = now;
+	if (_fd < 0 && !Open())
+		return;
+
+	if (_metricsInterval > 0 && (now - _lastMetrics) >= _metricsInterval)
+	{
+		_lastMetrics = now;
+		SendMetrics();
+	}
+	for (int n = 0; n < SYSLOG_BURST_MAX && SendLog(); n++)
+		;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Create the socket
+bool SyslogSender::Open()
+{
+	memset(&_destination, 0, sizeof(_destination));
+	_destination.sin_family = AF_INET;
+	_destination.sin_port = htons(_port);
+	if (inet_aton(_sAddress.c_str(), &_destination.sin_addr) == 0)
+	{
+		Logf("E543 - Syslog address '%s' not valid", _sAddress.c_str());
+		_port = 0;
+		return false;
+	}
+
+	_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (_fd < 0)
+	{
+		Logf("E544 - Syslog socket failed %d", errno);
+		return false;
+	}
+	fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+	Logf("Syslog sending to %s : %d", _sAddress.c_str(), _port);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Pack the next log records into one datagram. Records only count as sent
+// .. once the stack takes the datagram, so a busy link holds them in the log
+// .. until they are pushed out by newer ones
+// @return true if something was sent and there may be more
+bool SyslogSender::SendLog()
+{
+	const LogRing<LOG_ARENA_SIZE> &log = GetLog();
+	if (_nextSeq < log.OldestSeq())
+	{
+		_lost += log.OldestSeq() - _nextSeq;
+		_nextSeq = log.OldestSeq();
+	}
+	if (_nextSeq >= log.NextSeq())
+		return false;
+
+	// Lines go after the room for the header, which needs the worst severity
+	char *pBody = _datagram + SYSLOG_HEADER_MAX;
+	const int room = SYSLOG_PAYLOAD_MAX - SYSLOG_HEADER_MAX;
+	int length = 0;
+	int count = 0;
+	int severity = 6;
+	uint32_t next = _nextSeq;
+	bool full = false;
+	log.ForEach(LOG_ALL, [&](const LogRecord &record)
+				{
+		if (full)
+			return;
+		TextBuilder line(_line, sizeof(_line));
+		line.Append('[').Append(LogSourceName(record.source)).Append("] ");
+		int n = line.Length() + LogRender(record, _line + line.Length(), sizeof(_line) - line.Length());
+		if (length + n + 1 > room)
+		{
+			if (count > 0)
+			{
+				full = true;
+				return;
+			}
+			n = room - 1;
+		}
+		if (count++ > 0)
+			pBody[length++] = '\n';
+		memcpy(pBody + length, _line, n);
+		length += n;
+		next = record.seq + 1;
+
+		char code[5];
+		if (LogLimiter::CodeOf(record.Message(), code))
+			severity = min(severity, code[0] == 'E' ? 3 : 4); }, _nextSeq);
+
+	FixedText<SYSLOG_HEADER_MAX> header;
+	header.Append('<').AppendUnsigned(SYSLOG_FACILITY * 8 + severity).Append(">1 - ").Append(_sHost.c_str());
+	header.Append(" ntrip-server - LOG [log@" SYSLOG_SD_PEN " seq=\"").AppendUnsigned(_nextSeq);
+	header.Append("\" count=\"").AppendSigned(count).Append("\" lost=\"").AppendUnsigned(_lost).Append("\"] ");
+	char *pStart = pBody - header.Length();
+	memcpy(pStart, header.c_str(), header.Length());
+	if (!Send(pStart, header.Length() + length))
+		return false;
+	_recordsSent += count;
+	_nextSeq = next;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send the metrics as structured data
+void SyslogSender::SendMetrics()
+{
+	// Built in place. One byte is held back for the closing ']'
+	TextBuilder metrics(_datagram, sizeof(_datagram) - 1);
+	metrics.Append('<').AppendUnsigned(SYSLOG_FACILITY * 8 + 6).Append(">1 - ").Append(_sHost.c_str());
+	metrics.Append(" ntrip-server - METRICS [metrics@" SYSLOG_SD_PEN " uptime=\"").AppendUnsigned(millis() / 1000);
+	metrics.Append("\" heap=\"").AppendUnsigned(ESP.getFreeHeap()).Append("\" logLost=\"").AppendUnsigned(_lost).Append('"');
+	if (_metrics)
+		_metrics(metrics);
+	int length = metrics.Length();
+	_datagram[length++] = ']';
+	Send(_datagram, length);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Hand a datagram to the stack without waiting
+// @return false if it was refused
+bool SyslogSender::Send(const char *pData, int length)
+{
+	if (sendto(_fd, pData, length, 0, (struct sockaddr *)&_destination, sizeof(_destination)) != length)
+	{
+		if (_sendErrors++ == 0)
+			Logf("E545 - Syslog send failed %d", errno);
+		return false;
+	}
+	_datagrams++;
+	_bytesSent += length;
+	return true;
+}
@@ -0,0 +1,155 @@
+#include "TextBuilder.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Each number from 00 to 99 as two characters so integers are converted two
+// .. digits for each divide
+static const char _digitPairs[201] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const char _hexDigits[] = "0123456789abcdef";
+
+///////////////////////////////////////////////////////////////////////////////
+// Write the digits of a value backwards ending at pEnd
+// @return Where the first digit is
+static char *Digits(char *pEnd, uint64_t value)
+{
+	// 64 bit divides are slow on the ESP32 so only use them for the top digits
+	while (value > 0xFFFFFFFF)
+	{
+		uint64_t quotient = value / 100;
+		pEnd -= 2;
+		memcpy(pEnd, _digitPairs + 2 * (int)(value - quotient * 100), 2);
+		value = quotient;
+	}
+	uint32_t v = (uint32_t)value;
+	while (v >= 100)
+	{
+		uint32_t quotient = v / 100;
+		pEnd -= 2;
+		memcpy(pEnd, _digitPairs + 2 * (v - quotient * 100), 2);
+		v = quotient;
+	}
+	if (v >= 10)
+	{
+		pEnd -= 2;
+		memcpy(pEnd, _digitPairs + 2 * v, 2);
+	}
+	else
+	{
+		*--pEnd = '0' + v;
+	}
+	return pEnd;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy finished text to the caller cut to fit
+static int CopyOut(char *pOut, int size, const char *pText, int length)
+{
+	if (size <= 0)
+		return 0;
+	length = min(length, size - 1);
+	memcpy(pOut, pText, length);
+	pOut[length] = '\0';
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decimal text of a number
+// @return 1234567
+int FormatUnsigned(char *pOut, int size, uint64_t value)
+{
+	char text[TEXT_INTEGER_MAX];
+	char *pEnd = text + sizeof(text);
+	char *pStart = Digits(pEnd, value);
+	return CopyOut(pOut, size, pStart, pEnd - pStart);
+}
+
+int FormatSigned(char *pOut, int size, int64_t value)
+{
+	char text[TEXT_INTEGER_MAX];
+	char *pEnd = text + sizeof(text);
+	char *pStart = Digits(pEnd, value < 0 ? 0 - (uint64_t)value : (uint64_t)value);
+	if (value < 0)
+		*--pStart = '-';
+	return CopyOut(pOut, size, pStart, pEnd - pStart);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decimal text with thousand separators
+// @return 1,234,567
+int FormatThousands(char *pOut, int size, int64_t value)
+{
+	char digits[TEXT_INTEGER_MAX];
+	char *pEnd = digits + sizeof(digits);
+	char *pDigit = Digits(pEnd, value < 0 ? 0 - (uint64_t)value : (uint64_t)value);
+	int count = pEnd - pDigit;
+
+	char text[TEXT_INTEGER_MAX + 6];
+	int length = 0;
+	if (value < 0)
+		text[length++] = '-';
+	for (int n = count; n > 0; n--)
+	{
+		text[length++] = *pDigit++;
+		if (n > 1 && (n - 1) % 3 == 0)
+			text[length++] = ',';
+	}
+	return CopyOut(pOut, size, text, length);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Bytes as two hex digits each, followed by the separator unless it is '\0'.
+// .. Only whole bytes are written
+// @return "00 01 fe "
+int FormatHex(char *pOut, int size, const byte *pData, int length, char separator)
+{
+	if (size <= 0)
+		return 0;
+	int step = separator == '\0' ? 2 : 3;
+	char *p = pOut;
+	length = max(0, min(length, (size - 1) / step));
+	for (int n = 0; n < length; n++)
+	{
+		p[0] = _hexDigits[pData[n] >> 4];
+		p[1] = _hexDigits[pData[n] & 0x0F];
+		if (separator != '\0')
+			p[2] = separator;
+		p += step;
+	}
+	*p = '\0';
+	return p - pOut;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Time since boot as days then hours, minutes, seconds and milliseconds
+// @return "2 03:04:05.678"
+int FormatUptime(char *pOut, int size, unsigned long millis)
+{
+	uint32_t t = millis / 1000;
+	uint32_t ms = millis % 1000;
+	char text[TEXT_UPTIME_MAX];
+	char *pEnd = text + sizeof(text);
+	char *p = pEnd;
+
+	p -= 2;
+	memcpy(p, _digitPairs + 2 * (ms % 100), 2);
+	*--p = '0' + ms / 100;
+	*--p = '.';
+	p -= 2;
+	memcpy(p, _digitPairs + 2 * (t % 60), 2);
+	*--p = ':';
+	t /= 60;
+	p -= 2;
+	memcpy(p, _digitPairs + 2 * (t % 60), 2);
+	*--p = ':';
+	t /= 60;
+	p -= 2;
+	memcpy(p, _digitPairs + 2 * (t % 24), 2);
+	*--p = ' ';
+	p = Digits(p, t / 24);
+	return CopyOut(pOut, size, p, pEnd - p);
+}
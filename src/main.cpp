@@ -33,7 +33,14 @@
 #include "HandyString.h"
 #include "GpsParser.h"
 #include "NTRIPServer.h"
+#include "LocalCaster.h"
+#include "RawRtcmServer.h"
+#include "RtcmUdpSender.h"
+#include "ReceiverFailover.h"
+#include "NtripClientInput.h"
 #include "MyFiles.h"
+#include "LogStore.h"
+#include "SyslogSender.h"
 #include <WebPortal.h>
 #include "WifiBusyTask.h"
 
@@ -49,10 +56,20 @@ uint8_t _button1Current = HIGH; // Top button on left
 uint8_t _button2Current = HIGH; // Bottom button when
 
 MyFiles _myFiles;
-GpsParser _gpsParser;
+GpsParser _gpsParser(1, Serial1);
+#ifdef GPS2_SERIAL
+GpsParser _gpsParser2(2, GPS2_SERIAL);
+#endif
 NTRIPServer _ntripServer0(0);
 NTRIPServer _ntripServer1(1);
 NTRIPServer _ntripServer2(2);
+LocalCaster _localCaster;
+RawRtcmServer _rawServer;
+RtcmUdpSender _udpSender;
+ReceiverFailover _failover;
+NtripClientInput _ntripInput;
+LogStore _logStore;
+SyslogSender _syslog;
 
 // WiFi monitoring states
 #define WIFI_STARTUP_TIMEOUT 20000
@@ -92,15 +109,57 @@ void setup(void)
 
 	// Verify file IO (This can take up tpo 60s is SPIFFs not initialised)
 	if (_myFiles.Setup())
+	{
 		Logln("Test file IO");
+		_logStore.Setup();
+	}
 	else
+	{
 		Logln("E100 - File IO failed");
+	}
 
 	// Load the NTRIP server settings
 	_ntripServer0.LoadSettings();
 	_ntripServer1.LoadSettings();
 	_ntripServer2.LoadSettings();
-	_gpsParser.Setup(&_ntripServer0, &_ntripServer1, &_ntripServer2);
+	_localCaster.LoadSettings();
+	_rawServer.LoadSettings();
+	_udpSender.LoadSettings();
+	_ntripInput.LoadSettings();
+	_failover.LoadSettings();
+	_syslog.LoadSettings();
+
+	// Bind each caster to the receiver feeding it
+	for (NTRIPServer *pServer : {&_ntripServer0, &_ntripServer1, &_ntripServer2})
+	{
+#ifdef GPS2_SERIAL
+		if (pServer->GetInput() == 2)
+		{
+			_gpsParser2.AddServer(pServer);
+			continue;
+		}
+#endif
+		_gpsParser.AddServer(pServer);
+	}
+
+#ifdef GPS2_SERIAL
+	// Second receiver as a hot standby for the first
+	if (_failover.GetStandbyInput() == 2)
+	{
+		_failover.Setup(&_gpsParser2.GetFrameRing());
+		_gpsParser.SetFailover(&_failover);
+	}
+
+	// Second receiver only when a caster or the failover uses it
+	if (_gpsParser2.HasServers() || _failover.IsEnabled())
+	{
+		Logf("GPS 2 Buffer size %d", GPS2_SERIAL.setRxBufferSize(GPS_BUFFER_SIZE));
+		GPS2_SERIAL.begin(115200, SERIAL_8N1, GPS2_RX_PIN, GPS2_TX_PIN);
+	}
+#else
+	if (_failover.IsEnabled())
+		Logln("E561 - Receiver failover needs a second UART");
+#endif
 
 //	// _display.Setup();
 	Logf("Display type %d", USER_SETUP_ID);
@@ -110,6 +169,21 @@ void setup(void)
 
 	// Setup host name to have RTK_ prefix
 	WiFi.setHostname(MakeHostName().c_str());
+	_syslog.Setup(MakeHostName().c_str(), [](TextBuilder &params)
+				  {
+		int n = 1;
+		for (NTRIPServer *pServer : {&_ntripServer0, &_ntripServer1, &_ntripServer2})
+		{
+			if (pServer->GetAddress().empty())
+			{
+				n++;
+				continue;
+			}
+			params.Printf(" caster%d=\"%s\" caster%dAge=\"%lu\" caster%dReconnects=\"%d\" caster%dPackets=\"%d\"",
+						  n, pServer->GetStatus(), n, pServer->GetCorrectionAge(), n, pServer->GetReconnects(), n, pServer->GetPacketsSent());
+			n++;
+		}
+		params.Printf(" gpsReadErrors=\"%d\"", _gpsParser.GetReadErrorCount()); });
 	// _display.RefreshScreen();
 
 	// Block here till we have WiFi credentials (good or bad)
@@ -136,6 +210,9 @@ void setup(void)
 // Loop here
 void loop()
 {
+	// Pick up messages logged by other tasks
+	LogDrain();
+
 	// Trigger something every second
 	int t = millis();
 	_loopPersSecondCount++;
@@ -144,6 +221,7 @@ void loop()
 		_loopWaitTime = t;
 		// _display.SetLoopsPerSecond(_loopPersSecondCount, t);
 		_loopPersSecondCount = 0;
+		LogFlushSuppressed();
 	}
 
 	// Check for push buttons
@@ -166,10 +244,27 @@ void loop()
 	digitalWrite(DISPLAY_POWER_PIN, ((t - _lastButtonPress) < 30000) ? HIGH : LOW);
 #endif
 
-	// Check for new data GPS serial data
+	// Check for new data GPS serial data (Or the upstream caster when relaying)
 	if (IsWifiConnected())
 	{
-		// _display.SetGpsConnected(_gpsParser.ReadDataFromSerial(Serial1));
+#ifdef GPS2_SERIAL
+		// Standby first so its latest epoch is ready if the primary has stopped
+		if (_gpsParser2.HasServers() || _failover.IsEnabled())
+			_gpsParser2.ReadDataFromSerial(GPS2_SERIAL);
+#endif
+		if (_ntripInput.IsEnabled())
+		{
+			_ntripInput.Loop();
+			_gpsParser.ReadDataFromSerial(_ntripInput);
+		}
+		else
+		{
+			_gpsParser.ReadDataFromSerial(Serial1);
+		}
+		_localCaster.Loop(_gpsParser.GetFrameRing());
+		_rawServer.Loop(_gpsParser.GetFrameRing());
+		_udpSender.Loop(_gpsParser.GetFrameRing());
+		_syslog.Loop();
 		_webPortal.Loop();
 	}
 	else
@@ -177,6 +272,9 @@ void loop()
 		// _display.SetGpsConnected(false);
 	}
 
+	// Save the log once the data has been moved
+	_logStore.Loop();
+
 	// Update animations
 	// _display.Animate();
 }
@@ -0,0 +1,440 @@
+#!/usr/bin/env python3
+###############################################################################
+# Stand-in NTRIP caster used to check the uplink of the ESP32 before pointing
+# .. it at a real caster. Accepts one source at a time using NTRIP v1
+# .. (SOURCE) or NTRIP v2 (POST with chunked transfer) and checks what
+# .. arrives
+#	- Each v2 chunk has a valid hex length line and ends in CRLF
+#	- Each chunk holds whole RTCM frames (No frame split across chunks)
+#	- Every frame passes its CRC24Q
+# .. One line is printed per chunk (or per read for v1) and a summary when the
+# .. source disconnects.
+#
+# It also stands in as the upstream caster for NtripClientInput. A GET for
+# .. a mount point is answered with one epoch of RTCM frames per --interval,
+# .. chunked for NTRIP v2 and raw for v1. The chunk lines and frames are
+# .. cut across TCP segments at odd places to exercise the decoding.
+# .. GET / returns a source table
+#
+#	python3 test/caster_standin.py --port 2101 --password secret
+#	python3 test/caster_standin.py --self-test
+#
+# Point a caster at this machine with options v2=1 (or without for v1), or
+# .. the upstream input at it with host=<this machine> port=2101 mount=TEST
+###############################################################################
+import argparse
+import socket
+import sys
+import threading
+import time
+import base64
+
+
+def Crc24q(data):
+	crc = 0
+	for b in data:
+		crc ^= b << 16
+		for _ in range(8):
+			crc <<= 1
+			if crc & 0x1000000:
+				crc ^= 0x1864CFB
+	return crc & 0xFFFFFF
+
+
+def MakeFrame(msgType, payloadLength):
+	payload = bytes([(msgType >> 4) & 0xFF, (msgType & 0x0F) << 4]) + bytes((n * 7) & 0xFF for n in range(payloadLength - 2))
+	frame = bytes([0xD3, (len(payload) >> 8) & 0x03, len(payload) & 0xFF]) + payload
+	return frame + Crc24q(frame).to_bytes(3, 'big')
+
+
+###############################################################################
+# Splits a byte stream into RTCM frames and counts what is wrong with it
+class RtcmChecker:
+	def __init__(self):
+		self.buffer = b''
+		self.frames = 0
+		self.badCrc = 0
+		self.skipped = 0
+		self.types = {}
+
+	# Add bytes and return the frames completed
+	def Add(self, data):
+		self.buffer += data
+		found = []
+		while len(self.buffer) >= 6:
+			if self.buffer[0] != 0xD3:
+				self.buffer = self.buffer[1:]
+				self.skipped += 1
+				continue
+			length = ((self.buffer[1] & 0x03) << 8) | self.buffer[2]
+			if len(self.buffer) < length + 6:
+				break
+			frame = self.buffer[:length + 6]
+			self.buffer = self.buffer[length + 6:]
+			if Crc24q(frame[:-3]) != int.from_bytes(frame[-3:], 'big'):
+				self.badCrc += 1
+				self.buffer = frame[1:] + self.buffer
+				self.skipped += 1
+				continue
+			msgType = (frame[3] << 4) | (frame[4] >> 4)
+			self.types[msgType] = self.types.get(msgType, 0) + 1
+			self.frames += 1
+			found.append(msgType)
+		return found
+
+	# Bytes left over that do not make a whole frame
+	def Partial(self):
+		return len(self.buffer)
+
+
+###############################################################################
+# Reads HTTP chunked transfer coding strictly
+class ChunkReader:
+	def __init__(self, connection):
+		self.connection = connection
+		self.pending = b''
+
+	def ReadExact(self, count):
+		while len(self.pending) < count:
+			data = self.connection.recv(4096)
+			if not data:
+				raise EOFError()
+			self.pending += data
+		result = self.pending[:count]
+		self.pending = self.pending[count:]
+		return result
+
+	def ReadLine(self):
+		while b'\r\n' not in self.pending:
+			if len(self.pending) > 64:
+				raise ValueError('Chunk length line too long %r' % self.pending[:64])
+			data = self.connection.recv(4096)
+			if not data:
+				raise EOFError()
+			self.pending += data
+		line, self.pending = self.pending.split(b'\r\n', 1)
+		return line
+
+	# @return The chunk data or None at the zero length chunk
+	def Next(self):
+		line = self.ReadLine()
+		try:
+			size = int(line.split(b';')[0], 16)
+		except ValueError:
+			raise ValueError('Bad chunk length line %r' % line)
+		if size == 0:
+			return None
+		data = self.ReadExact(size)
+		if self.ReadExact(2) != b'\r\n':
+			raise ValueError('Chunk of %d bytes not followed by CRLF' % size)
+		return data
+
+
+def ReadHeaders(connection):
+	data = b''
+	while b'\r\n\r\n' not in data:
+		more = connection.recv(1024)
+		if not more:
+			raise EOFError()
+		data += more
+		if len(data) > 4096:
+			raise ValueError('Request headers too long')
+	head, rest = data.split(b'\r\n\r\n', 1)
+	lines = head.decode('latin-1').split('\r\n')
+	headers = {}
+	for line in lines[1:]:
+		if ':' in line:
+			key, value = line.split(':', 1)
+			headers[key.strip().lower()] = value.strip()
+	return lines[0], headers, rest
+
+
+# The frames of one epoch as the ESP32 would send them
+def EpochFrames(epoch):
+	frames = MakeFrame(1077, 400) + MakeFrame(1087, 300) + MakeFrame(1097, 250) + MakeFrame(1127, 200)
+	if epoch % 5 == 0:
+		frames += MakeFrame(1005, 19) + MakeFrame(1033, 40)
+	return frames
+
+
+# Frames in that many epochs
+def EpochFrameCount(epochs):
+	return epochs * 4 + ((epochs + 4) // 5) * 2
+
+
+# Send with the TCP segments cut at odd places so chunk lines and frames
+# .. arrive split
+def SendSplit(connection, data):
+	connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+	n = 0
+	step = 1
+	while n < len(data):
+		connection.sendall(data[n:n + step])
+		n += step
+		step = step * 3 % 97 + 1
+
+
+###############################################################################
+# Answer a rover or NtripClientInput. Any mount point but / gets RTCM
+# @param epochs Number to send before closing (None = until disconnected)
+def ServeRtcm(connection, address, path, headers, password, log, epochs, interval):
+	v2 = headers.get('ntrip-version', '') == 'Ntrip/2.0'
+	mount = path.lstrip('/')
+	if mount == '':
+		table = b'STR;TEST;TEST;RTCM 3.3;;2;GPS+GLO+GAL+BDS;NONE;XXX;0.00;0.00;0;0;caster_standin;none;B;N;0;\r\nENDSOURCETABLE\r\n'
+		if v2:
+			connection.sendall(b'HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nContent-Type: gnss/sourcetable\r\nContent-Length: %d\r\nConnection: close\r\n\r\n' % len(table) + table)
+		else:
+			connection.sendall(b'SOURCETABLE 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n\r\n' % len(table) + table)
+		log('%s source table' % address[0])
+		return
+
+	auth = headers.get('authorization', '')
+	if password is not None:
+		user, _, given = base64.b64decode(auth[6:]).decode('latin-1').partition(':') if auth.startswith('Basic ') else ('', '', '')
+		if given != password:
+			connection.sendall(b'HTTP/1.1 401 Unauthorized\r\nNtrip-Version: Ntrip/2.0\r\n\r\n' if v2 else b'ERROR - Bad Password\r\n')
+			log('%s bad password' % address[0])
+			return
+	if v2:
+		connection.sendall(b'HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nContent-Type: gnss/data\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n')
+	else:
+		connection.sendall(b'ICY 200 OK\r\n')
+	log('%s streaming /%s (NTRIP v%d)' % (address[0], mount, 2 if v2 else 1))
+
+	# Take and drop whatever the client sends (GGA)
+	connection.settimeout(0)
+	epoch = 0
+	sent = 0
+	try:
+		while epochs is None or epoch < epochs:
+			frames = EpochFrames(epoch)
+			SendSplit(connection, (b'%X\r\n' % len(frames) + frames + b'\r\n') if v2 else frames)
+			sent += len(frames)
+			epoch += 1
+			try:
+				if connection.recv(4096) == b'':
+					break
+			except BlockingIOError:
+				pass
+			time.sleep(interval)
+		if v2:
+			connection.sendall(b'0\r\n\r\n')
+	except OSError:
+		pass
+	log('%s stream closed after %d epochs and %d bytes' % (address[0], epoch, sent))
+
+
+###############################################################################
+# Serve one source connection, or a GET with ServeRtcm
+# @return Summary dictionary for the self test
+def ServeSource(connection, address, password, log, epochs=None, interval=1.0):
+	summary = {'chunks': 0, 'errors': [], 'frames': 0, 'badCrc': 0, 'split': 0}
+	checker = RtcmChecker()
+	start = time.time()
+	rover = False
+	try:
+		request, headers, rest = ReadHeaders(connection)
+		log('%s %s' % (address[0], request))
+		parts = request.split(' ')
+		if parts[0] == 'SOURCE':
+			if password is not None and parts[1] != password:
+				connection.sendall(b'ERROR - Bad Password\r\n')
+				return summary
+			connection.sendall(b'ICY 200 OK\r\n')
+			checker.Add(rest)
+			while True:
+				data = connection.recv(4096)
+				if not data:
+					break
+				types = checker.Add(data)
+				log('  read %5d bytes %2d frames %s' % (len(data), len(types), types))
+		elif parts[0] == 'POST':
+			auth = headers.get('authorization', '')
+			if password is not None:
+				user, _, given = base64.b64decode(auth[6:]).decode('latin-1').partition(':') if auth.startswith('Basic ') else ('', '', '')
+				if given != password:
+					connection.sendall(b'HTTP/1.1 401 Unauthorized\r\n\r\n')
+					return summary
+			if headers.get('transfer-encoding', '').lower() != 'chunked':
+				summary['errors'].append('POST without chunked transfer encoding')
+			if headers.get('ntrip-version', '') != 'Ntrip/2.0':
+				summary['errors'].append('Missing Ntrip-Version: Ntrip/2.0')
+			connection.sendall(b'HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\n\r\n')
+			reader = ChunkReader(connection)
+			reader.pending = rest
+			while True:
+				chunk = reader.Next()
+				if chunk is None:
+					break
+				summary['chunks'] += 1
+				types = checker.Add(chunk)
+				if checker.Partial() > 0:
+					summary['split'] += 1
+					summary['errors'].append('Chunk %d ends inside a frame (%d bytes over)' % (summary['chunks'], checker.Partial()))
+				log('  chunk %4d %5d bytes %2d frames %s' % (summary['chunks'], len(chunk), len(types), types))
+		elif parts[0] == 'GET':
+			rover = True
+			ServeRtcm(connection, address, parts[1], headers, password, log, epochs, interval)
+		else:
+			connection.sendall(b'HTTP/1.1 400 Bad Request\r\n\r\n')
+			summary['errors'].append('Unknown request %r' % request)
+	except EOFError:
+		pass
+	except (ValueError, OSError) as error:
+		summary['errors'].append(str(error))
+	finally:
+		connection.close()
+	if rover:
+		return summary
+
+	summary['frames'] = checker.frames
+	summary['badCrc'] = checker.badCrc
+	elapsed = max(time.time() - start, 0.001)
+	log('%s closed after %.1fs. %d chunks, %d frames, %d bad CRC, %d skipped bytes, types %s' %
+		(address[0], elapsed, summary['chunks'], checker.frames, checker.badCrc, checker.skipped, checker.types))
+	for error in summary['errors']:
+		log('  ERROR %s' % error)
+	return summary
+
+
+# Sources and rovers each on their own thread so a rover can read while a
+# .. source is checked
+def Serve(port, password, interval):
+	listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+	listener.bind(('', port))
+	listener.listen(4)
+	print('Stand-in caster on port %d' % port)
+	while True:
+		connection, address = listener.accept()
+		threading.Thread(target=ServeSource, args=(connection, address, password, print, None, interval), daemon=True).start()
+
+
+###############################################################################
+# A v2 source written the way the ESP32 writes it. Each epoch goes as one
+# .. chunk
+# @return The bytes to send and the frames the caster should find
+def TestStream(epochs):
+	stream = b''
+	for epoch in range(epochs):
+		frames = EpochFrames(epoch)
+		stream += ('%X\r\n' % len(frames)).encode() + frames + b'\r\n'
+	stream += b'0\r\n\r\n'
+	return stream, EpochFrameCount(epochs)
+
+
+# Log in as a v2 source and send the stream with the TCP segments cut at
+# .. odd places so chunk lines and frames arrive split
+# @return False if the caster did not accept
+def SendTestSource(client, stream, password='secret'):
+	auth = base64.b64encode(('MOUNT:%s' % password).encode()).decode()
+	client.sendall(('POST /MOUNT HTTP/1.1\r\nHost: 127.0.0.1\r\nNtrip-Version: Ntrip/2.0\r\nAuthorization: Basic %s\r\n'
+					'Connection: keep-alive\r\nTransfer-Encoding: chunked\r\n\r\n' % auth).encode())
+	if not client.recv(256).startswith(b'HTTP/1.1 200'):
+		return False
+	SendSplit(client, stream)
+	return True
+
+
+# @return 0 if the caster saw every chunk and frame intact
+def CheckResult(result, epochs, expected):
+	ok = result.get('chunks') == epochs and result.get('frames') == expected and result.get('badCrc') == 0 and not result.get('errors')
+	print('%s chunks %s/%d frames %s/%d errors %s' % ('PASS' if ok else 'FAIL', result.get('chunks'), epochs, result.get('frames'), expected, result.get('errors')))
+	return 0 if ok else 1
+
+
+# Accept one connection on a thread. A GET is sent that many epochs
+# @return The port, the thread and the dictionary the summary goes into
+def StartTestCaster(password='secret', epochs=None):
+	listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	listener.bind(('127.0.0.1', 0))
+	listener.listen(1)
+	port = listener.getsockname()[1]
+	result = {}
+
+	def Server():
+		connection, address = listener.accept()
+		listener.close()
+		result.update(ServeSource(connection, address, password, lambda text: None, epochs, 0))
+
+	thread = threading.Thread(target=Server)
+	thread.start()
+	return port, thread, result
+
+
+###############################################################################
+# Read a served stream the way NtripClientInput does, decoding chunks for v2
+# @return 0 if every frame arrived intact
+def CheckServed(v2, epochs):
+	port, thread, result = StartTestCaster(epochs=epochs)
+	client = socket.create_connection(('127.0.0.1', port))
+	auth = base64.b64encode(b'user:secret').decode()
+	if v2:
+		client.sendall(('GET /TEST HTTP/1.1\r\nHost: 127.0.0.1\r\nNtrip-Version: Ntrip/2.0\r\nAuthorization: Basic %s\r\nConnection: close\r\n\r\n' % auth).encode())
+	else:
+		client.sendall(('GET /TEST HTTP/1.0\r\nAuthorization: Basic %s\r\n\r\n' % auth).encode())
+	checker = RtcmChecker()
+	chunks = 0
+	errors = []
+	try:
+		if v2:
+			status, headers, rest = ReadHeaders(client)
+			if not status.startswith('HTTP/1.1 200') or headers.get('transfer-encoding', '') != 'chunked':
+				errors.append('Reply %r %r' % (status, headers))
+			reader = ChunkReader(client)
+			reader.pending = rest
+			while True:
+				chunk = reader.Next()
+				if chunk is None:
+					break
+				chunks += 1
+				checker.Add(chunk)
+		else:
+			data = b''
+			while b'\r\n' not in data:
+				data += client.recv(64)
+			status, _, rest = data.partition(b'\r\n')
+			if status != b'ICY 200 OK':
+				errors.append('Reply %r' % status)
+			checker.Add(rest)
+			while True:
+				data = client.recv(4096)
+				if not data:
+					break
+				checker.Add(data)
+	except (EOFError, ValueError, OSError) as error:
+		errors.append(str(error))
+	client.close()
+	thread.join()
+
+	expected = EpochFrameCount(epochs)
+	ok = checker.frames == expected and checker.badCrc == 0 and checker.skipped == 0 and (not v2 or chunks == epochs) and not errors
+	print('%s served v%d frames %d/%d bad CRC %d skipped %d errors %s' % ('PASS' if ok else 'FAIL', 2 if v2 else 1, checker.frames, expected, checker.badCrc, checker.skipped, errors))
+	return 0 if ok else 1
+
+
+###############################################################################
+# Check the checker with a v2 source, then the served stream for v1 and v2
+def SelfTest():
+	port, thread, result = StartTestCaster()
+	client = socket.create_connection(('127.0.0.1', port))
+	client.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+	epochs = 20
+	stream, expected = TestStream(epochs)
+	if not SendTestSource(client, stream):
+		print('FAIL no 200 reply')
+		return 1
+	client.close()
+	thread.join()
+	return CheckResult(result, epochs, expected) | CheckServed(True, 12) | CheckServed(False, 12)
+
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description='Stand-in NTRIP caster that checks the ESP32 uplink')
+	parser.add_argument('--port', type=int, default=2101)
+	parser.add_argument('--password', default=None, help='Password to require (Any if not set)')
+	parser.add_argument('--interval', type=float, default=1.0, help='Seconds between epochs served to a GET')
+	parser.add_argument('--self-test', action='store_true', help='Check the checker against a synthetic v2 source and a served stream')
+	args = parser.parse_args()
+	sys.exit(SelfTest() if args.self_test else Serve(args.port, args.password, args.interval))
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+###############################################################################
+# Fault-injecting proxy to put between the ESP32 and a caster (Or the
+# .. stand-in caster) to check how fast a dead caster is found. Passes the
+# .. stream both ways, then after N seconds of each connection breaks it
+#	stall	Stops reading and forwarding but keeps the connection open. The
+#			.. TCP window closes like a caster that has hung or a path that
+#			.. black-holes data. The ESP32 should drop it with E507 after stall=ms
+#	reset	Closes both sides with a RST like a caster that restarted
+# .. and reports the time from the fault to the next connection, which is
+# .. when the ESP32 has found the fault and reconnected.
+#
+#	python3 test/caster_standin.py --port 2101
+#	python3 test/fault_proxy.py --port 2103 --target 127.0.0.1:2101 --after 20 --fault stall
+#	python3 test/fault_proxy.py --self-test
+#
+# Point a caster at this machine port 2103. The kernel here still answers
+# .. TCP keepalive probes during a stall, so an idle standby socket is not
+# .. tested by this. Use a firewall DROP rule for that
+###############################################################################
+import argparse
+import socket
+import struct
+import sys
+import threading
+import time
+
+# Small buffers so a stall fills them and shows in seconds, as it does with
+# .. the few KB of lwip send buffer on the ESP32
+PROXY_BUFFER = 4096
+
+
+###############################################################################
+# One proxied connection. The fault starts 'after' seconds from the accept
+class Link:
+	def __init__(self, client, address, target, after, fault, log):
+		self.client = client
+		self.address = address
+		self.upstream = socket.create_connection(target)
+		self.after = after
+		self.fault = fault
+		self.log = log
+		self.faultTime = None
+		self.bytes = 0
+		self.closed = threading.Event()
+
+	def Start(self):
+		self.client.settimeout(0.1)
+		self.upstream.settimeout(0.1)
+		threading.Thread(target=self.Pump, args=(self.client, self.upstream, True), daemon=True).start()
+		threading.Thread(target=self.Pump, args=(self.upstream, self.client, False), daemon=True).start()
+		threading.Thread(target=self.Fault, daemon=True).start()
+
+	def Fault(self):
+		if self.closed.wait(self.after):
+			return
+		self.faultTime = time.time()
+		if self.fault == 'reset':
+			for sock in (self.client, self.upstream):
+				sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack('ii', 1, 0))
+			self.Close()
+		self.log('%s %s after %.0fs and %d bytes' % (self.address[0], self.fault.upper(), self.after, self.bytes))
+
+	# Copy one direction till closed. During a stall nothing is read
+	def Pump(self, source, destination, counted):
+		while not self.closed.is_set():
+			if self.faultTime is not None:
+				time.sleep(0.05)
+				continue
+			try:
+				data = source.recv(4096)
+			except socket.timeout:
+				continue
+			except OSError:
+				break
+			if not data:
+				break
+			if self.faultTime is not None:
+				continue
+			try:
+				destination.sendall(data)
+			except OSError:
+				break
+			if counted:
+				self.bytes += len(data)
+		self.Close()
+
+	def Close(self):
+		if self.closed.is_set():
+			return
+		self.closed.set()
+		for sock in (self.client, self.upstream):
+			try:
+				sock.close()
+			except OSError:
+				pass
+
+
+###############################################################################
+# Accept connections one after another. A new connection while the last is
+# .. faulted is the ESP32 giving up on it
+class Proxy:
+	def __init__(self, port, target, after, fault, log, host=''):
+		self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+		self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+		self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, PROXY_BUFFER)
+		self.listener.bind((host, port))
+		self.listener.listen(4)
+		self.port = self.listener.getsockname()[1]
+		self.target = target
+		self.after = after
+		self.fault = fault
+		self.log = log
+		self.detections = []
+
+	def Run(self, connections=None):
+		last = None
+		count = 0
+		while connections is None or count < connections:
+			client, address = self.listener.accept()
+			count += 1
+			if last is not None and last.faultTime is not None:
+				detect = time.time() - last.faultTime
+				self.detections.append(detect)
+				self.log('%s reconnected %.1fs after the %s' % (address[0], detect, last.fault))
+			if last is not None:
+				last.Close()
+			self.log('%s connected (%d)' % (address[0], count))
+			last = Link(client, address, self.target, self.after, self.fault, self.log)
+			last.Start()
+		self.listener.close()
+		return last
+
+
+###############################################################################
+# A source that writes like NTRIPServer with stall detection. The socket is
+# .. non-blocking and if it refuses data for the stall time the connection is
+# .. dropped and made again
+def StallingSource(port, stall, duration, detections):
+	end = time.time() + duration
+	while time.time() < end:
+		sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+		sock.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, PROXY_BUFFER)
+		try:
+			sock.connect(('127.0.0.1', port))
+		except OSError:
+			# Proxy has closed
+			sock.close()
+			return
+		sock.setblocking(False)
+		lastWrite = time.time()
+		data = bytes(512)
+		while time.time() < end:
+			try:
+				sock.send(data)
+				lastWrite = time.time()
+			except BlockingIOError:
+				if time.time() - lastWrite >= stall:
+					detections.append(time.time() - lastWrite)
+					break
+			except OSError:
+				# Reset by the far end
+				break
+			time.sleep(0.005)
+		sock.close()
+
+
+def Sink():
+	listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	listener.bind(('127.0.0.1', 0))
+	listener.listen(4)
+
+	def Drain(connection):
+		try:
+			while connection.recv(65536):
+				pass
+		except OSError:
+			pass
+		connection.close()
+
+	def Accept():
+		while True:
+			connection, _ = listener.accept()
+			threading.Thread(target=Drain, args=(connection,), daemon=True).start()
+
+	threading.Thread(target=Accept, daemon=True).start()
+	return listener.getsockname()[1]
+
+
+###############################################################################
+# A source written like NTRIPServer through the proxy for each fault. A stall
+# .. must be found and the source back within the stall time plus the time to
+# .. fill the buffers. A reset is seen on the next write
+def SelfTest():
+	stall = 3.0
+	after = 2.0
+	sink = Sink()
+	result = 0
+	for fault, limit in (('stall', stall + 2), ('reset', 1)):
+		lines = []
+		proxy = Proxy(0, ('127.0.0.1', sink), after, fault, lines.append, '127.0.0.1')
+		thread = threading.Thread(target=proxy.Run, args=(2,), daemon=True)
+		thread.start()
+		source = threading.Thread(target=StallingSource, args=(proxy.port, stall, after + limit + 2, []), daemon=True)
+		source.start()
+		thread.join(after + limit + 10)
+		for line in lines:
+			print('  ' + line)
+		ok = len(proxy.detections) > 0 and proxy.detections[0] <= limit
+		detect = proxy.detections[0] if proxy.detections else float('nan')
+		print('%s %s found and reconnected %.1fs after the fault (stall=%.0fms)' % ('PASS' if ok else 'FAIL', fault, detect, stall * 1000))
+		source.join()
+		result |= 0 if ok else 1
+	return result
+
+
+def Target(text):
+	host, _, port = text.rpartition(':')
+	return (host or '127.0.0.1', int(port))
+
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description='Proxy that breaks the caster connection to time fault detection')
+	parser.add_argument('--port', type=int, default=2103)
+	parser.add_argument('--target', type=Target, default=('127.0.0.1', 2101), help='Caster host:port')
+	parser.add_argument('--after', type=float, default=20, help='Seconds into each connection before the fault')
+	parser.add_argument('--fault', choices=['stall', 'reset'], default='stall')
+	parser.add_argument('--self-test', action='store_true', help='Time stall detection of a source written like NTRIPServer')
+	args = parser.parse_args()
+	if args.self_test:
+		sys.exit(SelfTest())
+	print('Fault proxy on port %d to %s:%d, %s after %.0fs' % (args.port, args.target[0], args.target[1], args.fault, args.after))
+	Proxy(args.port, args.target, args.after, args.fault, print).Run()
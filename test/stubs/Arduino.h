@@ -0,0 +1,27 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+// Just enough of Arduino.h for the host tests (pio test -e native). The
+// .. clock only moves when a test moves it so timing logic can be simulated
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+typedef uint8_t byte;
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline unsigned long &StubMillis()
+{
+	static unsigned long now = 0;
+	return now;
+}
+inline unsigned long millis() { return StubMillis(); }
+inline unsigned long micros() { return StubMillis() * 1000; }
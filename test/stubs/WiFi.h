@@ -0,0 +1,17 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+// WiFi status names used by HandyString on the host
+#include <Arduino.h>
+
+typedef enum
+{
+	WL_NO_SHIELD = 255,
+	WL_IDLE_STATUS = 0,
+	WL_NO_SSID_AVAIL,
+	WL_SCAN_COMPLETED,
+	WL_CONNECTED,
+	WL_CONNECT_FAILED,
+	WL_CONNECTION_LOST,
+	WL_DISCONNECTED
+} wl_status_t;
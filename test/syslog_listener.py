@@ -0,0 +1,355 @@
+#!/usr/bin/env python3
+###############################################################################
+# Stand-in syslog collector used to check what SyslogSender sends before
+# .. pointing it at a real one. Listens for UDP and checks each datagram
+#	- Fits in SYSLOG_PAYLOAD_MAX (1400 bytes)
+#	- Is a valid RFC 5424 message with facility local0 and version 1
+#	- LOG has log@32473 seq, count and lost, count matches the lines and
+#	  .. the PRI severity is the worst line (E = err, W = warning)
+#	- LOG seq follows on from the last datagram of the host. A gap must be
+#	  .. covered by a rise in lost or it is a datagram lost on the way
+#	- METRICS has metrics@32473 with whole number uptime, heap and logLost
+# .. One line is printed per datagram and a summary per host on Ctrl-C
+#
+#	python3 test/syslog_listener.py --port 5514
+#	python3 test/syslog_listener.py --self-test
+#
+# Point the ESP32 at this machine with address=<this machine> port=5514
+###############################################################################
+import argparse
+import re
+import socket
+import sys
+
+# Same as SYSLOG_PAYLOAD_MAX, SYSLOG_FACILITY and SYSLOG_SD_PEN
+PAYLOAD_MAX = 1400
+FACILITY = 16
+SD_PEN = '32473'
+
+SEVERITY_ERROR = 3
+SEVERITY_WARNING = 4
+SEVERITY_INFO = 6
+
+HEADER = re.compile(r'^<(0|[1-9][0-9]{0,2})>([1-9][0-9]?) (\S+) (\S+) (\S+) (\S+) (\S+) ')
+TIMESTAMP = re.compile(r'^-$|^\d{4}-\d\d-\d\dT\d\d:\d\d:\d\d(\.\d{1,6})?(Z|[+-]\d\d:\d\d)$')
+SD_NAME = re.compile(r'^[\x21-\x7e]{1,32}$')
+
+# [Source] D HH:MM:SS.mmm [GPS2 ]Ennn - text
+LINE = re.compile(r'^\[[^\]]+\] \d+ \d\d:\d\d:\d\d\.\d{3} (?:GPS2 )?')
+CODE = re.compile(r'^[ -]*([EW])\d{3}(?: |$)')
+
+
+###############################################################################
+# Split the STRUCTURED-DATA off the front of the text
+# @return List of (SD-ID, {name: value}) and the text after it
+def ParseStructuredData(text):
+	if text.startswith('-'):
+		return [], text[1:]
+	elements = []
+	n = 0
+	while n < len(text) and text[n] == '[':
+		n += 1
+		end = n
+		while end < len(text) and text[end] not in ' ]':
+			end += 1
+		sdId = text[n:end]
+		if not SD_NAME.match(sdId) or any(c in sdId for c in '="'):
+			raise ValueError('Bad SD-ID %r' % sdId)
+		params = {}
+		n = end
+		while n < len(text) and text[n] == ' ':
+			n += 1
+			equals = text.find('=', n)
+			if equals < 0:
+				raise ValueError('Parameter without = in %s' % sdId)
+			name = text[n:equals]
+			if not SD_NAME.match(name) or any(c in name for c in ' ]"'):
+				raise ValueError('Bad parameter name %r in %s' % (name, sdId))
+			if equals + 1 >= len(text) or text[equals + 1] != '"':
+				raise ValueError('Parameter %s in %s not quoted' % (name, sdId))
+			n = equals + 2
+			value = ''
+			while True:
+				if n >= len(text):
+					raise ValueError('Parameter %s in %s not closed' % (name, sdId))
+				c = text[n]
+				if c == '\\' and n + 1 < len(text) and text[n + 1] in '"\\]':
+					value += text[n + 1]
+					n += 2
+					continue
+				if c == '"':
+					n += 1
+					break
+				if c == ']':
+					raise ValueError('Unescaped ] in %s %s' % (sdId, name))
+				value += c
+				n += 1
+			if name in params:
+				raise ValueError('Parameter %s repeated in %s' % (name, sdId))
+			params[name] = value
+		if n >= len(text) or text[n] != ']':
+			raise ValueError('SD element %s not closed' % sdId)
+		n += 1
+		elements.append((sdId, params))
+	if not elements:
+		raise ValueError('No STRUCTURED-DATA')
+	return elements, text[n:]
+
+
+# Severity the sender gives a line from its error code
+def LineSeverity(line):
+	match = LINE.match(line)
+	if not match:
+		return None
+	code = CODE.match(line[match.end():])
+	if not code:
+		return SEVERITY_INFO
+	return SEVERITY_ERROR if code.group(1) == 'E' else SEVERITY_WARNING
+
+
+def WholeNumber(params, name, errors):
+	value = params.get(name)
+	if value is None or not value.isdigit():
+		errors.append('%s=%r is not a whole number' % (name, value))
+		return 0
+	return int(value)
+
+
+###############################################################################
+# What has been seen from one host
+class Host:
+	def __init__(self):
+		self.datagrams = 0
+		self.records = 0
+		self.metrics = 0
+		self.nextSeq = None
+		self.lost = 0
+		self.dropped = 0
+		self.missing = 0
+		self.restarts = 0
+		self.errors = 0
+
+	def Summary(self):
+		return '%d datagrams, %d records, %d metrics, %d dropped by the sender, %d missing in transit, %d restarts, %d errors' % (
+			self.datagrams, self.records, self.metrics, self.dropped, self.missing, self.restarts, self.errors)
+
+
+###############################################################################
+# Checks datagrams and keeps the state per host
+class Checker:
+	def __init__(self, log):
+		self.log = log
+		self.hosts = {}
+		self.bad = 0
+
+	# @return List of errors, empty if the datagram is good
+	def Check(self, data, address):
+		errors = []
+		if len(data) > PAYLOAD_MAX:
+			errors.append('%d bytes is over %d' % (len(data), PAYLOAD_MAX))
+		# Without a BOM the MSG may be any bytes (MSG-ANY) and a line can hold
+		# .. stray bytes from a receiver. The header is checked as ASCII below
+		text = data.decode('latin-1')
+
+		header = HEADER.match(text)
+		if not header:
+			errors.append('No RFC 5424 header in %r' % text[:60])
+			return self.Done(errors, address, None, text)
+		pri, version, timestamp, hostName, appName, procId, msgId = header.groups()
+		pri = int(pri)
+		if pri > 191:
+			errors.append('PRI %d over 191' % pri)
+		if version != '1':
+			errors.append('Version %s not 1' % version)
+		if not TIMESTAMP.match(timestamp):
+			errors.append('Bad TIMESTAMP %r' % timestamp)
+		for name, value, limit in (('HOSTNAME', hostName, 255), ('APP-NAME', appName, 48), ('PROCID', procId, 128), ('MSGID', msgId, 32)):
+			if len(value) > limit or any(ord(c) < 33 or ord(c) > 126 for c in value):
+				errors.append('Bad %s %r' % (name, value))
+		if pri // 8 != FACILITY:
+			errors.append('Facility %d not %d (local0)' % (pri // 8, FACILITY))
+		severity = pri % 8
+
+		try:
+			elements, rest = ParseStructuredData(text[header.end():])
+		except ValueError as error:
+			errors.append(str(error))
+			return self.Done(errors, address, hostName, text)
+		if rest and not rest.startswith(' '):
+			errors.append('No space before MSG %r' % rest[:20])
+		message = rest[1:]
+		params = dict(elements).get('%s@%s' % (msgId.lower(), SD_PEN))
+
+		host = self.hosts.setdefault(hostName, Host())
+		host.datagrams += 1
+		if msgId == 'LOG':
+			self.CheckLog(host, params, severity, message, errors)
+		elif msgId == 'METRICS':
+			self.CheckMetrics(host, params, severity, message, errors)
+		else:
+			errors.append('Unknown MSGID %r' % msgId)
+		host.errors += 1 if errors else 0
+		return self.Done(errors, address, hostName, text)
+
+	def CheckLog(self, host, params, severity, message, errors):
+		if params is None:
+			errors.append('LOG without log@%s' % SD_PEN)
+			return
+		seq = WholeNumber(params, 'seq', errors)
+		count = WholeNumber(params, 'count', errors)
+		lost = WholeNumber(params, 'lost', errors)
+		lines = message.split('\n') if message else []
+		if count != len(lines):
+			errors.append('count=%d but %d lines' % (count, len(lines)))
+		if count == 0:
+			errors.append('LOG with no lines')
+
+		worst = SEVERITY_INFO
+		for line in lines:
+			lineSeverity = LineSeverity(line)
+			if lineSeverity is None:
+				errors.append('Line not [Source] uptime text: %r' % line[:60])
+				continue
+			worst = min(worst, lineSeverity)
+		if lines and severity != worst:
+			errors.append('Severity %d but worst line is %d' % (severity, worst))
+
+		# Follow the sequence. A gap the sender counted as lost is fine
+		if host.nextSeq is not None:
+			if seq < host.nextSeq and lost < host.lost:
+				host.restarts += 1
+				self.log('  restart (seq %d after %d)' % (seq, host.nextSeq))
+			elif seq < host.nextSeq:
+				errors.append('seq %d repeats, expected %d' % (seq, host.nextSeq))
+			elif seq > host.nextSeq:
+				gap = seq - host.nextSeq
+				counted = lost - host.lost
+				if counted < gap:
+					host.missing += gap - counted
+					self.log('  MISSING %d records before seq %d (%d counted as lost)' % (gap - counted, seq, counted))
+				host.dropped += min(gap, counted)
+		host.nextSeq = seq + count
+		host.lost = lost
+		host.records += count
+
+	def CheckMetrics(self, host, params, severity, message, errors):
+		if params is None:
+			errors.append('METRICS without metrics@%s' % SD_PEN)
+			return
+		for name in ('uptime', 'heap', 'logLost'):
+			WholeNumber(params, name, errors)
+		if severity != SEVERITY_INFO:
+			errors.append('METRICS severity %d not %d' % (severity, SEVERITY_INFO))
+		if message:
+			errors.append('METRICS with a MSG %r' % message[:20])
+		host.metrics += 1
+
+	def Done(self, errors, address, hostName, text):
+		first = text.split('\n', 1)[0]
+		self.log('%s %s %s%s' % (address[0], hostName or '?', 'BAD ' if errors else '', first[:120]))
+		for error in errors:
+			self.log('  ERROR %s' % error)
+		self.bad += 1 if errors else 0
+		return errors
+
+
+def Serve(port):
+	listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	listener.bind(('', port))
+	print('Syslog listener on UDP port %d' % port)
+	checker = Checker(print)
+	try:
+		while True:
+			data, address = listener.recvfrom(65536)
+			checker.Check(data, address)
+	except KeyboardInterrupt:
+		pass
+	for name, host in checker.hosts.items():
+		print('%s: %s' % (name, host.Summary()))
+	return 1 if checker.bad else 0
+
+
+###############################################################################
+# Datagrams made the way SyslogSender makes them
+def LogDatagram(host, seq, lines, lost=0, severity=None):
+	if severity is None:
+		severity = min([LineSeverity(line) for line in lines] + [SEVERITY_INFO])
+	header = '<%d>1 - %s ntrip-server - LOG [log@%s seq="%d" count="%d" lost="%d"] ' % (FACILITY * 8 + severity, host, SD_PEN, seq, len(lines), lost)
+	return (header + '\n'.join(lines)).encode()
+
+
+def MetricsDatagram(host, uptime, heap, lost, extra=''):
+	return ('<%d>1 - %s ntrip-server - METRICS [metrics@%s uptime="%d" heap="%d" logLost="%d"%s]' %
+			(FACILITY * 8 + SEVERITY_INFO, host, SD_PEN, uptime, heap, lost, extra)).encode()
+
+
+def TestLines(start, count):
+	lines = []
+	for n in range(start, start + count):
+		text = ['RTK Sent 1024 bytes', 'W703 - Skipped [12] "d3 00 13"', 'E500 - caster.com Only sent 10 of 20 (5ms)'][n % 7 % 3]
+		lines.append('[Caster 1] 0 00:%02d:%02d.%03d %s' % (n // 60 % 60, n % 60, n * 7 % 1000, text))
+	return lines
+
+
+###############################################################################
+# Send good traffic with a counted loss and a transit loss, then datagrams
+# .. that are each wrong in one way and must each be flagged
+def SelfTest():
+	listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	listener.bind(('127.0.0.1', 0))
+	listener.settimeout(2)
+	port = listener.getsockname()[1]
+	lines = []
+	checker = Checker(lines.append)
+
+	good = [
+		LogDatagram('RTK_abcdef', 0, TestLines(0, 1)),
+		LogDatagram('RTK_abcdef', 1, TestLines(1, 9), 0),
+		MetricsDatagram('RTK_abcdef', 60, 123456, 0, ' caster1="caster.com" caster1Age="12" gpsReadErrors="0"'),
+		# 5 records dropped by the sender and counted
+		LogDatagram('RTK_abcdef', 15, TestLines(15, 4), 5),
+		# 3 records in a datagram lost on the way
+		LogDatagram('RTK_abcdef', 22, TestLines(22, 2), 5),
+		LogDatagram('RTK_abcdef', 24, TestLines(24, 12), 5),
+	]
+	bad = [
+		('oversize', LogDatagram('RTK_bad', 0, ['[System] 0 00:00:00.000 ' + 'x' * PAYLOAD_MAX])),
+		('count', LogDatagram('RTK_bad', 1, TestLines(1, 3)).replace(b'count="3"', b'count="4"')),
+		('severity', LogDatagram('RTK_bad', 4, TestLines(2, 1), 0, SEVERITY_INFO)),
+		('facility', LogDatagram('RTK_bad', 5, TestLines(0, 1)).replace(b'<134>', b'<14>')),
+		('version', LogDatagram('RTK_bad', 6, TestLines(0, 1)).replace(b'>1 ', b'>2 ')),
+		('repeat', LogDatagram('RTK_bad', 6, TestLines(0, 1))),
+		('unclosed SD', MetricsDatagram('RTK_bad', 1, 2, 0)[:-1]),
+		('metrics value', MetricsDatagram('RTK_bad', 1, 2, 0).replace(b'heap="2"', b'heap="-2"')),
+		('msgid', LogDatagram('RTK_bad', 7, TestLines(0, 1)).replace(b' LOG [', b' DEBUG [')),
+	]
+
+	sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	result = 0
+	for data in good:
+		sender.sendto(data, ('127.0.0.1', port))
+		received, address = listener.recvfrom(65536)
+		errors = checker.Check(received, address)
+		if errors:
+			print('FAIL good datagram flagged %s' % errors)
+			result = 1
+	host = checker.hosts['RTK_abcdef']
+	ok = host.records == 28 and host.dropped == 5 and host.missing == 3 and host.metrics == 1 and host.errors == 0
+	print('%s good stream %s' % ('PASS' if ok else 'FAIL', host.Summary()))
+	result |= 0 if ok else 1
+
+	for name, data in bad:
+		sender.sendto(data, ('127.0.0.1', port))
+		received, address = listener.recvfrom(65536)
+		errors = checker.Check(received, address)
+		print('%s %s flagged %s' % ('PASS' if errors else 'FAIL', name, errors[:1]))
+		result |= 0 if errors else 1
+	return result
+
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description='Stand-in syslog collector that checks what the ESP32 sends')
+	parser.add_argument('--port', type=int, default=5514)
+	parser.add_argument('--self-test', action='store_true', help='Check the checker against good and broken datagrams')
+	args = parser.parse_args()
+	sys.exit(SelfTest() if args.self_test else Serve(args.port))
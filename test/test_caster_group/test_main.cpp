@@ -0,0 +1,251 @@
+#include <unity.h>
+#include "CasterGroup.h"
+
+// Same as SOCKET_RETRY_INTERVAL, SOCKET_RETRY_MAX and CONNECT_TIMEOUT used by NTRIPServer
+#define SIM_RETRY_INTERVAL 30000
+#define SIM_RETRY_MAX (10 * 60000)
+#define SIM_CONNECT_TIMEOUT 5000
+
+///////////////////////////////////////////////////////////////////////////////
+// Drives a group the way NTRIPServer::Reconnect does, one second at a time.
+// .. A dead endpoint takes the connect timeout to fail. Every attempt waits
+// .. the retry interval except one early switch after each accept. A caster
+// .. that rejects the login doubles the wait for the whole group
+struct Simulation
+{
+	CasterGroup group;
+	bool alive[CASTER_GROUP_MAX] = {true, true, true, true};
+	bool rejects[CASTER_GROUP_MAX] = {false, false, false, false};
+	unsigned long retryInterval = SIM_RETRY_INTERVAL;
+	bool connected = false;
+	bool earlySwitched = false;	   // Used the switch without a wait
+	unsigned long nextAttempt = 0;
+	unsigned long streamed = 0;	   // Time with a working connection (ms)
+	unsigned long firstBackup = 0; // Millis when we first streamed on a backup (0 = never)
+	int attempts = 0;			   // Connection attempts
+	int earlyAttempts = 0;		   // Attempts made before the retry wait was over
+
+	Simulation()
+	{
+		group.Setup("primary", 2101, "backup1:2101,backup2:2102");
+	}
+
+	void Step()
+	{
+		unsigned long now = millis();
+		group.Tick(connected);
+		if (connected)
+		{
+			if (!alive[group.CurrentIndex()])
+			{
+				connected = false;
+				group.OnFailure(CASTER_PENALTY_DROP);
+				nextAttempt = now;
+			}
+			else if (group.ShouldSwitch())
+			{
+				connected = false;
+				nextAttempt = now;
+			}
+			else
+			{
+				streamed += 1000;
+			}
+		}
+		else
+		{
+			bool waited = (long)(now - nextAttempt) >= 0;
+			if (waited || (!earlySwitched && retryInterval == SIM_RETRY_INTERVAL))
+			{
+				bool changed = group.Choose();
+				if (changed && !waited)
+				{
+					earlySwitched = true;
+					earlyAttempts++;
+				}
+				if (changed || waited)
+					Attempt();
+			}
+		}
+		StubMillis() += 1000;
+	}
+
+	void Attempt()
+	{
+		attempts++;
+		nextAttempt = millis() + retryInterval;
+		if (rejects[group.CurrentIndex()])
+		{
+			group.OnFailure(CASTER_PENALTY_REJECT);
+			retryInterval = min(retryInterval * 2, (unsigned long)SIM_RETRY_MAX);
+			nextAttempt = millis() + retryInterval;
+			return;
+		}
+		if (alive[group.CurrentIndex()])
+		{
+			connected = true;
+			earlySwitched = false;
+			if (group.CurrentIndex() > 0 && firstBackup == 0)
+				firstBackup = millis();
+			return;
+		}
+		StubMillis() += SIM_CONNECT_TIMEOUT;
+		group.OnFailure(CASTER_PENALTY_CONNECT);
+	}
+
+	void Run(unsigned long duration)
+	{
+		unsigned long end = millis() + duration;
+		while ((long)(millis() - end) < 0)
+			Step();
+	}
+};
+
+void setUp()
+{
+	StubMillis() = 1000000;
+}
+
+void tearDown()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A primary that never answers loses to the first backup after one connect
+// .. timeout, not after two failed retries
+void test_dead_primary_fails_over_after_one_connect()
+{
+	Simulation sim;
+	sim.alive[0] = false;
+	unsigned long start = millis();
+	sim.Run(60000);
+	TEST_ASSERT_EQUAL_INT(1, sim.group.CurrentIndex());
+	TEST_ASSERT_TRUE(sim.connected);
+	TEST_ASSERT_LESS_OR_EQUAL(SIM_CONNECT_TIMEOUT + 1000, sim.firstBackup - start);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// One dropped connection is a glitch. Stay on the primary
+void test_single_drop_keeps_primary()
+{
+	CasterGroup group;
+	group.Setup("primary", 2101, "backup1:2101");
+	group.OnFailure(CASTER_PENALTY_DROP);
+	TEST_ASSERT_FALSE(group.Choose());
+	TEST_ASSERT_EQUAL_INT(0, group.CurrentIndex());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Repeated drops or a rejection move us on
+void test_repeated_drops_move_to_backup()
+{
+	CasterGroup group;
+	group.Setup("primary", 2101, "backup1:2101");
+	group.OnFailure(CASTER_PENALTY_DROP);
+	group.OnFailure(CASTER_PENALTY_DROP);
+	TEST_ASSERT_TRUE(group.Choose());
+	TEST_ASSERT_EQUAL_INT(1, group.CurrentIndex());
+
+	CasterGroup rejected;
+	rejected.Setup("primary", 2101, "backup1:2101");
+	rejected.OnFailure(CASTER_PENALTY_REJECT);
+	TEST_ASSERT_TRUE(rejected.Choose());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Once the primary is back we return to it after its penalty decays, never
+// .. before the dwell time, and the hysteresis holds us on the backup till then
+void test_returns_to_primary_after_recovery()
+{
+	Simulation sim;
+	sim.alive[0] = false;
+	sim.Run(10000);
+	TEST_ASSERT_EQUAL_INT(1, sim.group.CurrentIndex());
+	unsigned long failover = sim.group.GetSwitchTime();
+	sim.alive[0] = true;
+
+	while (sim.group.CurrentIndex() != 0 && (millis() - failover) < 3600000)
+		sim.Step();
+	unsigned long back = millis() - failover;
+	TEST_ASSERT_EQUAL_INT(0, sim.group.CurrentIndex());
+	TEST_ASSERT_GREATER_OR_EQUAL(CASTER_MIN_DWELL, back);
+	TEST_ASSERT_GREATER_OR_EQUAL(300000, back);
+	TEST_ASSERT_LESS_OR_EQUAL(420000, back);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// With the primary dead for an hour we probe it now and then but stream on
+// .. the backup nearly all the time
+void test_dead_primary_for_an_hour_keeps_streaming()
+{
+	Simulation sim;
+	sim.alive[0] = false;
+	sim.Run(3600000);
+	TEST_ASSERT_TRUE(sim.connected);
+	TEST_ASSERT_GREATER_OR_EQUAL(3600000 * 97 / 100, sim.streamed);
+	TEST_ASSERT_LESS_OR_EQUAL(30, sim.group.GetFailovers());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Both the primary and the first backup dead. End up on the second backup
+void test_two_dead_reaches_second_backup()
+{
+	Simulation sim;
+	sim.alive[0] = false;
+	sim.alive[1] = false;
+	sim.Run(120000);
+	TEST_ASSERT_EQUAL_INT(2, sim.group.CurrentIndex());
+	TEST_ASSERT_TRUE(sim.connected);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Every caster refusing connections. Attempts keep to the retry interval
+// .. and the penalties stop growing, so no tight reconnect loop
+void test_all_dead_bounds_attempts()
+{
+	Simulation sim;
+	for (bool &alive : sim.alive)
+		alive = false;
+	sim.Run(600000);
+	TEST_ASSERT_FALSE(sim.connected);
+	TEST_ASSERT_LESS_OR_EQUAL(600000 / SIM_RETRY_INTERVAL + 2, sim.attempts);
+	TEST_ASSERT_LESS_OR_EQUAL(1, sim.earlyAttempts);
+	TEST_ASSERT_LESS_OR_EQUAL(sim.attempts, sim.group.GetFailovers());
+	for (int n = 0; n < (int)sim.group.GetEndpoints().size(); n++)
+		TEST_ASSERT_LESS_OR_EQUAL(CASTER_PENALTY_MAX, sim.group.GetEndpoints()[n].penalty);
+
+	char text[80];
+	snprintf(text, sizeof(text), "%d attempts and %d failovers in 10 minutes", sim.attempts, sim.group.GetFailovers());
+	TEST_MESSAGE(text);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Every caster rejecting the password. A switch never skips the backoff so
+// .. the waits keep doubling to the maximum
+void test_rejected_login_keeps_backoff()
+{
+	Simulation sim;
+	for (bool &rejects : sim.rejects)
+		rejects = true;
+	sim.Run(3600000);
+	TEST_ASSERT_FALSE(sim.connected);
+	TEST_ASSERT_EQUAL_INT(0, sim.earlyAttempts);
+	TEST_ASSERT_EQUAL_UINT32(SIM_RETRY_MAX, sim.retryInterval);
+
+	// 1, 2, 4, 8 then 10 minute waits
+	TEST_ASSERT_LESS_OR_EQUAL(10, sim.attempts);
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_dead_primary_fails_over_after_one_connect);
+	RUN_TEST(test_single_drop_keeps_primary);
+	RUN_TEST(test_repeated_drops_move_to_backup);
+	RUN_TEST(test_returns_to_primary_after_recovery);
+	RUN_TEST(test_dead_primary_for_an_hour_keeps_streaming);
+	RUN_TEST(test_two_dead_reaches_second_backup);
+	RUN_TEST(test_all_dead_bounds_attempts);
+	RUN_TEST(test_rejected_login_keeps_backoff);
+	return UNITY_END();
+}
@@ -0,0 +1,216 @@
+#include <unity.h>
+#include <chrono>
+#include <memory>
+#include "LogFormat.h"
+#include "TextBuilder.h"
+#include "HandyString.h"
+
+// Calls timed for each benchmark
+#define BENCH_CALLS 200000
+
+///////////////////////////////////////////////////////////////////////////////
+// A record built the way Logf builds one, without the ring
+struct TestRecord
+{
+	union
+	{
+		LogRecord header;
+		uint32_t align;
+	};
+	byte payload[LOG_RECORD_MAX];
+};
+
+template <size_t N, typename... Args>
+static void Pack(TestRecord &record, const char (&format)[N], Args... args)
+{
+	const char *pFormat = format;
+	int length = min((int)sizeof(pFormat) + LogArgsSize(args...), LOG_RECORD_MAX);
+	memset(&record.header, 0, sizeof(record.header));
+	record.header.kind = LOG_KIND_FORMAT;
+	record.header.source = LOG_SYSTEM;
+	record.header.length = length;
+	memcpy(record.payload, &pFormat, sizeof(pFormat));
+	LogArgsPack(record.payload + sizeof(pFormat), record.payload + length, args...);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// @return The rendered text without the uptime in front
+static std::string Text(const TestRecord &record, int size = LOG_LINE_MAX)
+{
+	char line[LOG_LINE_MAX];
+	int length = LogRender(record.header, line, size);
+	TEST_ASSERT_LESS_THAN(size, length);
+	TEST_ASSERT_EQUAL_INT((int)strlen(line), length);
+	const char *pSpace = strchr(line, ' ');
+	pSpace = strchr(pSpace + 1, ' ');
+	return std::string(pSpace + 1);
+}
+
+template <size_t N, typename... Args>
+static std::string Render(const char (&format)[N], Args... args)
+{
+	static TestRecord record;
+	Pack(record, format, args...);
+	return Text(record);
+}
+
+// Matches the text printf makes
+#define ASSERT_LIKE_PRINTF(format, ...) TEST_ASSERT_EQUAL_STRING(StringPrintf(format, __VA_ARGS__).c_str(), Render(format, __VA_ARGS__).c_str())
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// %s copies the text when logged so a temporary can go straight away
+void test_string_of_temporary()
+{
+	static TestRecord record;
+	{
+		std::string name = "temporary";
+		Pack(record, "Name %s, %s!", name.c_str(), std::string("gone").c_str());
+		name.assign(name.size(), 'x');
+	}
+	std::string clobber(64, 'z');
+	TEST_ASSERT_EQUAL_STRING("Name temporary, gone!", Text(record).c_str());
+
+	const char *pNull = nullptr;
+	TEST_ASSERT_EQUAL_STRING("[]", Render("[%s]", pNull).c_str());
+	ASSERT_LIKE_PRINTF("[%8s][%-8s][%.3s]", "ab", "cd", "truncate");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A '*' width or precision comes from the argument list
+void test_star_width_and_precision()
+{
+	ASSERT_LIKE_PRINTF("[%*d]", 6, 42);
+	ASSERT_LIKE_PRINTF("[%-*d]", 6, -42);
+	ASSERT_LIKE_PRINTF("[%.*s]", 3, "abcdef");
+	ASSERT_LIKE_PRINTF("[%*.*f]", 10, 2, 3.14159);
+	ASSERT_LIKE_PRINTF("[%*s|%d]", 5, "x", 7);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Length modifiers are skipped and the packed size of the argument used
+void test_length_modifiers()
+{
+	ASSERT_LIKE_PRINTF("%hhd %hhu", (signed char)-5, (unsigned char)250);
+	ASSERT_LIKE_PRINTF("%hd %hu", (short)-32768, (unsigned short)65535);
+	ASSERT_LIKE_PRINTF("%ld %lu", -123456789L, 4000000000UL);
+	ASSERT_LIKE_PRINTF("%lld %llu", (long long)INT64_MIN, (unsigned long long)UINT64_MAX);
+	ASSERT_LIKE_PRINTF("%llx %lX %08x", 0x123456789ABCDEFULL, 0xBEEFUL, 0xABCDu);
+	ASSERT_LIKE_PRINTF("%zu %d", (size_t)12345, -1);
+	ASSERT_LIKE_PRINTF("%u", (unsigned)UINT32_MAX);
+	ASSERT_LIKE_PRINTF("%d", (int)INT32_MIN);
+	ASSERT_LIKE_PRINTF("%c%c", 'o', 'k');
+	ASSERT_LIKE_PRINTF("%.3f %e %g", 1.0f / 3, 12345.678, 0.0001);
+	ASSERT_LIKE_PRINTF("%+05d %#o %%", 7, 8u);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// An argument that is missing or the wrong type shows as '?'
+void test_missing_arguments()
+{
+	TEST_ASSERT_EQUAL_STRING("1 ? ?", Render("%d %d %s", 1).c_str());
+	TEST_ASSERT_EQUAL_STRING("?", Render("%d", 2.5).c_str());
+	TEST_ASSERT_EQUAL_STRING("?", Render("%f", 3).c_str());
+	TEST_ASSERT_EQUAL_STRING("? 4", Render("%s %d", 1, 4).c_str());
+	TEST_ASSERT_EQUAL_STRING("[?]", Render("[%*d]", 2).c_str());
+	TEST_ASSERT_EQUAL_STRING("No args", Render("No args").c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Binary goes in as bytes and comes out as hex. Long text is cut to the
+// .. record and the line never overruns
+void test_hex_and_limits()
+{
+	const byte data[] = {0xD3, 0x00, 0x13, 0x3E};
+	TEST_ASSERT_EQUAL_STRING("Frame d3 00 13 3e ", Render("Frame %s", LogHex(data, sizeof(data))).c_str());
+
+	std::string longText(3000, 'a');
+	std::string text = Render("%s", longText.c_str());
+	TEST_ASSERT_LESS_OR_EQUAL(LOG_RECORD_MAX, (int)text.size());
+	TEST_ASSERT_GREATER_THAN(LOG_RECORD_MAX - 32, (int)text.size());
+
+	static TestRecord record;
+	Pack(record, "%s and %d", "Some words", 12345);
+	TEST_ASSERT_EQUAL_STRING("Some", Text(record, 20).c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// What Logf did before. Formats twice into a heap buffer and makes a string
+// .. with the uptime from four StringPrintf calls in front
+static std::string OldUptime(unsigned long millis)
+{
+	uint32_t t = millis / 1000;
+	std::string uptime = StringPrintf(":%02d.%03d", t % 60, millis % 1000);
+	t /= 60;
+	uptime = StringPrintf(":%02d", t % 60) + uptime;
+	t /= 60;
+	uptime = StringPrintf("%02d", t % 24) + uptime;
+	t /= 24;
+	uptime = StringPrintf("%d ", t) + uptime;
+	return uptime;
+}
+
+template <typename... Args>
+static std::string OldLogf(const std::string &format, Args... args)
+{
+	int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) + 1;
+	auto size = static_cast<size_t>(size_s);
+	std::unique_ptr<char[]> buf(new char[size]);
+	std::snprintf(buf.get(), size, format.c_str(), args...);
+	return OldUptime(123456789) + " " + std::string(buf.get(), buf.get() + size - 1);
+}
+
+template <typename F>
+static double NanosPerCall(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int n = 0; n < BENCH_CALLS; n++)
+		f(n);
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>(elapsed).count() / BENCH_CALLS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Cost on the logging task (Pack) against the old format-when-logged, and
+// .. the render only paid when the log is viewed. Host numbers, so only the
+// .. ratios carry over to the ESP32
+void test_benchmark()
+{
+	static TestRecord record;
+	volatile size_t sink = 0;
+	const char *pHost = "caster.example.com";
+
+	double oldNs = NanosPerCall([&](int n)
+								{ sink += OldLogf("RTK %s sent %d bytes in %lums (%.1f%%)", pHost, n, (unsigned long)n * 3, n * 0.01).size(); });
+	double packNs = NanosPerCall([&](int n)
+								 {
+		Pack(record, "RTK %s sent %d bytes in %lums (%.1f%%)", pHost, n, (unsigned long)n * 3, n * 0.01);
+		sink += record.header.length; });
+	char line[LOG_LINE_MAX];
+	double renderNs = NanosPerCall([&](int)
+								   { sink += LogRender(record.header, line, sizeof(line)); });
+
+	char text[160];
+	snprintf(text, sizeof(text), "Old Logf %.0fns, new Logf pack %.0fns (%.1fx), render when viewed %.0fns", oldNs, packNs, oldNs / packNs, renderNs);
+	TEST_MESSAGE(text);
+	TEST_ASSERT_LESS_THAN(oldNs, packNs);
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_string_of_temporary);
+	RUN_TEST(test_star_width_and_precision);
+	RUN_TEST(test_length_modifiers);
+	RUN_TEST(test_missing_arguments);
+	RUN_TEST(test_hex_and_limits);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
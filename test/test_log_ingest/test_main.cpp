@@ -0,0 +1,207 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "LogIngest.h"
+
+// Producer threads and the messages each tries to log
+#define STRESS_THREADS 4
+#define STRESS_MESSAGES 50000
+
+// Small ring so the producers wrap, pad and fill it all the time
+#define STRESS_RING_SIZE 1024
+
+///////////////////////////////////////////////////////////////////////////////
+// Payload of a test message. Sequence, thread and then bytes that depend on
+// .. both so a torn or misplaced message shows up
+static void Fill(byte *pPayload, int length, uint32_t seq, int thread)
+{
+	for (int n = 0; n < length; n++)
+		pPayload[n] = n < 4 ? (seq >> (8 * n)) & 0xFF : (byte)(seq * 7 + thread + n);
+}
+
+static bool Check(const byte *pPayload, int length, uint32_t &seq, int thread)
+{
+	if (length < 4)
+		return false;
+	seq = pPayload[0] | pPayload[1] << 8 | pPayload[2] << 16 | (uint32_t)pPayload[3] << 24;
+	for (int n = 4; n < length; n++)
+		if (pPayload[n] != (byte)(seq * 7 + thread + n))
+			return false;
+	return pPayload[length] == '\0';
+}
+
+// Length of message seq from a thread. Includes lengths that leave the end
+// .. of the ring short so the next message pads
+static int Length(uint32_t seq, int thread)
+{
+	return 4 + (seq * 2654435761u + thread * 40503u) % 380;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Producers on several threads against one consumer. Every message that was
+// .. reserved comes out whole, in order per producer, and every one that
+// .. was not is in the drop count
+void test_threads_wrap_and_account()
+{
+	static LogIngest<STRESS_RING_SIZE> ingest;
+	uint32_t sent[STRESS_THREADS] = {};
+	uint32_t failed[STRESS_THREADS] = {};
+	uint32_t received[STRESS_THREADS] = {};
+	uint32_t nextSeq[STRESS_THREADS] = {};
+	int errors = 0;
+	std::atomic<int> running{STRESS_THREADS};
+
+	std::vector<std::thread> producers;
+	for (int thread = 0; thread < STRESS_THREADS; thread++)
+	{
+		producers.emplace_back([&, thread]()
+							   {
+			for (uint32_t seq = 0; seq < STRESS_MESSAGES; seq++)
+			{
+				int length = Length(seq, thread);
+				byte *pPayload = ingest.Reserve((LogSource)thread, LOG_KIND_TEXT, length);
+				if (pPayload == nullptr)
+				{
+					// Like a task that logs then gets on with something else
+					failed[thread]++;
+					std::this_thread::yield();
+					continue;
+				}
+				Fill(pPayload, length, seq, thread);
+				pPayload[length] = '\0';
+				LogIngest<STRESS_RING_SIZE>::Commit(pPayload);
+				sent[thread]++;
+			}
+			running--; });
+	}
+
+	// Consumer. Seq numbers from a thread only go up as drops leave gaps
+	auto check = [&](const LogSlot &slot)
+	{
+		int thread = slot.source;
+		uint32_t seq;
+		if (thread >= STRESS_THREADS || slot.kind != LOG_KIND_TEXT || !Check(slot.Payload(), slot.length, seq, thread) ||
+			seq < nextSeq[thread] || slot.length != Length(seq, thread))
+		{
+			errors++;
+			return;
+		}
+		nextSeq[thread] = seq + 1;
+		received[thread]++;
+	};
+	while (running > 0 || ingest.Waiting() > 0)
+		if (ingest.Drain(check) == 0)
+			std::this_thread::yield();
+	for (auto &producer : producers)
+		producer.join();
+	ingest.Drain(check);
+
+	uint32_t totalFailed = 0;
+	uint32_t totalReceived = 0;
+	for (int thread = 0; thread < STRESS_THREADS; thread++)
+	{
+		TEST_ASSERT_EQUAL_UINT32(sent[thread], received[thread]);
+		TEST_ASSERT_EQUAL_UINT32(STRESS_MESSAGES, sent[thread] + failed[thread]);
+		totalFailed += failed[thread];
+		totalReceived += received[thread];
+	}
+	TEST_ASSERT_EQUAL_INT(0, errors);
+	TEST_ASSERT_EQUAL_UINT32(totalFailed, ingest.Dropped());
+	TEST_ASSERT_EQUAL_UINT32(0, ingest.Waiting());
+
+	// The ring must have been busy enough to wrap and drop
+	TEST_ASSERT_GREATER_THAN(STRESS_RING_SIZE * 4, totalReceived);
+	TEST_ASSERT_GREATER_THAN(0, totalFailed);
+
+	char text[120];
+	snprintf(text, sizeof(text), "%u messages through a %d byte ring, %u dropped", totalReceived, STRESS_RING_SIZE, totalFailed);
+	TEST_MESSAGE(text);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Once a long message is drained every header boundary it covered reads free.
+// .. Its payload is made to look like ready headers so a slot reserved in that
+// .. space but not committed would be taken early if only its first header
+// .. was cleared
+void test_cleared_header_boundaries()
+{
+	static LogIngest<256> ingest;
+	int drained = 0;
+	auto count = [&](const LogSlot &)
+	{ drained++; };
+
+	// Long message from offset 0 to 208
+	byte *pLong = ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 190);
+	TEST_ASSERT_NOT_NULL(pLong);
+	memset(pLong, 0, 191);
+	for (int offset = 0; offset < 190; offset += sizeof(LogSlot))
+		pLong[offset] = LOG_SLOT_READY;
+	LogIngest<256>::Commit(pLong);
+	TEST_ASSERT_EQUAL_INT(1, ingest.Drain(count));
+
+	// Fill to the end then wrap into the old long message
+	byte *pFill = ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 30);
+	TEST_ASSERT_NOT_NULL(pFill);
+	LogIngest<256>::Commit(pFill);
+	byte *pFirst = ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 20);
+	byte *pSecond = ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 20);
+	TEST_ASSERT_NOT_NULL(pFirst);
+	TEST_ASSERT_NOT_NULL(pSecond);
+
+	// Neither committed. Only the fill comes out
+	drained = 0;
+	ingest.Drain(count);
+	TEST_ASSERT_EQUAL_INT(1, drained);
+
+	// The second is committed but the first still holds it back
+	LogIngest<256>::Commit(pSecond);
+	TEST_ASSERT_EQUAL_INT(0, ingest.Drain(count));
+	LogIngest<256>::Commit(pFirst);
+	TEST_ASSERT_EQUAL_INT(2, ingest.Drain(count));
+	TEST_ASSERT_EQUAL_UINT32(0, ingest.Waiting());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A message that will not fit before the end pads to the front. With the
+// .. ring full the next one is dropped and counted, and fits again once
+// .. drained
+void test_pad_and_drop()
+{
+	static LogIngest<256> ingest;
+	auto none = [](const LogSlot &) {};
+
+	byte *pA = ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 150);
+	LogIngest<256>::Commit(pA);
+	TEST_ASSERT_EQUAL_INT(1, ingest.Drain(none));
+
+	// A took 176. B needs 128 which will not fit before the end so it pads 80
+	byte *pB = ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 100);
+	TEST_ASSERT_NOT_NULL(pB);
+	TEST_ASSERT_EQUAL_UINT32(80 + 128, ingest.Waiting());
+
+	// No room for another 128 till B is gone
+	TEST_ASSERT_NULL(ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 100));
+	TEST_ASSERT_EQUAL_UINT32(1, ingest.Dropped());
+	LogIngest<256>::Commit(pB);
+	TEST_ASSERT_EQUAL_INT(1, ingest.Drain(none));
+	TEST_ASSERT_NOT_NULL(ingest.Reserve(LOG_SYSTEM, LOG_KIND_TEXT, 100));
+	TEST_ASSERT_EQUAL_UINT32(1, ingest.Dropped());
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_threads_wrap_and_account);
+	RUN_TEST(test_cleared_header_boundaries);
+	RUN_TEST(test_pad_and_drop);
+	return UNITY_END();
+}
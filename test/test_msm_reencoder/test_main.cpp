@@ -0,0 +1,394 @@
+#include <unity.h>
+#include <vector>
+#include <math.h>
+#include "MsmReencoder.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// An MSM message with each field held at the resolution of its own type.
+// .. Encoded and decoded here with RtcmGetUInt/RtcmSetUInt so the test does
+// .. not lean on the reencoder's own bit readers
+struct Msm
+{
+	int type = 1077;
+	int station = 1234;
+	uint32_t epochTime = 123456789;
+	uint32_t flags = 0x2A5A5 & 0x7FFFF;
+	uint64_t satMask = 0;
+	uint32_t sigMask = 0;
+	std::vector<bool> cells;
+	std::vector<int> roughInt, info, roughMod, roughRate;
+	std::vector<int> pseudorange, phase, lock, half, cnr, fineRate;
+
+	inline int Kind() const { return type % 10; }
+	inline bool Rates() const { return Kind() == 5 || Kind() == 7; }
+	inline bool Extended() const { return Kind() >= 6; }
+	inline int SatCount() const { return __builtin_popcountll(satMask); }
+	inline int SigCount() const { return __builtin_popcount(sigMask); }
+};
+
+static void Put(byte *pBytes, int &pos, int len, int value)
+{
+	RtcmSetUInt(pBytes, pos, len, (unsigned int)value & (len == 32 ? 0xFFFFFFFFu : (1u << len) - 1));
+	pos += len;
+}
+
+static int GetSigned(const byte *pBytes, int &pos, int len)
+{
+	int value = RtcmGetUInt(pBytes, pos, len);
+	pos += len;
+	return value >= (1 << (len - 1)) ? value - (1 << len) : value;
+}
+
+static int Get(const byte *pBytes, int &pos, int len)
+{
+	int value = RtcmGetUInt(pBytes, pos, len);
+	pos += len;
+	return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// @return Length of the frame
+static int Encode(const Msm &msm, byte *pOut)
+{
+	memset(pOut, 0, RTCM_MAX_FRAME);
+	int pos = RTCM_TYPE_BIT;
+	Put(pOut, pos, 12, msm.type);
+	Put(pOut, pos, 12, msm.station);
+	Put(pOut, pos, 30, msm.epochTime);
+	Put(pOut, pos, 19, msm.flags);
+	Put(pOut, pos, 32, msm.satMask >> 32);
+	Put(pOut, pos, 32, msm.satMask & 0xFFFFFFFF);
+	Put(pOut, pos, 32, msm.sigMask);
+	for (bool cell : msm.cells)
+		Put(pOut, pos, 1, cell);
+	int sats = msm.SatCount();
+	int cells = msm.pseudorange.size();
+	for (int n = 0; n < sats; n++)
+		Put(pOut, pos, 8, msm.roughInt[n]);
+	if (msm.Rates())
+		for (int n = 0; n < sats; n++)
+			Put(pOut, pos, 4, msm.info[n]);
+	for (int n = 0; n < sats; n++)
+		Put(pOut, pos, 10, msm.roughMod[n]);
+	if (msm.Rates())
+		for (int n = 0; n < sats; n++)
+			Put(pOut, pos, 14, msm.roughRate[n]);
+	for (int n = 0; n < cells; n++)
+		Put(pOut, pos, msm.Extended() ? 20 : 15, msm.pseudorange[n]);
+	for (int n = 0; n < cells; n++)
+		Put(pOut, pos, msm.Extended() ? 24 : 22, msm.phase[n]);
+	for (int n = 0; n < cells; n++)
+		Put(pOut, pos, msm.Extended() ? 10 : 4, msm.lock[n]);
+	for (int n = 0; n < cells; n++)
+		Put(pOut, pos, 1, msm.half[n]);
+	for (int n = 0; n < cells; n++)
+		Put(pOut, pos, msm.Extended() ? 10 : 6, msm.cnr[n]);
+	if (msm.Rates())
+		for (int n = 0; n < cells; n++)
+			Put(pOut, pos, 15, msm.fineRate[n]);
+
+	int messageLength = (pos - RTCM_TYPE_BIT + 7) / 8;
+	pOut[0] = 0xD3;
+	RtcmSetUInt(pOut, 14, 10, messageLength);
+	int length = 3 + messageLength + 3;
+	RtcmSetUInt(pOut, (length - 3) * 8, 24, RtcmCrc24(pOut, length - 3));
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// @return false if the frame is not a whole MSM with good parity
+static bool Decode(const byte *pFrame, int length, Msm &msm)
+{
+	if (pFrame[0] != 0xD3 || (int)RtcmGetUInt(pFrame, 14, 10) + 6 != length)
+		return false;
+	if (RtcmGetUInt(pFrame, (length - 3) * 8, 24) != RtcmCrc24(pFrame, length - 3))
+		return false;
+	int pos = RTCM_TYPE_BIT;
+	msm = Msm();
+	msm.type = Get(pFrame, pos, 12);
+	msm.station = Get(pFrame, pos, 12);
+	msm.epochTime = Get(pFrame, pos, 30);
+	msm.flags = Get(pFrame, pos, 19);
+	msm.satMask = (uint64_t)(uint32_t)Get(pFrame, pos, 32) << 32;
+	msm.satMask |= (uint32_t)Get(pFrame, pos, 32);
+	msm.sigMask = Get(pFrame, pos, 32);
+	int cells = 0;
+	for (int n = 0; n < msm.SatCount() * msm.SigCount(); n++)
+	{
+		msm.cells.push_back(Get(pFrame, pos, 1));
+		cells += msm.cells.back();
+	}
+	int sats = msm.SatCount();
+	for (int n = 0; n < sats; n++)
+		msm.roughInt.push_back(Get(pFrame, pos, 8));
+	if (msm.Rates())
+		for (int n = 0; n < sats; n++)
+			msm.info.push_back(Get(pFrame, pos, 4));
+	for (int n = 0; n < sats; n++)
+		msm.roughMod.push_back(Get(pFrame, pos, 10));
+	if (msm.Rates())
+		for (int n = 0; n < sats; n++)
+			msm.roughRate.push_back(GetSigned(pFrame, pos, 14));
+	for (int n = 0; n < cells; n++)
+		msm.pseudorange.push_back(GetSigned(pFrame, pos, msm.Extended() ? 20 : 15));
+	for (int n = 0; n < cells; n++)
+		msm.phase.push_back(GetSigned(pFrame, pos, msm.Extended() ? 24 : 22));
+	for (int n = 0; n < cells; n++)
+		msm.lock.push_back(Get(pFrame, pos, msm.Extended() ? 10 : 4));
+	for (int n = 0; n < cells; n++)
+		msm.half.push_back(Get(pFrame, pos, 1));
+	for (int n = 0; n < cells; n++)
+		msm.cnr.push_back(Get(pFrame, pos, msm.Extended() ? 10 : 6));
+	if (msm.Rates())
+		for (int n = 0; n < cells; n++)
+			msm.fineRate.push_back(GetSigned(pFrame, pos, 15));
+	return pos <= (length - 3) * 8;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GPS MSM7. Satellites 3, 10 and 20 on signals 2 (L1C) and 15 (L2L).
+// .. Satellite 10 only has the L2L cell
+static Msm SampleMsm7()
+{
+	Msm msm;
+	msm.satMask = (1ull << (64 - 3)) | (1ull << (64 - 10)) | (1ull << (64 - 20));
+	msm.sigMask = (1u << (32 - 2)) | (1u << (32 - 15));
+	msm.cells = {true, true, false, true, true, true};
+	msm.roughInt = {70, 75, 80};
+	msm.info = {0, 3, 15};
+	msm.roughMod = {100, 512, 1023};
+	msm.roughRate = {-500, 0, 8191};
+	msm.pseudorange = {1000, -1000, 524287, 17, -17};
+	msm.phase = {4001, -4001, 8388607, 3, -3};
+	msm.lock = {0, 63, 300, 600, 704};
+	msm.half = {0, 1, 0, 1, 0};
+	msm.cnr = {700, 15, 1023, 16, 512};
+	msm.fineRate = {-16383, 0, 16383, 5, -5};
+	return msm;
+}
+
+static int RoundShift(int value, int shift)
+{
+	return (int)floor((value + (1 << (shift - 1))) / (double)(1 << shift));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MSM7 to MSM4 keeps the header, masks and rough ranges and rounds each cell
+// .. to the coarser steps. Lock time never grows
+void test_msm7_to_msm4_round_trip()
+{
+	Msm in = SampleMsm7();
+	byte frame[RTCM_MAX_FRAME];
+	byte out[RTCM_MAX_FRAME];
+	int length = Encode(in, frame);
+
+	MsmReencoder reencoder;
+	reencoder.Setup(4, 0);
+	int outLength = reencoder.Reencode(frame, length, in.type, 1, out);
+	TEST_ASSERT_GREATER_THAN(0, outLength);
+	TEST_ASSERT_LESS_THAN(length, outLength);
+
+	Msm result;
+	TEST_ASSERT_TRUE(Decode(out, outLength, result));
+	TEST_ASSERT_EQUAL_INT(1074, result.type);
+	TEST_ASSERT_EQUAL_INT(in.station, result.station);
+	TEST_ASSERT_EQUAL_UINT32(in.epochTime, result.epochTime);
+	TEST_ASSERT_EQUAL_UINT32(in.flags, result.flags);
+	TEST_ASSERT_TRUE(in.satMask == result.satMask);
+	TEST_ASSERT_EQUAL_UINT32(in.sigMask, result.sigMask);
+	TEST_ASSERT_TRUE(in.cells == result.cells);
+	TEST_ASSERT_TRUE(in.roughInt == result.roughInt);
+	TEST_ASSERT_TRUE(in.roughMod == result.roughMod);
+	TEST_ASSERT_EQUAL_INT(0, (int)result.info.size());
+	TEST_ASSERT_EQUAL_INT(0, (int)result.fineRate.size());
+
+	for (size_t n = 0; n < in.pseudorange.size(); n++)
+	{
+		// The largest MSM7 values are clamped clear of the MSM4 invalid marker
+		TEST_ASSERT_EQUAL_INT(min(RoundShift(in.pseudorange[n], 5), 16383), result.pseudorange[n]);
+		TEST_ASSERT_EQUAL_INT(min(RoundShift(in.phase[n], 2), 2097151), result.phase[n]);
+		TEST_ASSERT_EQUAL_INT(in.half[n], result.half[n]);
+		TEST_ASSERT_EQUAL_INT(in.cnr[n] >> 4, result.cnr[n]);
+
+		uint32_t lock = MsmReencoder::LockFromExtended(in.lock[n]);
+		TEST_ASSERT_LESS_OR_EQUAL(lock, MsmReencoder::LockFromIndicator(result.lock[n]));
+		if (result.lock[n] < 15)
+			TEST_ASSERT_GREATER_THAN(lock, MsmReencoder::LockFromIndicator(result.lock[n] + 1));
+	}
+	TEST_ASSERT_EQUAL_UINT32(1, reencoder.GetFrames());
+	TEST_ASSERT_EQUAL_UINT64(length - outLength, reencoder.GetBytesSaved());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Keeping one signal drops the L2L column and satellite 10 that only had
+// .. L2L. Kept cells are bit for bit the same at MSM7
+void test_signal_subset()
+{
+	Msm in = SampleMsm7();
+	byte frame[RTCM_MAX_FRAME];
+	byte out[RTCM_MAX_FRAME];
+	int length = Encode(in, frame);
+
+	MsmReencoder reencoder;
+	reencoder.Setup(0, 1);
+	int outLength = reencoder.Reencode(frame, length, in.type, 1, out);
+	TEST_ASSERT_GREATER_THAN(0, outLength);
+
+	Msm result;
+	TEST_ASSERT_TRUE(Decode(out, outLength, result));
+	TEST_ASSERT_EQUAL_INT(1077, result.type);
+	TEST_ASSERT_EQUAL_UINT32(1u << (32 - 2), result.sigMask);
+	TEST_ASSERT_TRUE(((1ull << (64 - 3)) | (1ull << (64 - 20))) == result.satMask);
+	TEST_ASSERT_EQUAL_INT(2, (int)result.cells.size());
+	TEST_ASSERT_TRUE(result.cells[0] && result.cells[1]);
+
+	// Satellites 3 and 20 are the first and last of the input
+	TEST_ASSERT_EQUAL_INT(in.roughInt[0], result.roughInt[0]);
+	TEST_ASSERT_EQUAL_INT(in.roughInt[2], result.roughInt[1]);
+	TEST_ASSERT_EQUAL_INT(in.info[2], result.info[1]);
+	TEST_ASSERT_EQUAL_INT(in.roughRate[2], result.roughRate[1]);
+
+	// L1C cells were 0 (Satellite 3) and 3 (Satellite 20)
+	const int kept[] = {0, 3};
+	for (int n = 0; n < 2; n++)
+	{
+		TEST_ASSERT_EQUAL_INT(in.pseudorange[kept[n]], result.pseudorange[n]);
+		TEST_ASSERT_EQUAL_INT(in.phase[kept[n]], result.phase[n]);
+		TEST_ASSERT_EQUAL_INT(in.lock[kept[n]], result.lock[n]);
+		TEST_ASSERT_EQUAL_INT(in.half[kept[n]], result.half[n]);
+		TEST_ASSERT_EQUAL_INT(in.cnr[kept[n]], result.cnr[n]);
+		TEST_ASSERT_EQUAL_INT(in.fineRate[kept[n]], result.fineRate[n]);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Invalid pseudorange and phase stay invalid at the new width. A valid value
+// .. that would round onto the marker is kept one step clear of it
+void test_invalid_markers()
+{
+	Msm in = SampleMsm7();
+	in.pseudorange[0] = -524288;
+	in.phase[0] = -8388608;
+	in.pseudorange[1] = -524287;
+	in.phase[1] = -8388607;
+	byte frame[RTCM_MAX_FRAME];
+	byte out[RTCM_MAX_FRAME];
+	int length = Encode(in, frame);
+
+	MsmReencoder reencoder;
+	reencoder.Setup(4, 0);
+	int outLength = reencoder.Reencode(frame, length, in.type, 1, out);
+	Msm result;
+	TEST_ASSERT_TRUE(Decode(out, outLength, result));
+	TEST_ASSERT_EQUAL_INT(-16384, result.pseudorange[0]);
+	TEST_ASSERT_EQUAL_INT(-2097152, result.phase[0]);
+	TEST_ASSERT_EQUAL_INT(-16383, result.pseudorange[1]);
+	TEST_ASSERT_EQUAL_INT(-2097151, result.phase[1]);
+
+	// MSM4 invalid markers come back as MSM7 ones when only signals are cut
+	Msm msm4 = result;
+	int length4 = Encode(msm4, frame);
+	reencoder.Setup(0, 1);
+	outLength = reencoder.Reencode(frame, length4, msm4.type, 2, out);
+	TEST_ASSERT_TRUE(Decode(out, outLength, result));
+	TEST_ASSERT_EQUAL_INT(-16384, result.pseudorange[0]);
+	TEST_ASSERT_EQUAL_INT(-2097152, result.phase[0]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A frame shorter than its masks say is passed on untouched. Each copy is
+// .. its exact size so an overread shows up under the address sanitizer
+void test_truncated_frames()
+{
+	Msm in = SampleMsm7();
+	byte frame[RTCM_MAX_FRAME];
+	byte out[RTCM_MAX_FRAME];
+	int length = Encode(in, frame);
+
+	MsmReencoder reencoder;
+	reencoder.Setup(4, 1);
+	for (int cut = 1; cut < length; cut++)
+	{
+		std::vector<byte> shortFrame(frame, frame + length - cut);
+		TEST_ASSERT_EQUAL_INT(0, reencoder.Reencode(shortFrame.data(), shortFrame.size(), in.type, 1, out));
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, reencoder.GetFrames());
+
+	// Masks with more than 64 cells
+	Msm wide = SampleMsm7();
+	wide.satMask = 0xFFFFF00000000000ull;
+	wide.sigMask = 0xF0000000;
+	wide.cells.assign(80, false);
+	wide.roughInt.assign(20, 0);
+	wide.info.assign(20, 0);
+	wide.roughMod.assign(20, 0);
+	wide.roughRate.assign(20, 0);
+	for (auto *pField : {&wide.pseudorange, &wide.phase, &wide.lock, &wide.half, &wide.cnr, &wide.fineRate})
+		pField->clear();
+	length = Encode(wide, frame);
+	TEST_ASSERT_EQUAL_INT(0, reencoder.Reencode(frame, length, wide.type, 1, out));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Frames only lose fields. MSM4 never becomes MSM7 and MSM1-3 pass untouched
+void test_never_adds_fields()
+{
+	Msm in = SampleMsm7();
+	byte frame[RTCM_MAX_FRAME];
+	byte out[RTCM_MAX_FRAME];
+	int length = Encode(in, frame);
+
+	MsmReencoder to4;
+	to4.Setup(4, 0);
+	int length4 = to4.Reencode(frame, length, in.type, 1, out);
+	memcpy(frame, out, length4);
+
+	MsmReencoder to7;
+	to7.Setup(7, 0);
+	TEST_ASSERT_EQUAL_INT(0, to7.Reencode(frame, length4, 1074, 1, out));
+	TEST_ASSERT_EQUAL_INT(0, to7.Reencode(frame, length4, 1073, 1, out));
+
+	// MSM7 to MSM5 keeps the rates but loses the extended resolution
+	length = Encode(in, frame);
+	MsmReencoder to5;
+	to5.Setup(5, 0);
+	int length5 = to5.Reencode(frame, length, in.type, 1, out);
+	Msm result;
+	TEST_ASSERT_TRUE(Decode(out, length5, result));
+	TEST_ASSERT_EQUAL_INT(1075, result.type);
+	TEST_ASSERT_TRUE(in.fineRate == result.fineRate);
+	TEST_ASSERT_TRUE(in.roughRate == result.roughRate);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lock time indicators convert back to no more than the time they came from
+void test_lock_time_rounds_down()
+{
+	for (uint32_t ms = 0; ms < 100000000; ms = ms * 5 / 4 + 1)
+	{
+		TEST_ASSERT_LESS_OR_EQUAL(ms, MsmReencoder::LockFromExtended(MsmReencoder::ExtendedFromLock(ms)));
+		TEST_ASSERT_LESS_OR_EQUAL(ms, MsmReencoder::LockFromIndicator(MsmReencoder::IndicatorFromLock(ms)));
+	}
+	for (uint32_t indicator = 0; indicator <= 704; indicator++)
+		TEST_ASSERT_EQUAL_UINT32(indicator, MsmReencoder::ExtendedFromLock(MsmReencoder::LockFromExtended(indicator)));
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_msm7_to_msm4_round_trip);
+	RUN_TEST(test_signal_subset);
+	RUN_TEST(test_invalid_markers);
+	RUN_TEST(test_truncated_frames);
+	RUN_TEST(test_never_adds_fields);
+	RUN_TEST(test_lock_time_rounds_down);
+	return UNITY_END();
+}
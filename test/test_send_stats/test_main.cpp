@@ -0,0 +1,177 @@
+#include <unity.h>
+#include "SendStats.h"
+
+// Each bucket is within 25% of the values that land in it
+#define BUCKET_ERROR_PERCENT (100 / SEND_HISTOGRAM_SUB)
+
+void setUp()
+{
+	StubMillis() = 1000000;
+}
+
+void tearDown()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Percentile is reported as the top of its bucket. Never under the true
+// .. value and never more than one bucket over it
+static void AssertPercentile(uint32_t expected, uint32_t actual)
+{
+	TEST_ASSERT_GREATER_OR_EQUAL_UINT32(expected, actual);
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(expected + expected * BUCKET_ERROR_PERCENT / 100, actual);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes taking 1 to 1000us once each. The true p50 is 500us, p90 900us
+// .. and p99 990us
+void test_percentiles_of_uniform_writes()
+{
+	SendStats stats;
+	for (uint32_t n = 1; n <= 1000; n++)
+		stats.Add(n, 100);
+	TEST_ASSERT_EQUAL_UINT32(1000, stats.Total());
+	TEST_ASSERT_EQUAL_UINT32(1000, stats.Max());
+	AssertPercentile(500, stats.Percentile(50));
+	AssertPercentile(900, stats.Percentile(90));
+	AssertPercentile(990, stats.Percentile(99));
+	TEST_ASSERT_EQUAL_UINT32(1000, stats.Percentile(100));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A few slow writes among fast ones show at p99 and max but not at p50
+void test_slow_tail_shows_in_p99_only()
+{
+	SendStats stats;
+	for (int n = 0; n < 980; n++)
+		stats.Add(200, 100);
+	for (int n = 0; n < 20; n++)
+		stats.Add(40000 + n, 100);
+	AssertPercentile(200, stats.Percentile(50));
+	AssertPercentile(200, stats.Percentile(90));
+	AssertPercentile(40000, stats.Percentile(99));
+	TEST_ASSERT_EQUAL_UINT32(40019, stats.Max());
+	TEST_ASSERT_EQUAL_UINT32(40019, stats.Percentile(100));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Values under SEND_HISTOGRAM_SUB have a bucket each so come back exact.
+// .. Anything past the last bucket is reported as the max
+void test_small_and_huge_writes()
+{
+	SendStats stats;
+	TEST_ASSERT_EQUAL_UINT32(0, stats.Percentile(50));
+	stats.Add(0, 0);
+	stats.Add(1, 10);
+	stats.Add(2, 10);
+	stats.Add(3, 10);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.Percentile(25));
+	TEST_ASSERT_EQUAL_UINT32(1, stats.Percentile(50));
+	TEST_ASSERT_EQUAL_UINT32(3, stats.Percentile(100));
+
+	stats.Add(UINT32_MAX, 10);
+	TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, stats.Max());
+	TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, stats.Percentile(100));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Send at a steady rate for a millis step and size
+static void SendAt(SendStats &stats, int seconds, int stepMs, uint32_t bytes)
+{
+	for (int n = 0; n < seconds * 1000 / stepMs; n++)
+	{
+		StubMillis() += stepMs;
+		stats.Add(50, bytes);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The throughput EWMA settles on a steady rate and moves a quarter of the
+// .. way to a new rate each second
+void test_throughput_ewma()
+{
+	SendStats stats;
+
+	// The first write closes the window open since boot and starts the next
+	stats.Add(50, 0);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.BytesPerSecond());
+
+	// 100 bytes every 50ms is 2000 B/s
+	SendAt(stats, 20, 50, 100);
+	TEST_ASSERT_UINT32_WITHIN(20, 2000, stats.BytesPerSecond());
+
+	// Up to 8000 B/s. One window in it is 2000 * 3/4 + 8000 / 4
+	SendAt(stats, 1, 50, 400);
+	TEST_ASSERT_UINT32_WITHIN(20, 3500, stats.BytesPerSecond());
+	SendAt(stats, 20, 50, 400);
+	TEST_ASSERT_UINT32_WITHIN(80, 8000, stats.BytesPerSecond());
+
+	// Within a window nothing changes
+	uint32_t before = stats.BytesPerSecond();
+	StubMillis() += 500;
+	stats.Add(50, 0);
+	TEST_ASSERT_EQUAL_UINT32(before, stats.BytesPerSecond());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The ring keeps the last SEND_STATS_SIZE writes in order and its totals
+// .. drop what falls off. The histogram keeps them all
+void test_ring_wraparound()
+{
+	SendStats stats;
+
+	// 10 writes that took a long time and sent nothing then a full ring at
+	// .. 2 bytes per us. Once they are gone the speed is 2000 B/ms exactly
+	for (int n = 0; n < 10; n++)
+		stats.Add(100000, 0);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.WriteSpeed());
+	for (uint32_t n = 1; n <= SEND_STATS_SIZE; n++)
+		stats.Add(n, n * 2);
+
+	TEST_ASSERT_EQUAL_INT(SEND_STATS_SIZE, stats.Count());
+	TEST_ASSERT_EQUAL_UINT32(SEND_STATS_SIZE + 10, stats.Total());
+	TEST_ASSERT_EQUAL_UINT32(2000, stats.WriteSpeed());
+	for (int n = 0; n < SEND_STATS_SIZE; n++)
+	{
+		TEST_ASSERT_EQUAL_UINT32(n + 1, stats.Get(n).micros);
+		TEST_ASSERT_EQUAL_UINT32((n + 1) * 2, stats.Get(n).bytes);
+	}
+
+	// Wrap again part way
+	for (uint32_t n = 0; n < 3; n++)
+		stats.Add(7, 14);
+	TEST_ASSERT_EQUAL_INT(SEND_STATS_SIZE, stats.Count());
+	TEST_ASSERT_EQUAL_UINT32(4, stats.Get(0).micros);
+	TEST_ASSERT_EQUAL_UINT32(7, stats.Get(SEND_STATS_SIZE - 1).micros);
+	TEST_ASSERT_EQUAL_UINT32(2000, stats.WriteSpeed());
+	TEST_ASSERT_EQUAL_UINT32(100000, stats.Max());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void test_reset()
+{
+	SendStats stats;
+	for (int n = 0; n < SEND_STATS_SIZE * 2; n++)
+		stats.Add(1000, 100);
+	stats.Reset();
+	TEST_ASSERT_EQUAL_INT(0, stats.Count());
+	TEST_ASSERT_EQUAL_UINT32(0, stats.Total());
+	TEST_ASSERT_EQUAL_UINT32(0, stats.Max());
+	TEST_ASSERT_EQUAL_UINT32(0, stats.Percentile(99));
+	TEST_ASSERT_EQUAL_UINT32(0, stats.WriteSpeed());
+	stats.Add(5, 10);
+	TEST_ASSERT_EQUAL_INT(1, stats.Count());
+	TEST_ASSERT_EQUAL_UINT32(5, stats.Get(0).micros);
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_percentiles_of_uniform_writes);
+	RUN_TEST(test_slow_tail_shows_in_p99_only);
+	RUN_TEST(test_small_and_huge_writes);
+	RUN_TEST(test_throughput_ewma);
+	RUN_TEST(test_ring_wraparound);
+	RUN_TEST(test_reset);
+	return UNITY_END();
+}
@@ -0,0 +1,362 @@
+#include <unity.h>
+#include <chrono>
+#include <memory>
+#include <climits>
+#include "TextBuilder.h"
+#include "HandyString.h"
+#include "LogFormat.h"
+
+// Calls timed for each benchmark
+#define BENCH_CALLS 200000
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The integers come out like printf for the edges of each width
+void test_integers_like_printf()
+{
+	const int64_t values[] = {0, 1, 9, 10, 99, 100, 12345, INT32_MAX, INT32_MIN, 4294967295LL, 4294967296LL, INT64_MAX, INT64_MIN};
+	char text[TEXT_INTEGER_MAX];
+	char expected[32];
+	for (int64_t value : values)
+	{
+		snprintf(expected, sizeof(expected), "%lld", (long long)value);
+		TEST_ASSERT_EQUAL_INT((int)strlen(expected), FormatSigned(text, sizeof(text), value));
+		TEST_ASSERT_EQUAL_STRING(expected, text);
+		snprintf(expected, sizeof(expected), "%llu", (unsigned long long)value);
+		FormatUnsigned(text, sizeof(text), value);
+		TEST_ASSERT_EQUAL_STRING(expected, text);
+	}
+	TEST_ASSERT_EQUAL_STRING("18446744073709551615", FixedText<TEXT_INTEGER_MAX>().AppendUnsigned(UINT64_MAX).c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Thousands, hex and uptime for values the pages and log show
+void test_thousands_hex_uptime()
+{
+	char text[TEXT_INTEGER_MAX + 6];
+	const struct
+	{
+		int64_t value;
+		const char *pText;
+	} thousands[] = {{0, "0"}, {999, "999"}, {1000, "1,000"}, {-123456, "-123,456"}, {1234567, "1,234,567"}, {INT32_MIN, "-2,147,483,648"}};
+	for (auto &test : thousands)
+	{
+		FormatThousands(text, sizeof(text), test.value);
+		TEST_ASSERT_EQUAL_STRING(test.pText, text);
+	}
+
+	const byte data[] = {0x00, 0x0F, 0xD3, 0xFF};
+	char hex[16];
+	TEST_ASSERT_EQUAL_INT(12, FormatHex(hex, sizeof(hex), data, sizeof(data)));
+	TEST_ASSERT_EQUAL_STRING("00 0f d3 ff ", hex);
+	TEST_ASSERT_EQUAL_INT(8, FormatHex(hex, sizeof(hex), data, sizeof(data), '\0'));
+	TEST_ASSERT_EQUAL_STRING("000fd3ff", hex);
+
+	// Only whole bytes when it does not fit
+	TEST_ASSERT_EQUAL_INT(6, FormatHex(hex, 8, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_STRING("00 0f ", hex);
+
+	char uptime[TEXT_UPTIME_MAX];
+	FormatUptime(uptime, sizeof(uptime), 0);
+	TEST_ASSERT_EQUAL_STRING("0 00:00:00.000", uptime);
+	FormatUptime(uptime, sizeof(uptime), 2 * 86400000UL + 3 * 3600000 + 4 * 60000 + 5678);
+	TEST_ASSERT_EQUAL_STRING("2 03:04:05.678", uptime);
+	FormatUptime(uptime, sizeof(uptime), 4294967295UL);
+	TEST_ASSERT_EQUAL_STRING("49 17:02:47.295", uptime);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A builder never overruns, always ends in '\0' and remembers a cut
+void test_builder_truncates()
+{
+	char buffer[10];
+	memset(buffer, 'x', sizeof(buffer));
+	TextBuilder text(buffer, 8);
+	text.Append("abc").AppendUnsigned(42).Append('-');
+	TEST_ASSERT_EQUAL_STRING("abc42-", text.c_str());
+	TEST_ASSERT_FALSE(text.IsTruncated());
+
+	text.Append("defgh");
+	TEST_ASSERT_EQUAL_STRING("abc42-d", text.c_str());
+	TEST_ASSERT_TRUE(text.IsTruncated());
+	TEST_ASSERT_EQUAL_INT('x', buffer[8]);
+
+	text.Clear();
+	TEST_ASSERT_FALSE(text.IsTruncated());
+	text.Printf("%d-%s", 12345, "long");
+	TEST_ASSERT_EQUAL_STRING("12345-l", text.c_str());
+	TEST_ASSERT_TRUE(text.IsTruncated());
+	text.Printf("more");
+	TEST_ASSERT_EQUAL_INT(7, text.Length());
+
+	const byte data[] = {1, 2, 3};
+	text.Clear();
+	text.Append('[').AppendHex(data, sizeof(data));
+	TEST_ASSERT_EQUAL_STRING("[01 02 ", text.c_str());
+	TEST_ASSERT_TRUE(text.IsTruncated());
+	TEST_ASSERT_EQUAL_INT('x', buffer[8]);
+
+	FixedText<1> empty;
+	empty.Append('a').AppendHex(data, 1).Printf("b");
+	TEST_ASSERT_EQUAL_STRING("", empty.c_str());
+	TEST_ASSERT_TRUE(empty.IsTruncated());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// What the callers made before they used the builder, so the benchmark
+// .. compares like with like
+template <typename... Args>
+static std::string OldStringPrintf(const std::string &format, Args... args)
+{
+	int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) + 1;
+	auto size = static_cast<size_t>(size_s);
+	std::unique_ptr<char[]> buf(new char[size]);
+	std::snprintf(buf.get(), size, format.c_str(), args...);
+	return std::string(buf.get(), buf.get() + size - 1);
+}
+
+static std::string OldToThousands(int number)
+{
+	std::string value = std::to_string(number);
+	int len = value.length();
+	int dlen = 3;
+	while (len > dlen)
+	{
+		value.insert(len - dlen, 1, ',');
+		dlen += 4;
+		len += 1;
+	}
+	return value;
+}
+
+static std::string OldHexDump(const unsigned char *data, int len)
+{
+	std::string hex;
+	for (int n = 0; n < len; n++)
+		hex += OldStringPrintf("%02x ", data[n]);
+	return hex;
+}
+
+static std::string OldUptime(unsigned long millis)
+{
+	uint32_t t = millis / 1000;
+	std::string uptime = OldStringPrintf(":%02d.%03d", t % 60, millis % 1000);
+	t /= 60;
+	uptime = OldStringPrintf(":%02d", t % 60) + uptime;
+	t /= 60;
+	uptime = OldStringPrintf("%02d", t % 24) + uptime;
+	t /= 24;
+	uptime = OldStringPrintf("%d ", t) + uptime;
+	return uptime;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The converted callers make the same text as the code they replaced
+static int OldSyslogHeader(char *pHeader, int size, int pri, const char *pHost, uint32_t seq, int count, uint32_t lost)
+{
+	int length = snprintf(pHeader, size, "<%d>1 - %s ntrip-server - LOG [log@32473 seq=\"%u\" count=\"%d\" lost=\"%u\"] ", pri, pHost, seq, count, lost);
+	return min(length, size - 1);
+}
+
+static void NewSyslogHeader(TextBuilder &header, int pri, const char *pHost, uint32_t seq, int count, uint32_t lost)
+{
+	header.Append('<').AppendUnsigned(pri).Append(">1 - ").Append(pHost);
+	header.Append(" ntrip-server - LOG [log@32473 seq=\"").AppendUnsigned(seq);
+	header.Append("\" count=\"").AppendSigned(count).Append("\" lost=\"").AppendUnsigned(lost).Append("\"] ");
+}
+
+static int OldJsonEscape(char *pOut, const char *pLine, int n)
+{
+	int length = 0;
+	for (int i = 0; i < n; i++)
+	{
+		char c = pLine[i];
+		if (c == '"' || c == '\\')
+		{
+			pOut[length++] = '\\';
+			pOut[length++] = c;
+		}
+		else if ((byte)c < ' ' || (byte)c >= 0x80)
+		{
+			length += sprintf(pOut + length, "\\u%04x", (byte)c);
+		}
+		else
+		{
+			pOut[length++] = c;
+		}
+	}
+	pOut[length] = '\0';
+	return length;
+}
+
+static void NewJsonEscape(TextBuilder &json, const char *pLine, int n)
+{
+	int plain = 0;
+	for (int i = 0; i < n; i++)
+	{
+		byte c = pLine[i];
+		if (c >= ' ' && c < 0x80 && c != '"' && c != '\\')
+			continue;
+		json.Append(pLine + plain, i - plain);
+		plain = i + 1;
+		if (c == '"' || c == '\\')
+			json.Append('\\').Append((char)c);
+		else
+			json.Append("\\u00", 4).AppendHex(&c, 1, '\0');
+	}
+	json.Append(pLine + plain, n - plain);
+}
+
+void test_callers_match_old_text()
+{
+	char old[200];
+	FixedText<200> header;
+	int oldLength = OldSyslogHeader(old, sizeof(old), 131, "RTK_abcdef", 4000000000u, 17, 3);
+	NewSyslogHeader(header, 131, "RTK_abcdef", 4000000000u, 17, 3);
+	TEST_ASSERT_EQUAL_INT(oldLength, header.Length());
+	TEST_ASSERT_EQUAL_STRING(old, header.c_str());
+
+	const char line[] = "0 00:00:01.000 \"Quote\" back\\slash \x01 tab\t high\xB0\xFF end";
+	FixedText<200> json;
+	oldLength = OldJsonEscape(old, line, sizeof(line) - 1);
+	NewJsonEscape(json, line, sizeof(line) - 1);
+	TEST_ASSERT_EQUAL_STRING(old, json.c_str());
+	TEST_ASSERT_NOT_NULL(strstr(json.c_str(), "\\u00b0\\u00ff"));
+
+	for (int value : {0, 7, 999, 1000, 65535, 1234567, INT32_MAX})
+		TEST_ASSERT_EQUAL_STRING(OldToThousands(value).c_str(), FixedText<TEXT_INTEGER_MAX + 6>().AppendThousands(value).c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Time for each call in ns
+template <typename F>
+static double NanosPerCall(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int n = 0; n < BENCH_CALLS; n++)
+		f(n);
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>(elapsed).count() / BENCH_CALLS;
+}
+
+static void Report(const char *pName, double oldNs, double newNs)
+{
+	char text[120];
+	snprintf(text, sizeof(text), "%-22s old %6.0fns new %6.0fns (%.1fx)", pName, oldNs, newNs, oldNs / newNs);
+	TEST_MESSAGE(text);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Each function and each converted caller against the code it replaced.
+// .. Host numbers, so only the ratios carry over to the ESP32
+void test_benchmark()
+{
+	volatile size_t sink = 0;
+	char text[LOG_LINE_MAX];
+	byte data[32];
+	for (int n = 0; n < (int)sizeof(data); n++)
+		data[n] = n * 37;
+
+	// Functions
+	double oldNs = NanosPerCall([&](int n)
+								{ sink += OldStringPrintf("%d", n * 1234).size(); });
+	double newNs = NanosPerCall([&](int n)
+								{ sink += FixedText<TEXT_INTEGER_MAX>().AppendSigned(n * 1234).Length(); });
+	Report("AppendSigned", oldNs, newNs);
+
+	oldNs = NanosPerCall([&](int n)
+						 { sink += OldToThousands(n * 1234).size(); });
+	newNs = NanosPerCall([&](int n)
+						 { sink += FixedText<TEXT_INTEGER_MAX + 6>().AppendThousands(n * 1234).Length(); });
+	Report("AppendThousands", oldNs, newNs);
+
+	double hexOldNs = NanosPerCall([&](int n)
+								   { data[0] = n; sink += OldHexDump(data, sizeof(data)).size(); });
+	double hexNewNs = NanosPerCall([&](int n)
+								   {
+		data[0] = n;
+		TextBuilder hex(text, sizeof(text));
+		sink += hex.AppendHex(data, sizeof(data)).Length(); });
+	Report("AppendHex 32 bytes", hexOldNs, hexNewNs);
+
+	double uptimeOldNs = NanosPerCall([&](int n)
+									  { sink += OldUptime(n * 12347UL).size(); });
+	double uptimeNewNs = NanosPerCall([&](int n)
+									  { sink += FixedText<TEXT_UPTIME_MAX>().AppendUptime(n * 12347UL).Length(); });
+	Report("AppendUptime", uptimeOldNs, uptimeNewNs);
+
+	oldNs = NanosPerCall([&](int n)
+						 { sink += OldStringPrintf(" caster%d=\"%s\" caster%dAge=\"%lu\"", 1, "Connected", 1, (unsigned long)n).size(); });
+	newNs = NanosPerCall([&](int n)
+						 {
+		TextBuilder params(text, sizeof(text));
+		sink += params.Printf(" caster%d=\"%s\" caster%dAge=\"%lu\"", 1, "Connected", 1, (unsigned long)n).Length(); });
+	Report("Printf metrics", oldNs, newNs);
+
+	// Callers
+	oldNs = NanosPerCall([&](int n)
+						 { sink += OldSyslogHeader(text, 160, 134, "RTK_abcdef", n, 9, 0); });
+	newNs = NanosPerCall([&](int n)
+						 {
+		FixedText<160> header;
+		NewSyslogHeader(header, 134, "RTK_abcdef", n, 9, 0);
+		sink += header.Length(); });
+	Report("Syslog header", oldNs, newNs);
+
+	const char line[] = "0 00:12:34.567 GPS2 W703 - Skipped [12] \"d3 00 13\" \\ \x01\xB0 and some more words to make it a typical line";
+	char json[sizeof(line) * 6];
+	oldNs = NanosPerCall([&](int)
+						 { sink += OldJsonEscape(json, line, sizeof(line) - 1); });
+	newNs = NanosPerCall([&](int)
+						 {
+		TextBuilder escaped(json, sizeof(json));
+		NewJsonEscape(escaped, line, sizeof(line) - 1);
+		sink += escaped.Length(); });
+	Report("ApiLog escape", oldNs, newNs);
+
+	// The LogStore batch now renders to a line and appends it, one copy more
+	static char batch[4096];
+	static union
+	{
+		LogRecord header;
+		byte bytes[sizeof(LogRecord) + sizeof(line)];
+	} record;
+	record.header.kind = LOG_KIND_TEXT;
+	record.header.source = LOG_SYSTEM;
+	record.header.length = sizeof(line) - 1;
+	memcpy(record.bytes + sizeof(LogRecord), line, sizeof(line));
+	oldNs = NanosPerCall([&](int)
+						 {
+		int length = LogRender(record.header, batch, sizeof(batch) - 2);
+		batch[length++] = '\r';
+		batch[length++] = '\n';
+		sink += length; });
+	newNs = NanosPerCall([&](int)
+						 {
+		TextBuilder store(batch, sizeof(batch));
+		store.Append(text, LogRender(record.header, text, sizeof(text))).Append("\r\n", 2);
+		sink += store.Length(); });
+	Report("LogStore batch line", oldNs, newNs);
+
+	// Only the gaps too big to be noise are checked
+	TEST_ASSERT_LESS_THAN(hexOldNs, hexNewNs);
+	TEST_ASSERT_LESS_THAN(uptimeOldNs, uptimeNewNs);
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_integers_like_printf);
+	RUN_TEST(test_thousands_hex_uptime);
+	RUN_TEST(test_builder_truncates);
+	RUN_TEST(test_callers_match_old_text);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+###############################################################################
+# TLS front for the stand-in caster so a tls=1 uplink can be checked without
+# .. a real TLS caster. Terminates TLS and passes the plain stream on to
+# .. caster_standin.py, which checks the chunks and frames as usual. Prints
+# .. the SHA256 fingerprint of its certificate in the form fp= takes, and the
+# .. handshake time and bytes each way for every connection
+#
+#	python3 test/caster_standin.py --port 2101 --password secret
+#	python3 test/tls_standin.py --port 2102 --target 127.0.0.1:2101
+#	python3 test/tls_standin.py --self-test
+#
+# Point a caster at this machine port 2102 with tls=1 fp=<printed>. Without
+# .. --cert/--key a self-signed certificate is made with openssl. Check the
+# .. ESP32 refuses it (E508) when fp= is left out or is wrong
+###############################################################################
+import argparse
+import hashlib
+import os
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+import caster_standin
+
+
+# Self-signed certificate for a quick test
+# @return Paths of the certificate and key
+def MakeCertificate(folder, name='caster-standin'):
+	cert = os.path.join(folder, 'standin.pem')
+	key = os.path.join(folder, 'standin.key')
+	subprocess.run(['openssl', 'req', '-x509', '-newkey', 'rsa:2048', '-nodes', '-days', '30', '-subj', '/CN=%s' % name,
+					'-keyout', key, '-out', cert], check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+	return cert, key
+
+
+# SHA256 of the DER certificate as lower case hex, the form fp= takes
+def Fingerprint(certPath):
+	with open(certPath) as file:
+		der = ssl.PEM_cert_to_DER_cert(file.read())
+	return hashlib.sha256(der).hexdigest()
+
+
+# Copy one direction until it closes. Bytes copied go in counts[key]
+def Pump(source, destination, counts, key):
+	try:
+		while True:
+			data = source.recv(4096)
+			if not data:
+				break
+			destination.sendall(data)
+			counts[key] += len(data)
+	except OSError:
+		pass
+	finally:
+		try:
+			destination.shutdown(socket.SHUT_WR)
+		except OSError:
+			pass
+
+
+# Handshake then pass the plain stream to the target both ways
+def ServeConnection(connection, address, context, target, log):
+	start = time.time()
+	try:
+		tlsConnection = context.wrap_socket(connection, server_side=True)
+	except (ssl.SSLError, OSError) as error:
+		log('%s TLS handshake failed: %s' % (address[0], error))
+		connection.close()
+		return
+	handshake = time.time() - start
+	log('%s TLS %s %s handshake %.0fms' % (address[0], tlsConnection.version(), tlsConnection.cipher()[0], handshake * 1000))
+	upstream = socket.create_connection(target)
+	counts = {'in': 0, 'out': 0}
+	back = threading.Thread(target=Pump, args=(upstream, tlsConnection, counts, 'out'))
+	back.start()
+	Pump(tlsConnection, upstream, counts, 'in')
+	back.join()
+	tlsConnection.close()
+	upstream.close()
+	log('%s closed after %.1fs. %d bytes in, %d bytes out' % (address[0], time.time() - start, counts['in'], counts['out']))
+
+
+def MakeContext(cert, key):
+	context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+	context.load_cert_chain(cert, key)
+	return context
+
+
+def Serve(port, target, cert, key):
+	folder = None
+	if cert is None:
+		folder = tempfile.TemporaryDirectory()
+		cert, key = MakeCertificate(folder.name)
+	context = MakeContext(cert, key)
+	listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+	listener.bind(('', port))
+	listener.listen(4)
+	print('TLS stand-in on port %d passing to %s:%d' % (port, target[0], target[1]))
+	print('Caster options: tls=1 fp=%s' % Fingerprint(cert))
+	while True:
+		connection, address = listener.accept()
+		threading.Thread(target=ServeConnection, args=(connection, address, context, target, print), daemon=True).start()
+
+
+###############################################################################
+# A v2 source through the TLS front to the checking caster. The client checks
+# .. the certificate against the printed fingerprint the way fp= does
+def SelfTest():
+	with tempfile.TemporaryDirectory() as folder:
+		cert, key = MakeCertificate(folder)
+		fingerprint = Fingerprint(cert)
+		casterPort, casterThread, result = caster_standin.StartTestCaster()
+
+		listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+		listener.bind(('127.0.0.1', 0))
+		listener.listen(1)
+		port = listener.getsockname()[1]
+		context = MakeContext(cert, key)
+
+		def Front():
+			connection, address = listener.accept()
+			listener.close()
+			ServeConnection(connection, address, context, ('127.0.0.1', casterPort), lambda text: None)
+
+		front = threading.Thread(target=Front)
+		front.start()
+
+		# No CA, so trust comes only from the pin like fp= on the ESP32
+		client = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+		client.check_hostname = False
+		client.verify_mode = ssl.CERT_NONE
+		connection = client.wrap_socket(socket.create_connection(('127.0.0.1', port)))
+		seen = hashlib.sha256(connection.getpeercert(binary_form=True)).hexdigest()
+		if seen != fingerprint:
+			print('FAIL fingerprint %s, expected %s' % (seen, fingerprint))
+			return 1
+
+		epochs = 20
+		stream, expected = caster_standin.TestStream(epochs)
+		if not caster_standin.SendTestSource(connection, stream):
+			print('FAIL no 200 reply through TLS')
+			return 1
+		connection.close()
+		front.join()
+		casterThread.join()
+		print('Fingerprint pinned %s' % fingerprint)
+		return caster_standin.CheckResult(result, epochs, expected)
+
+
+def Target(text):
+	host, _, port = text.rpartition(':')
+	return (host or '127.0.0.1', int(port))
+
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description='TLS front for the stand-in caster')
+	parser.add_argument('--port', type=int, default=2102)
+	parser.add_argument('--target', type=Target, default=('127.0.0.1', 2101), help='Plain stand-in caster host:port')
+	parser.add_argument('--cert', default=None, help='PEM certificate (Self-signed if not set)')
+	parser.add_argument('--key', default=None, help='PEM private key for --cert')
+	parser.add_argument('--self-test', action='store_true', help='Send a v2 source through TLS to a checking caster')
+	args = parser.parse_args()
+	sys.exit(SelfTest() if args.self_test else Serve(args.port, args.target, args.cert, args.key))